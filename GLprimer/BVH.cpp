@@ -0,0 +1,611 @@
+/*
+ * A bounding volume hierarchy over the triangles of a Mesh, for ray queries on the CPU.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "BVH.hpp"
+#include "Mesh.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_USE_SSE2
+#endif
+
+static_assert(sizeof(BVH::Node) == 32, "BVH nodes should be 32 bytes");
+
+namespace {
+
+// Nodes with more triangles than this build their subtrees as separate jobs
+const uint32_t parallelThreshold = 8192;
+
+const float infinity = std::numeric_limits<float>::infinity();
+
+// A box with a fourth, unused lane, so SSE2 can grow it in one instruction per side
+struct alignas(16) Box {
+    float min[4] = {infinity, infinity, infinity, infinity};
+    float max[4] = {-infinity, -infinity, -infinity, -infinity};
+};
+
+struct BuildTriangle {
+    Box bounds;
+    float centroid[3];
+    uint32_t id;  // Index in the mesh, in the fourth lane of the centroid
+};
+
+struct Bin {
+    Box bounds;
+    uint32_t count = 0;
+};
+
+// Grow the box to hold the box or the point from min to max, whose fourth lanes are ignored
+void grow(Box& box, const float* min, const float* max) {
+#ifdef BVH_USE_SSE2
+    _mm_store_ps(box.min, _mm_min_ps(_mm_load_ps(box.min), _mm_load_ps(min)));
+    _mm_store_ps(box.max, _mm_max_ps(_mm_load_ps(box.max), _mm_load_ps(max)));
+#else
+    for (int axis = 0; axis < 3; axis++) {
+        box.min[axis] = std::min(box.min[axis], min[axis]);
+        box.max[axis] = std::max(box.max[axis], max[axis]);
+    }
+#endif
+}
+
+void grow(Box& box, const Box& other) { grow(box, other.min, other.max); }
+
+float surfaceArea(const float min[3], const float max[3]) {
+    const float x = max[0] - min[0];
+    const float y = max[1] - min[1];
+    const float z = max[2] - min[2];
+    return (x < 0.0f) ? 0.0f : 2.0f * (x * y + y * z + z * x);
+}
+
+float surfaceArea(const Box& box) { return surfaceArea(box.min, box.max); }
+
+int binIndex(float centroid, float min, float scale) {
+    return std::min(BVH::binCount - 1, static_cast<int>((centroid - min) * scale));
+}
+
+// Distance along the ray to the box, or infinity if it is missed or further than tMax
+float boxDistance(const BVH::Node& node, const float origin[3], const float inverse[3],
+                  float tMax) {
+    float tEnter = 0.0f;
+    float tExit = tMax;
+    for (int axis = 0; axis < 3; axis++) {
+        const float t1 = (node.min[axis] - origin[axis]) * inverse[axis];
+        const float t2 = (node.max[axis] - origin[axis]) * inverse[axis];
+        tEnter = std::max(tEnter, std::min(t1, t2));
+        tExit = std::min(tExit, std::max(t1, t2));
+    }
+    return (tEnter <= tExit) ? tEnter : infinity;
+}
+
+#ifdef BVH_USE_SSE2
+// Horizontal minimum of the four lanes
+float minLane(__m128 value) {
+    value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(1, 0, 3, 2)));
+    value = _mm_min_ps(value, _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(value);
+}
+
+__m128 select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+}  // namespace
+
+struct BVH::BuildState {
+    std::vector<BuildTriangle> triangles;  // Sorted in place into leaf order
+    std::atomic<uint32_t> nodesUsed{0};
+};
+
+BVH::BVH() : memory_(MemoryTracker::BVHs) {}
+
+bool BVH::build(const Mesh& mesh, unsigned numThreads) {
+    TRACE_ZONE("BVH::build");
+    const auto start = std::chrono::steady_clock::now();
+    const size_t triangleCount = static_cast<size_t>(mesh.triangleCount());
+    const std::vector<GLfloat>& vertices = mesh.vertices();
+    const std::vector<GLuint>& indices = mesh.indices();
+    clear();
+    if (mesh.empty() || triangleCount == 0 ||
+        vertices.size() < 8 * static_cast<size_t>(mesh.vertexCount()) ||
+        indices.size() < 3 * triangleCount) {
+        std::cerr << "A BVH needs a mesh with vertex and index arrays and at least one "
+                     "triangle\n";
+        return false;
+    }
+
+    // Bounds and centroids of the triangles, and at most 2 n nodes, counting the unused one
+    BuildState state;
+    state.triangles.resize(triangleCount);
+    nodes_.resize(2 * triangleCount);
+    MemoryTracker::Allocation scratch(MemoryTracker::BVHs,
+                                      triangleCount * sizeof(BuildTriangle) +
+                                          nodes_.capacity() * sizeof(Node));
+    for (size_t i = 0; i < triangleCount; i++) {
+        BuildTriangle& triangle = state.triangles[i];
+        triangle.id = static_cast<uint32_t>(i);
+        for (int axis = 0; axis < 3; axis++) {
+            const GLfloat a = vertices[8 * indices[3 * i] + axis];
+            const GLfloat b = vertices[8 * indices[3 * i + 1] + axis];
+            const GLfloat c = vertices[8 * indices[3 * i + 2] + axis];
+            triangle.bounds.min[axis] = std::min({a, b, c});
+            triangle.bounds.max[axis] = std::max({a, b, c});
+            triangle.centroid[axis] = (a + b + c) / 3.0f;
+        }
+    }
+
+    // Children are allocated in pairs from node 2, so siblings share a cache line
+    Node& root = nodes_[0];
+    root.leftFirst = 0;
+    root.count = static_cast<uint32_t>(triangleCount);
+    state.nodesUsed = 2;
+    if (numThreads != 1 && triangleCount > parallelThreshold) {
+        ThreadPool pool(numThreads);
+        subdivide(state, 0, 0, &pool);
+        pool.wait();
+    } else {
+        subdivide(state, 0, 0, nullptr);
+    }
+    nodes_.resize(state.nodesUsed);
+    nodes_.shrink_to_fit();
+
+    // Store the triangles in leaf order, ready for the intersection test
+    triangles_.resize(triangleCount);
+    triangleIds_.resize(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++) {
+        const uint32_t id = state.triangles[i].id;
+        triangleIds_[i] = id;
+        const GLfloat* v0 = &vertices[8 * indices[3 * id]];
+        const GLfloat* v1 = &vertices[8 * indices[3 * id + 1]];
+        const GLfloat* v2 = &vertices[8 * indices[3 * id + 2]];
+        Triangle& triangle = triangles_[i];
+        for (int axis = 0; axis < 3; axis++) {
+            triangle.v0[axis] = v0[axis];
+            triangle.edge1[axis] = v1[axis] - v0[axis];
+            triangle.edge2[axis] = v2[axis] - v0[axis];
+        }
+    }
+    memory_.resize(nodes_.capacity() * sizeof(Node) + triangles_.capacity() * sizeof(Triangle) +
+                   triangleIds_.capacity() * sizeof(uint32_t));
+
+    computeStats();
+    stats_.buildMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return true;
+}
+
+/* Split the triangles of the node where the surface area heuristic is lowest, among the
+ * planes between binCount bins of the centroids along each axis. A leaf costs one per
+ * triangle and a split one for the traversal plus the cost of the children, weighted by
+ * their area relative to the node. */
+void BVH::subdivide(BuildState& state, uint32_t nodeIndex, int depth, ThreadPool* pool) {
+    Node& node = nodes_[nodeIndex];
+    const uint32_t first = node.leftFirst;
+    const uint32_t count = node.count;
+    Box bounds;
+    Box centroidBounds;
+    for (uint32_t i = first; i < first + count; i++) {
+        const BuildTriangle& triangle = state.triangles[i];
+        grow(bounds, triangle.bounds);
+        grow(centroidBounds, triangle.centroid, triangle.centroid);
+    }
+    std::copy(bounds.min, bounds.min + 3, node.min);
+    std::copy(bounds.max, bounds.max + 3, node.max);
+    const float* centroidMin = centroidBounds.min;
+    if (count <= 2 || depth >= maxDepth - 1) {
+        return;
+    }
+
+    // Bin the centroids along all axes in one pass over the triangles
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const float extent = centroidBounds.max[axis] - centroidMin[axis];
+        scale[axis] = (extent > 0.0f) ? binCount / extent : 0.0f;
+    }
+    Bin bins[3][binCount];
+    for (uint32_t i = first; i < first + count; i++) {
+        const BuildTriangle& triangle = state.triangles[i];
+        for (int axis = 0; axis < 3; axis++) {
+            Bin& bin =
+                bins[axis][binIndex(triangle.centroid[axis], centroidMin[axis], scale[axis])];
+            bin.count++;
+            grow(bin.bounds, triangle.bounds);
+        }
+    }
+
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = infinity;
+    for (int axis = 0; axis < 3; axis++) {
+        if (scale[axis] == 0.0f) {
+            continue;
+        }
+        // Sweep from the left and then from the right, split s puts bins below s left
+        float leftCost[binCount];
+        Bin left;
+        for (int s = 1; s < binCount; s++) {
+            left.count += bins[axis][s - 1].count;
+            grow(left.bounds, bins[axis][s - 1].bounds);
+            leftCost[s] = left.count * surfaceArea(left.bounds);
+        }
+        Bin right;
+        for (int s = binCount - 1; s > 0; s--) {
+            right.count += bins[axis][s].count;
+            grow(right.bounds, bins[axis][s].bounds);
+            if (right.count == 0 || right.count == count) {
+                continue;
+            }
+            const float cost = leftCost[s] + right.count * surfaceArea(right.bounds);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = s;
+            }
+        }
+    }
+
+    const float area = surfaceArea(bounds);
+    const bool splitPays = bestAxis >= 0 && area + bestCost < count * area;
+    if (!splitPays && count <= maxLeafSize) {
+        return;
+    }
+    uint32_t leftCount = count / 2;  // When all centroids are in one place
+    if (bestAxis >= 0) {
+        BuildTriangle* begin = state.triangles.data() + first;
+        BuildTriangle* middle =
+            std::partition(begin, begin + count, [&](const BuildTriangle& triangle) {
+                return binIndex(triangle.centroid[bestAxis], centroidMin[bestAxis],
+                                scale[bestAxis]) < bestSplit;
+            });
+        leftCount = static_cast<uint32_t>(middle - begin);
+    }
+
+    const uint32_t leftIndex = state.nodesUsed.fetch_add(2);
+    Node& leftChild = nodes_[leftIndex];
+    Node& rightChild = nodes_[leftIndex + 1];
+    leftChild.leftFirst = first;
+    leftChild.count = leftCount;
+    rightChild.leftFirst = first + leftCount;
+    rightChild.count = count - leftCount;
+    node.leftFirst = leftIndex;
+    node.count = 0;
+
+    if (pool && count > parallelThreshold) {
+        pool->enqueue([this, &state, leftIndex, depth, pool]() {
+            subdivide(state, leftIndex, depth + 1, pool);
+        });
+    } else {
+        subdivide(state, leftIndex, depth + 1, pool);
+    }
+    subdivide(state, leftIndex + 1, depth + 1, pool);
+}
+
+void BVH::clear() {
+    std::vector<Node>().swap(nodes_);
+    std::vector<Triangle>().swap(triangles_);
+    std::vector<uint32_t>().swap(triangleIds_);
+    stats_ = Stats();
+    memory_.resize(0);
+}
+
+bool BVH::intersect(const Ray& ray, Hit& hit) const { return traverse<false>(ray, hit); }
+
+bool BVH::occluded(const Ray& ray) const {
+    Hit hit;
+    return traverse<true>(ray, hit);
+}
+
+/* Visit the nearer child first and push the other one, skipping the children that the ray
+ * misses or reaches beyond the closest hit so far */
+template <bool anyHit>
+bool BVH::traverse(const Ray& ray, Hit& hit) const {
+    if (nodes_.empty()) {
+        return false;
+    }
+    const float* origin = ray.origin.data();
+    const float* direction = ray.direction.data();
+    const float inverse[3] = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+    float tMax = ray.tMax;
+    bool found = false;
+    uint32_t stack[maxDepth];
+    int stackSize = 0;
+    const Node* node = &nodes_[0];
+    if (boxDistance(*node, origin, inverse, tMax) == infinity) {
+        return false;
+    }
+
+    while (true) {
+        if (node->count > 0) {
+            // Moller-Trumbore intersection with each triangle of the leaf
+            for (uint32_t i = node->leftFirst; i < node->leftFirst + node->count; i++) {
+                const Triangle& triangle = triangles_[i];
+                const float* e1 = triangle.edge1;
+                const float* e2 = triangle.edge2;
+                const float p[3] = {direction[1] * e2[2] - direction[2] * e2[1],
+                                    direction[2] * e2[0] - direction[0] * e2[2],
+                                    direction[0] * e2[1] - direction[1] * e2[0]};
+                const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+                if (det == 0.0f) {
+                    continue;
+                }
+                const float inverseDet = 1.0f / det;
+                const float s[3] = {origin[0] - triangle.v0[0], origin[1] - triangle.v0[1],
+                                    origin[2] - triangle.v0[2]};
+                const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDet;
+                if (!(u >= 0.0f && u <= 1.0f)) {
+                    continue;
+                }
+                const float q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2],
+                                    s[0] * e1[1] - s[1] * e1[0]};
+                const float v =
+                    (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverseDet;
+                if (!(v >= 0.0f && u + v <= 1.0f)) {
+                    continue;
+                }
+                const float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverseDet;
+                if (t > 0.0f && t < tMax) {
+                    if (anyHit) {
+                        return true;
+                    }
+                    tMax = t;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangle = triangleIds_[i];
+                    found = true;
+                }
+            }
+            if (stackSize == 0) {
+                break;
+            }
+            node = &nodes_[stack[--stackSize]];
+            continue;
+        }
+
+        uint32_t near = node->leftFirst;
+        uint32_t far = near + 1;
+        float nearDistance = boxDistance(nodes_[near], origin, inverse, tMax);
+        float farDistance = boxDistance(nodes_[far], origin, inverse, tMax);
+        if (farDistance < nearDistance) {
+            std::swap(near, far);
+            std::swap(nearDistance, farDistance);
+        }
+        if (nearDistance == infinity) {
+            if (stackSize == 0) {
+                break;
+            }
+            node = &nodes_[stack[--stackSize]];
+        } else {
+            node = &nodes_[near];
+            if (farDistance != infinity) {
+                stack[stackSize++] = far;
+            }
+        }
+    }
+    return found;
+}
+
+unsigned BVH::intersect4(const Ray rays[4], Hit hits[4]) const {
+    return traverse4<false>(rays, hits);
+}
+
+unsigned BVH::occluded4(const Ray rays[4]) const {
+    Hit hits[4];
+    return traverse4<true>(rays, hits);
+}
+
+#ifdef BVH_USE_SSE2
+/* Trace the four rays down the tree together, with one lane per ray. A node is visited if any
+ * of the rays still looking hits it, and the child that the rays reach first is visited
+ * first. Lanes that have found a hit in any-hit mode are done. */
+template <bool anyHit>
+unsigned BVH::traverse4(const Ray rays[4], Hit hits[4]) const {
+    if (nodes_.empty()) {
+        return 0;
+    }
+    __m128 origin[3], direction[3], inverse[3];
+    for (int axis = 0; axis < 3; axis++) {
+        origin[axis] = _mm_setr_ps(rays[0].origin[axis], rays[1].origin[axis],
+                                   rays[2].origin[axis], rays[3].origin[axis]);
+        direction[axis] = _mm_setr_ps(rays[0].direction[axis], rays[1].direction[axis],
+                                      rays[2].direction[axis], rays[3].direction[axis]);
+        inverse[axis] = _mm_div_ps(_mm_set1_ps(1.0f), direction[axis]);
+    }
+    __m128 tMax = _mm_setr_ps(rays[0].tMax, rays[1].tMax, rays[2].tMax, rays[3].tMax);
+    __m128 hitU = _mm_setzero_ps();
+    __m128 hitV = _mm_setzero_ps();
+    __m128 hitIndex = _mm_castsi128_ps(_mm_set1_epi32(-1));  // Leaf order index, or -1
+    __m128 active = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 far = _mm_set1_ps(infinity);
+
+    // Entry distances of the rays that hit the box, infinity for the others
+    const auto boxDistance4 = [&](const Node& box) {
+        __m128 tEnter = zero;
+        __m128 tExit = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            const __m128 t1 =
+                _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.min[axis]), origin[axis]), inverse[axis]);
+            const __m128 t2 =
+                _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box.max[axis]), origin[axis]), inverse[axis]);
+            tEnter = _mm_max_ps(tEnter, _mm_min_ps(t1, t2));
+            tExit = _mm_min_ps(tExit, _mm_max_ps(t1, t2));
+        }
+        return select(_mm_and_ps(active, _mm_cmple_ps(tEnter, tExit)), tEnter, far);
+    };
+
+    uint32_t stack[maxDepth];
+    int stackSize = 0;
+    const Node* node = &nodes_[0];
+    if (minLane(boxDistance4(*node)) == infinity) {
+        return 0;
+    }
+
+    while (true) {
+        if (node->count > 0) {
+            for (uint32_t i = node->leftFirst; i < node->leftFirst + node->count; i++) {
+                const Triangle& triangle = triangles_[i];
+                const __m128 e1[3] = {_mm_set1_ps(triangle.edge1[0]),
+                                      _mm_set1_ps(triangle.edge1[1]),
+                                      _mm_set1_ps(triangle.edge1[2])};
+                const __m128 e2[3] = {_mm_set1_ps(triangle.edge2[0]),
+                                      _mm_set1_ps(triangle.edge2[1]),
+                                      _mm_set1_ps(triangle.edge2[2])};
+                const __m128 p[3] = {
+                    _mm_sub_ps(_mm_mul_ps(direction[1], e2[2]), _mm_mul_ps(direction[2], e2[1])),
+                    _mm_sub_ps(_mm_mul_ps(direction[2], e2[0]), _mm_mul_ps(direction[0], e2[2])),
+                    _mm_sub_ps(_mm_mul_ps(direction[0], e2[1]), _mm_mul_ps(direction[1], e2[0]))};
+                const __m128 det = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(e1[0], p[0]), _mm_mul_ps(e1[1], p[1])),
+                    _mm_mul_ps(e1[2], p[2]));
+                const __m128 inverseDet = _mm_div_ps(one, det);
+                const __m128 s[3] = {_mm_sub_ps(origin[0], _mm_set1_ps(triangle.v0[0])),
+                                     _mm_sub_ps(origin[1], _mm_set1_ps(triangle.v0[1])),
+                                     _mm_sub_ps(origin[2], _mm_set1_ps(triangle.v0[2]))};
+                const __m128 u = _mm_mul_ps(
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], p[0]), _mm_mul_ps(s[1], p[1])),
+                               _mm_mul_ps(s[2], p[2])),
+                    inverseDet);
+                const __m128 q[3] = {
+                    _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1])),
+                    _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2])),
+                    _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]))};
+                const __m128 v = _mm_mul_ps(
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(direction[0], q[0]),
+                                          _mm_mul_ps(direction[1], q[1])),
+                               _mm_mul_ps(direction[2], q[2])),
+                    inverseDet);
+                const __m128 t = _mm_mul_ps(
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], q[0]), _mm_mul_ps(e2[1], q[1])),
+                               _mm_mul_ps(e2[2], q[2])),
+                    inverseDet);
+                __m128 hit = _mm_and_ps(active, _mm_cmpneq_ps(det, zero));
+                hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+                hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+                hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, tMax)));
+                if (_mm_movemask_ps(hit) == 0) {
+                    continue;
+                }
+                tMax = select(hit, t, tMax);
+                hitU = select(hit, u, hitU);
+                hitV = select(hit, v, hitV);
+                hitIndex = select(hit, _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(i))),
+                                  hitIndex);
+                if (anyHit) {
+                    active = _mm_andnot_ps(hit, active);
+                    if (_mm_movemask_ps(active) == 0) {
+                        stackSize = 0;
+                        break;
+                    }
+                }
+            }
+            if (stackSize == 0) {
+                break;
+            }
+            node = &nodes_[stack[--stackSize]];
+            continue;
+        }
+
+        uint32_t near = node->leftFirst;
+        uint32_t farChild = near + 1;
+        float nearDistance = minLane(boxDistance4(nodes_[near]));
+        float farDistance = minLane(boxDistance4(nodes_[farChild]));
+        if (farDistance < nearDistance) {
+            std::swap(near, farChild);
+            std::swap(nearDistance, farDistance);
+        }
+        if (nearDistance == infinity) {
+            if (stackSize == 0) {
+                break;
+            }
+            node = &nodes_[stack[--stackSize]];
+        } else {
+            node = &nodes_[near];
+            if (farDistance != infinity) {
+                stack[stackSize++] = farChild;
+            }
+        }
+    }
+
+    alignas(16) float t[4], u[4], v[4];
+    alignas(16) int32_t index[4];
+    _mm_store_ps(t, tMax);
+    _mm_store_ps(u, hitU);
+    _mm_store_ps(v, hitV);
+    _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_castps_si128(hitIndex));
+    unsigned mask = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        if (index[lane] < 0) {
+            continue;
+        }
+        mask |= 1u << lane;
+        hits[lane].t = t[lane];
+        hits[lane].u = u[lane];
+        hits[lane].v = v[lane];
+        hits[lane].triangle = triangleIds_[index[lane]];
+    }
+    return mask;
+}
+#else
+template <bool anyHit>
+unsigned BVH::traverse4(const Ray rays[4], Hit hits[4]) const {
+    unsigned mask = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        if (traverse<anyHit>(rays[lane], hits[lane])) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+#endif
+
+/* Count the nodes and leaves, and sum the SAH cost: the area of each inner node plus the area
+ * times the triangle count of each leaf, relative to the area of the root */
+void BVH::computeStats() {
+    stats_.triangles = triangles_.size();
+    stats_.nodes = nodes_.size() - 1;
+    stats_.leaves = 0;
+    stats_.depth = 0;
+    double cost = 0.0;
+    std::vector<std::pair<uint32_t, int>> stack = {{0, 1}};
+    while (!stack.empty()) {
+        const uint32_t index = stack.back().first;
+        const int depth = stack.back().second;
+        stack.pop_back();
+        const Node& node = nodes_[index];
+        const float area = surfaceArea(node.min, node.max);
+        stats_.depth = std::max(stats_.depth, depth);
+        if (node.count > 0) {
+            stats_.leaves++;
+            cost += static_cast<double>(area) * node.count;
+        } else {
+            cost += area;
+            stack.push_back({node.leftFirst, depth + 1});
+            stack.push_back({node.leftFirst + 1, depth + 1});
+        }
+    }
+    const float rootArea = surfaceArea(nodes_[0].min, nodes_[0].max);
+    stats_.sahCost = (rootArea > 0.0f) ? static_cast<float>(cost / rootArea) : 0.0f;
+}
+
+std::string BVH::summary() const {
+    char text[100];
+    snprintf(text, sizeof(text), "%zu nodes, depth %d, SAH %.1f, built in %.1f ms",
+             stats_.nodes, stats_.depth, stats_.sahCost, stats_.buildMs);
+    return text;
+}
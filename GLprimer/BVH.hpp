@@ -0,0 +1,126 @@
+/*
+ * A bounding volume hierarchy over the triangles of a Mesh, for ray queries on the CPU.
+ *
+ * Usage: Call build() with a Mesh, or the mesh() of a TriangleSoup made after
+ *        setKeepCPUCopy(true). The tree is built top-down with the surface area heuristic
+ *        over binned triangle centroids, and the subtrees of large
+ *        nodes are built in parallel on a ThreadPool. The BVH copies the triangles it needs,
+ *        so the mesh can change or go away afterwards. intersect() finds the closest hit of
+ *        a ray and occluded() whether anything is hit at all. intersect4() and occluded4()
+ *        trace packets of four rays together with SSE2, which is faster for coherent rays
+ *        like those through neighbouring pixels. Hits name the triangle by its index in the
+ *        mesh, with the barycentric coordinates of the hit point.
+ *        Queries are const and can run from many threads at once.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "MemoryTracker.hpp"
+
+class Mesh;
+class ThreadPool;
+
+class BVH {
+public:
+    static constexpr uint32_t noHit = 0xffffffff;
+    static constexpr int binCount = 16;          // Split candidates per axis are binCount - 1
+    static constexpr uint32_t maxLeafSize = 16;  // Larger nodes are split even if SAH says not to
+    static constexpr int maxDepth = 64;          // Nodes this deep are leaves
+
+    // 32 bytes, two siblings share a 64 byte cache line
+    struct Node {
+        float min[3];
+        uint32_t leftFirst;  // Index of the left child, the right one follows it, or of the
+                             // first triangle of a leaf
+        float max[3];
+        uint32_t count;  // Triangles in a leaf, 0 for an inner node
+    };
+
+    struct Ray {
+        std::array<float, 3> origin = {{0.0f, 0.0f, 0.0f}};
+        std::array<float, 3> direction = {{0.0f, 0.0f, -1.0f}};  // Need not be normalized
+        float tMax = std::numeric_limits<float>::infinity();     // Hits beyond are ignored
+    };
+
+    struct Hit {
+        float t = std::numeric_limits<float>::infinity();  // origin + t * direction
+        float u = 0.0f;  // Barycentric weights of the second and the third vertex
+        float v = 0.0f;
+        uint32_t triangle = noHit;  // Index of the triangle in the mesh
+    };
+
+    struct Stats {
+        size_t triangles = 0;
+        size_t nodes = 0;
+        size_t leaves = 0;
+        int depth = 0;
+        float sahCost = 0.0f;  // Expected cost of a random ray, a triangle test costs 1
+        double buildMs = 0.0;
+    };
+
+    BVH();
+
+    BVH(const BVH&) = delete;
+    BVH& operator=(const BVH&) = delete;
+
+    // Build over the triangles of the mesh with numThreads threads, 0 means one per hardware
+    // thread. Returns false, and leaves the BVH empty, if the mesh has no triangles or no
+    // vertex and index arrays, like the mesh() of a TriangleSoup that dropped its copy.
+    bool build(const Mesh& mesh, unsigned numThreads = 0);
+
+    void clear();
+    bool empty() const { return nodes_.empty(); }
+
+    // Find the closest hit before ray.tMax, returns false and leaves hit as is on a miss
+    bool intersect(const Ray& ray, Hit& hit) const;
+
+    // Returns true if any triangle is hit before ray.tMax
+    bool occluded(const Ray& ray) const;
+
+    // The same for four rays at once. intersect4() sets the hits of the rays that hit and
+    // returns a mask with bit i set if ray i hit, occluded4() returns the mask of the rays
+    // that are blocked.
+    unsigned intersect4(const Ray rays[4], Hit hits[4]) const;
+    unsigned occluded4(const Ray rays[4]) const;
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+    Stats stats() const { return stats_; }
+
+    // As "1234 nodes, depth 20, SAH 12.3, built in 4.5 ms"
+    std::string summary() const;
+
+private:
+    // A triangle as its first vertex and two edges, for the intersection test
+    struct Triangle {
+        float v0[3];
+        float edge1[3];
+        float edge2[3];
+    };
+
+    struct BuildState;
+
+    // Compute the bounds of a node and split it, then its children, in parallel if pool is set
+    void subdivide(BuildState& state, uint32_t nodeIndex, int depth, ThreadPool* pool);
+
+    template <bool anyHit>
+    bool traverse(const Ray& ray, Hit& hit) const;
+
+    template <bool anyHit>
+    unsigned traverse4(const Ray rays[4], Hit hits[4]) const;
+
+    void computeStats();
+
+    std::vector<Node> nodes_;            // Node 0 is the root, node 1 is unused
+    std::vector<Triangle> triangles_;    // In leaf order
+    std::vector<uint32_t> triangleIds_;  // Mesh index of each triangle
+    Stats stats_;
+    MemoryTracker::Allocation memory_;
+};
@@ -0,0 +1,506 @@
+/*
+ * BC1 and BC3 (DXT1 and DXT5) block compression, and DDS file output.
+ *
+ * The color endpoints of each block are found along the principal axis of its colors,
+ * then refined once by a least squares fit to the chosen indices. Index selection
+ * evaluates four pixels at a time with SSE when available.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "BlockCompressor.hpp"
+#include "MipChain.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCKCOMPRESSOR_USE_SSE2
+#endif
+
+namespace {
+
+struct Color {
+    float r, g, b;
+};
+
+struct Block {
+    // Structure of arrays, so that four pixels can be processed in one SSE register
+    alignas(16) float r[16];
+    alignas(16) float g[16];
+    alignas(16) float b[16];
+    GLubyte a[16];
+};
+
+std::uint16_t packRGB565(const Color& c) {
+    const int r = std::clamp(static_cast<int>(c.r * 31.0f / 255.0f + 0.5f), 0, 31);
+    const int g = std::clamp(static_cast<int>(c.g * 63.0f / 255.0f + 0.5f), 0, 63);
+    const int b = std::clamp(static_cast<int>(c.b * 31.0f / 255.0f + 0.5f), 0, 31);
+    return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+}
+
+Color unpackRGB565(std::uint16_t c) {
+    const int r = (c >> 11) & 31;
+    const int g = (c >> 5) & 63;
+    const int b = c & 31;
+    return {static_cast<float>((r << 3) | (r >> 2)), static_cast<float>((g << 2) | (g >> 4)),
+            static_cast<float>((b << 3) | (b >> 2))};
+}
+
+// The four colors of a block in four color mode
+std::array<Color, 4> palette(std::uint16_t c0, std::uint16_t c1) {
+    const Color p0 = unpackRGB565(c0);
+    const Color p1 = unpackRGB565(c1);
+    return {{p0,
+             p1,
+             {(2 * p0.r + p1.r) / 3, (2 * p0.g + p1.g) / 3, (2 * p0.b + p1.b) / 3},
+             {(p0.r + 2 * p1.r) / 3, (p0.g + 2 * p1.g) / 3, (p0.b + 2 * p1.b) / 3}}};
+}
+
+// Choose the nearest palette entry for each pixel, returns the total squared error
+float selectIndices(const Block& block, const std::array<Color, 4>& pal, int indices[16]) {
+    float error = 0.0f;
+#ifdef BLOCKCOMPRESSOR_USE_SSE2
+    for (int i = 0; i < 16; i += 4) {
+        const __m128 r = _mm_load_ps(block.r + i);
+        const __m128 g = _mm_load_ps(block.g + i);
+        const __m128 b = _mm_load_ps(block.b + i);
+        __m128 best = _mm_set1_ps(std::numeric_limits<float>::max());
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int p = 0; p < 4; p++) {
+            const __m128 dr = _mm_sub_ps(r, _mm_set1_ps(pal[p].r));
+            const __m128 dg = _mm_sub_ps(g, _mm_set1_ps(pal[p].g));
+            const __m128 db = _mm_sub_ps(b, _mm_set1_ps(pal[p].b));
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+                                        _mm_mul_ps(db, db));
+            const __m128 closer = _mm_cmplt_ps(d, best);
+            best = _mm_min_ps(d, best);
+            bestIndex = _mm_or_si128(_mm_andnot_si128(_mm_castps_si128(closer), bestIndex),
+                                     _mm_and_si128(_mm_castps_si128(closer), _mm_set1_epi32(p)));
+        }
+        alignas(16) float bestOut[4];
+        alignas(16) int indexOut[4];
+        _mm_store_ps(bestOut, best);
+        _mm_store_si128(reinterpret_cast<__m128i*>(indexOut), bestIndex);
+        for (int k = 0; k < 4; k++) {
+            indices[i + k] = indexOut[k];
+            error += bestOut[k];
+        }
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        float best = std::numeric_limits<float>::max();
+        for (int p = 0; p < 4; p++) {
+            const float dr = block.r[i] - pal[p].r;
+            const float dg = block.g[i] - pal[p].g;
+            const float db = block.b[i] - pal[p].b;
+            const float d = dr * dr + dg * dg + db * db;
+            if (d < best) {
+                best = d;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+#endif
+    return error;
+}
+
+// Order the endpoints for four color mode and compute the indices for them
+float encodeEndpoints(const Block& block, const Color& e0, const Color& e1, std::uint16_t& c0,
+                      std::uint16_t& c1, int indices[16]) {
+    c0 = packRGB565(e0);
+    c1 = packRGB565(e1);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+    if (c0 == c1) {
+        // A single color, but the block has to be in four color mode (c0 > c1)
+        if (c1 > 0) {
+            c1--;
+        } else {
+            c0++;
+        }
+    }
+    return selectIndices(block, palette(c0, c1), indices);
+}
+
+// Encode the colors of a block into 8 bytes: two RGB565 endpoints and 16 2-bit indices
+void encodeColorBlock(const Block& block, GLubyte* out) {
+    // Mean and covariance of the block colors
+    Color mean = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; i++) {
+        mean.r += block.r[i];
+        mean.g += block.g[i];
+        mean.b += block.b[i];
+    }
+    mean = {mean.r / 16, mean.g / 16, mean.b / 16};
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};  // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        const float r = block.r[i] - mean.r;
+        const float g = block.g[i] - mean.g;
+        const float b = block.b[i] - mean.b;
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+
+    // Principal axis by power iteration
+    Color axis = {1.0f, 1.0f, 1.0f};
+    for (int iter = 0; iter < 8; iter++) {
+        const Color next = {cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+                            cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+                            cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b};
+        const float length = std::max({std::abs(next.r), std::abs(next.g), std::abs(next.b)});
+        if (length < 1e-6f) {
+            break;  // All colors are (nearly) the same
+        }
+        axis = {next.r / length, next.g / length, next.b / length};
+    }
+    const float axisLength2 = axis.r * axis.r + axis.g * axis.g + axis.b * axis.b;
+
+    // Extent of the colors along the axis
+    float tmin = 0.0f;
+    float tmax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        const float t = ((block.r[i] - mean.r) * axis.r + (block.g[i] - mean.g) * axis.g +
+                         (block.b[i] - mean.b) * axis.b) / axisLength2;
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+    const Color e0 = {mean.r + tmax * axis.r, mean.g + tmax * axis.g, mean.b + tmax * axis.b};
+    const Color e1 = {mean.r + tmin * axis.r, mean.g + tmin * axis.g, mean.b + tmin * axis.b};
+
+    std::uint16_t c0;
+    std::uint16_t c1;
+    int indices[16];
+    float error = encodeEndpoints(block, e0, e1, c0, c1, indices);
+
+    // Least squares refinement of the endpoints for the chosen indices
+    const float weight[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};  // Share of endpoint 0
+    float aa = 0, ab = 0, bb = 0;
+    Color ax = {0, 0, 0};
+    Color bx = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        const float a = weight[indices[i]];
+        const float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax = {ax.r + a * block.r[i], ax.g + a * block.g[i], ax.b + a * block.b[i]};
+        bx = {bx.r + b * block.r[i], bx.g + b * block.g[i], bx.b + b * block.b[i]};
+    }
+    const float det = aa * bb - ab * ab;
+    if (std::abs(det) > 1e-6f) {
+        const Color r0 = {(bb * ax.r - ab * bx.r) / det, (bb * ax.g - ab * bx.g) / det,
+                          (bb * ax.b - ab * bx.b) / det};
+        const Color r1 = {(aa * bx.r - ab * ax.r) / det, (aa * bx.g - ab * ax.g) / det,
+                          (aa * bx.b - ab * ax.b) / det};
+        std::uint16_t rc0;
+        std::uint16_t rc1;
+        int refined[16];
+        const float refinedError = encodeEndpoints(block, r0, r1, rc0, rc1, refined);
+        if (refinedError < error) {
+            c0 = rc0;
+            c1 = rc1;
+            std::copy(refined, refined + 16, indices);
+        }
+    }
+
+    std::uint32_t bits = 0;
+    for (int i = 15; i >= 0; i--) {
+        bits = (bits << 2) | static_cast<std::uint32_t>(indices[i]);
+    }
+    out[0] = static_cast<GLubyte>(c0 & 0xff);
+    out[1] = static_cast<GLubyte>(c0 >> 8);
+    out[2] = static_cast<GLubyte>(c1 & 0xff);
+    out[3] = static_cast<GLubyte>(c1 >> 8);
+    for (int k = 0; k < 4; k++) {
+        out[4 + k] = static_cast<GLubyte>(bits >> (8 * k));
+    }
+}
+
+// The eight alpha values of a BC3 alpha block with a0 > a1
+std::array<int, 8> alphaPalette(int a0, int a1) {
+    std::array<int, 8> pal;
+    pal[0] = a0;
+    pal[1] = a1;
+    for (int k = 1; k <= 6; k++) {
+        pal[k + 1] = ((7 - k) * a0 + k * a1 + 3) / 7;
+    }
+    return pal;
+}
+
+// Encode the alpha of a block into 8 bytes: two 8-bit endpoints and 16 3-bit indices
+void encodeAlphaBlock(const Block& block, GLubyte* out) {
+    int a0 = *std::max_element(block.a, block.a + 16);
+    int a1 = *std::min_element(block.a, block.a + 16);
+    out[0] = static_cast<GLubyte>(a0);
+    out[1] = static_cast<GLubyte>(a1);
+
+    std::uint64_t bits = 0;
+    if (a0 != a1) {
+        const std::array<int, 8> pal = alphaPalette(a0, a1);
+        for (int i = 15; i >= 0; i--) {
+            int best = 0;
+            for (int p = 1; p < 8; p++) {
+                if (std::abs(pal[p] - block.a[i]) < std::abs(pal[best] - block.a[i])) {
+                    best = p;
+                }
+            }
+            bits = (bits << 3) | static_cast<std::uint64_t>(best);
+        }
+    }
+    for (int k = 0; k < 6; k++) {
+        out[2 + k] = static_cast<GLubyte>(bits >> (8 * k));
+    }
+}
+
+// Gather a 4x4 block from an RGBA image, replicating edge pixels for partial blocks
+void loadBlock(const GLubyte* rgba, GLuint width, GLuint height, GLuint bx, GLuint by,
+               Block& block) {
+    for (int y = 0; y < 4; y++) {
+        const GLuint py = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            const GLuint px = std::min(bx * 4 + x, width - 1);
+            const GLubyte* p = rgba + (static_cast<size_t>(py) * width + px) * 4;
+            block.r[y * 4 + x] = p[0];
+            block.g[y * 4 + x] = p[1];
+            block.b[y * 4 + x] = p[2];
+            block.a[y * 4 + x] = p[3];
+        }
+    }
+}
+
+// DDS file layout (the file starts with the four bytes "DDS ")
+struct DDSPixelFormat {
+    std::uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+};
+struct DDSHeader {
+    std::uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+    std::uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    std::uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+// The workers of compress(), kept from one call to the next instead of being started for
+// every image or mip level. The calls take turns on the mutex, so wait() only waits for
+// the jobs of one call, and the pool is only replaced when a call asks for another size.
+struct SharedPool {
+    std::mutex mutex;
+    std::unique_ptr<ThreadPool> pool;
+    unsigned numThreads = 0;
+};
+
+SharedPool& sharedPool() {
+    static SharedPool instance;
+    return instance;
+}
+
+}  // namespace
+
+std::vector<GLubyte> BlockCompressor::toRGBA(const GLubyte* pixels, size_t pixelCount,
+                                             GLuint format) {
+    std::vector<GLubyte> rgba(pixelCount * 4);
+    const bool hasAlpha = (format == GL_RGBA || format == GL_BGRA);
+    const bool bgr = (format == GL_BGR || format == GL_BGRA);
+    const size_t bpp = hasAlpha ? 4 : 3;
+    for (size_t i = 0; i < pixelCount; i++) {
+        const GLubyte* in = pixels + i * bpp;
+        GLubyte* out = rgba.data() + i * 4;
+        out[0] = bgr ? in[2] : in[0];
+        out[1] = in[1];
+        out[2] = bgr ? in[0] : in[2];
+        out[3] = hasAlpha ? in[3] : 255;
+    }
+    return rgba;
+}
+
+size_t BlockCompressor::compressedSize(GLuint width, GLuint height, Format blockFormat) {
+    const size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+    return blocks * (blockFormat == Format::BC1 ? 8 : 16);
+}
+
+std::vector<GLubyte> BlockCompressor::compress(const GLubyte* pixels, GLuint width, GLuint height,
+                                               GLuint format, Format blockFormat,
+                                               unsigned numThreads) {
+    const std::vector<GLubyte> rgba =
+        toRGBA(pixels, static_cast<size_t>(width) * height, format);
+    const GLuint blocksX = (width + 3) / 4;
+    const GLuint blocksY = (height + 3) / 4;
+    const size_t blockSize = (blockFormat == Format::BC1) ? 8 : 16;
+    std::vector<GLubyte> out(compressedSize(width, height, blockFormat));
+
+    auto encodeRows = [&](GLuint begin, GLuint end) {
+        Block block;
+        for (GLuint by = begin; by < end; by++) {
+            for (GLuint bx = 0; bx < blocksX; bx++) {
+                loadBlock(rgba.data(), width, height, bx, by, block);
+                GLubyte* dst = out.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+                if (blockFormat == Format::BC3) {
+                    encodeAlphaBlock(block, dst);
+                    dst += 8;
+                }
+                encodeColorBlock(block, dst);
+            }
+        }
+    };
+
+    // Small images are not worth starting threads for
+    if (blocksX * blocksY < 1024 || numThreads == 1) {
+        encodeRows(0, blocksY);
+        return out;
+    }
+
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (!shared.pool || shared.numThreads != numThreads) {
+        shared.pool.reset();  // Join the old workers before starting the new ones
+        shared.pool.reset(new ThreadPool(numThreads));
+        shared.numThreads = numThreads;
+    }
+    ThreadPool& pool = *shared.pool;
+    const GLuint bands = std::min<GLuint>(blocksY, static_cast<GLuint>(pool.size() * 4));
+    for (GLuint t = 0; t < bands; t++) {
+        const GLuint begin = static_cast<GLuint>(static_cast<size_t>(blocksY) * t / bands);
+        const GLuint end = static_cast<GLuint>(static_cast<size_t>(blocksY) * (t + 1) / bands);
+        pool.enqueue([&encodeRows, begin, end] { encodeRows(begin, end); });
+    }
+    pool.wait();
+    return out;
+}
+
+std::vector<GLubyte> BlockCompressor::decompress(const GLubyte* blocks, GLuint width,
+                                                 GLuint height, Format blockFormat) {
+    std::vector<GLubyte> rgba(static_cast<size_t>(width) * height * 4);
+    const GLuint blocksX = (width + 3) / 4;
+    const GLuint blocksY = (height + 3) / 4;
+    const size_t blockSize = (blockFormat == Format::BC1) ? 8 : 16;
+
+    for (GLuint by = 0; by < blocksY; by++) {
+        for (GLuint bx = 0; bx < blocksX; bx++) {
+            const GLubyte* in = blocks + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+            std::array<int, 16> alpha;
+            alpha.fill(255);
+            if (blockFormat == Format::BC3) {
+                const int a0 = in[0];
+                const int a1 = in[1];
+                std::array<int, 8> pal;
+                if (a0 > a1) {
+                    pal = alphaPalette(a0, a1);
+                } else {  // Six interpolated values plus 0 and 255
+                    pal = {a0, a1, 0, 0, 0, 0, 0, 255};
+                    for (int k = 1; k <= 4; k++) {
+                        pal[k + 1] = ((5 - k) * a0 + k * a1 + 2) / 5;
+                    }
+                }
+                std::uint64_t bits = 0;
+                for (int k = 0; k < 6; k++) {
+                    bits |= static_cast<std::uint64_t>(in[2 + k]) << (8 * k);
+                }
+                for (int i = 0; i < 16; i++) {
+                    alpha[i] = pal[(bits >> (3 * i)) & 7];
+                }
+                in += 8;
+            }
+
+            const std::uint16_t c0 = static_cast<std::uint16_t>(in[0] | (in[1] << 8));
+            const std::uint16_t c1 = static_cast<std::uint16_t>(in[2] | (in[3] << 8));
+            std::array<Color, 4> pal = palette(c0, c1);
+            bool transparentBlack = false;
+            if (blockFormat == Format::BC1 && c0 <= c1) {  // Three color mode
+                const Color p0 = pal[0];
+                const Color p1 = pal[1];
+                pal[2] = {(p0.r + p1.r) / 2, (p0.g + p1.g) / 2, (p0.b + p1.b) / 2};
+                pal[3] = {0.0f, 0.0f, 0.0f};
+                transparentBlack = true;
+            }
+            const std::uint32_t bits = static_cast<std::uint32_t>(in[4]) | (in[5] << 8) |
+                                       (in[6] << 16) | (static_cast<std::uint32_t>(in[7]) << 24);
+
+            for (int i = 0; i < 16; i++) {
+                const GLuint px = bx * 4 + (i % 4);
+                const GLuint py = by * 4 + (i / 4);
+                if (px >= width || py >= height) {
+                    continue;
+                }
+                const int index = (bits >> (2 * i)) & 3;
+                GLubyte* out = rgba.data() + (static_cast<size_t>(py) * width + px) * 4;
+                out[0] = static_cast<GLubyte>(pal[index].r + 0.5f);
+                out[1] = static_cast<GLubyte>(pal[index].g + 0.5f);
+                out[2] = static_cast<GLubyte>(pal[index].b + 0.5f);
+                out[3] = (transparentBlack && index == 3) ? 0 : static_cast<GLubyte>(alpha[i]);
+            }
+        }
+    }
+    return rgba;
+}
+
+double BlockCompressor::psnr(const GLubyte* a, const GLubyte* b, size_t pixelCount,
+                             bool includeAlpha) {
+    const int channels = includeAlpha ? 4 : 3;
+    double sum = 0.0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        for (int c = 0; c < channels; c++) {
+            const double d = static_cast<double>(a[i * 4 + c]) - b[i * 4 + c];
+            sum += d * d;
+        }
+    }
+    const double mse = sum / (static_cast<double>(pixelCount) * channels);
+    if (mse == 0.0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+bool BlockCompressor::writeDDS(const std::string& filename, const MipChain& chain,
+                               Format blockFormat, unsigned numThreads) {
+    if (chain.empty()) {
+        return false;
+    }
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    const MipChain::Level& base = chain.level(0);
+    DDSHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDSHeader);
+    // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    header.height = base.height;
+    header.width = base.width;
+    header.pitchOrLinearSize =
+        static_cast<std::uint32_t>(compressedSize(base.width, base.height, blockFormat));
+    header.mipMapCount = static_cast<std::uint32_t>(chain.levelCount());
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = 0x4;  // DDPF_FOURCC
+    const char* fourCC = (blockFormat == Format::BC1) ? "DXT1" : "DXT5";
+    std::memcpy(&header.pixelFormat.fourCC, fourCC, 4);
+    header.caps = 0x1000 | 0x8 | 0x400000;  // TEXTURE | COMPLEX | MIPMAP
+
+    out.write("DDS ", 4);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (size_t i = 0; i < chain.levelCount(); i++) {
+        const MipChain::Level& level = chain.level(i);
+        const std::vector<GLubyte> blocks = compress(level.data, level.width, level.height,
+                                                     chain.format(), blockFormat, numThreads);
+        out.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    }
+    return !out.fail();
+}
@@ -0,0 +1,48 @@
+/*
+ * BC1 and BC3 (DXT1 and DXT5) block compression of images, and DDS files to store them.
+ *
+ * Usage: compress() encodes an 8 bit RGB or RGBA image in 4x4 pixel blocks, using
+ *        several threads. decompress() decodes blocks back to RGBA, and psnr() compares
+ *        the result to the original to measure the quality of the encoding.
+ *        writeDDS() compresses every level of a MipChain and stores them in a DDS file,
+ *        which Texture::createTexture() uploads with glCompressedTexSubImage2D().
+ *        BC1 stores 8 bytes per block (4 bits per pixel) without alpha, BC3 stores
+ *        16 bytes per block (8 bits per pixel) with alpha. This class uses no OpenGL calls.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <string>
+#include <vector>
+
+class MipChain;
+
+class BlockCompressor {
+public:
+    enum class Format { BC1, BC3 };
+
+    // Compress an image, format is the byte order of the pixels (GL_RGB(A) or GL_BGR(A)).
+    // numThreads = 0 uses one thread per hardware thread.
+    static std::vector<GLubyte> compress(const GLubyte* pixels, GLuint width, GLuint height,
+                                         GLuint format, Format blockFormat,
+                                         unsigned numThreads = 0);
+
+    // Decompress blocks to RGBA pixels (4 bytes per pixel, in RGBA order)
+    static std::vector<GLubyte> decompress(const GLubyte* blocks, GLuint width, GLuint height,
+                                           Format blockFormat);
+
+    // Peak signal-to-noise ratio in dB between two RGBA images, over RGB or RGBA
+    static double psnr(const GLubyte* a, const GLubyte* b, size_t pixelCount, bool includeAlpha);
+
+    // Size in bytes of one compressed image of the given size
+    static size_t compressedSize(GLuint width, GLuint height, Format blockFormat);
+
+    // Compress all levels of a mipmap chain and write them to a DDS file
+    static bool writeDDS(const std::string& filename, const MipChain& chain, Format blockFormat,
+                         unsigned numThreads = 0);
+
+    // Convert pixels in any supported layout to RGBA order, 4 bytes per pixel
+    static std::vector<GLubyte> toRGBA(const GLubyte* pixels, size_t pixelCount, GLuint format);
+};
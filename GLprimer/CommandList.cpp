@@ -0,0 +1,227 @@
+/*
+ * A list of rendering commands recorded into a byte stream, to be replayed on the GL thread.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "CommandList.hpp"
+#include "GLState.hpp"
+#include "GpuProfiler.hpp"
+#include "Texture.hpp"
+#include "TriangleSoup.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+/*
+ * The stream is a sequence of a 32 bit opcode followed by the arguments of the command.
+ * The arguments are copied in and out with memcpy(), so they need no alignment.
+ */
+namespace {
+
+struct TextureArguments {
+    Texture* texture;
+};
+
+struct TextureNameArguments {
+    GLenum target;
+    GLuint texture;
+};
+
+struct UniformBlockArguments {
+    GLuint binding;
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+};
+
+struct MatrixArguments {
+    GLint location;
+    std::array<GLfloat, 16> matrix;
+};
+
+struct VectorArguments {
+    GLint location;
+    std::array<GLfloat, 4> vector;
+};
+
+struct FloatArguments {
+    GLint location;
+    GLfloat value;
+};
+
+struct MeshArguments {
+    TriangleSoup* mesh;
+};
+
+struct ScopeArguments {
+    const std::string* name;
+};
+
+struct NoArguments {};
+
+template <typename T>
+T read(const unsigned char* stream, size_t& offset) {
+    T arguments;
+    std::memcpy(&arguments, stream + offset, sizeof(T));
+    offset += sizeof(T);
+    return arguments;
+}
+
+}  // namespace
+
+CommandList::CommandList(size_t capacity) : stream_(capacity), used_(0), commands_(0) {}
+
+void CommandList::clear() {
+    used_ = 0;
+    commands_ = 0;
+}
+
+template <typename T>
+size_t CommandList::record(Op op, const T& arguments) {
+    const size_t size = sizeof(Op) + sizeof(T);
+    if (used_ + size > stream_.size()) {
+        stream_.resize(std::max(2 * stream_.size(), used_ + size));
+    }
+    std::memcpy(&stream_[used_], &op, sizeof(Op));
+    std::memcpy(&stream_[used_ + sizeof(Op)], &arguments, sizeof(T));
+    used_ += size;
+    commands_++;
+    return used_ - sizeof(T);
+}
+
+bool CommandList::isRecorded(Patch patch, Op op, size_t size) const {
+    if (patch.offset < sizeof(Op) || patch.offset > used_ || size > used_ - patch.offset) {
+        return false;
+    }
+    Op recorded;
+    std::memcpy(&recorded, &stream_[patch.offset - sizeof(Op)], sizeof(Op));
+    return recorded == op;
+}
+
+void CommandList::bindProgram(GLuint program) { record(Op::BindProgram, program); }
+
+void CommandList::bindTexture(Texture& texture) {
+    record(Op::BindTexture, TextureArguments{&texture});
+}
+
+void CommandList::bindTexture(GLenum target, GLuint texture) {
+    record(Op::BindTextureName, TextureNameArguments{target, texture});
+}
+
+CommandList::Patch CommandList::setUniformBlockRange(GLuint binding, GLuint buffer,
+                                                     GLintptr offset, GLsizeiptr size) {
+    const UniformBlockArguments arguments = {binding, buffer, offset, size};
+    return Patch{record(Op::SetUniformBlockRange, arguments)};
+}
+
+CommandList::Patch CommandList::setMatrix(GLint location, const std::array<GLfloat, 16>& matrix) {
+    return Patch{record(Op::SetMatrix, MatrixArguments{location, matrix})};
+}
+
+void CommandList::setVector(GLint location, const std::array<GLfloat, 4>& vector) {
+    record(Op::SetVector, VectorArguments{location, vector});
+}
+
+void CommandList::setFloat(GLint location, GLfloat value) {
+    record(Op::SetFloat, FloatArguments{location, value});
+}
+
+void CommandList::drawMesh(TriangleSoup& mesh) { record(Op::DrawMesh, MeshArguments{&mesh}); }
+
+void CommandList::beginScope(const std::string& name) {
+    record(Op::BeginScope, ScopeArguments{&name});
+}
+
+void CommandList::endScope() { record(Op::EndScope, NoArguments{}); }
+
+void CommandList::patchMatrix(Patch patch, const std::array<GLfloat, 16>& matrix) {
+    if (!isRecorded(patch, Op::SetMatrix, sizeof(MatrixArguments))) {
+        std::cerr << "Patch is not a recorded matrix (offset " << patch.offset << ")\n";
+        return;
+    }
+    std::memcpy(&stream_[patch.offset + offsetof(MatrixArguments, matrix)], matrix.data(),
+                sizeof(matrix));
+}
+
+void CommandList::patchUniformBlockRange(Patch patch, GLintptr offset) {
+    if (!isRecorded(patch, Op::SetUniformBlockRange, sizeof(UniformBlockArguments))) {
+        std::cerr << "Patch is not a recorded uniform block range (offset " << patch.offset
+                  << ")\n";
+        return;
+    }
+    std::memcpy(&stream_[patch.offset + offsetof(UniformBlockArguments, offset)], &offset,
+                sizeof(offset));
+}
+
+void CommandList::execute(GpuProfiler* profiler) {
+    stats_ = Stats();
+    const unsigned char* stream = stream_.data();
+    size_t offset = 0;
+    while (offset < used_) {
+        const Op op = read<Op>(stream, offset);
+        switch (op) {
+            case Op::BindProgram:
+                GLState::useProgram(read<GLuint>(stream, offset));
+                break;
+            case Op::BindTexture:
+                read<TextureArguments>(stream, offset).texture->bind();
+                break;
+            case Op::BindTextureName: {
+                const auto a = read<TextureNameArguments>(stream, offset);
+                GLState::bindTexture(a.target, a.texture);
+                break;
+            }
+            case Op::SetUniformBlockRange: {
+                const auto a = read<UniformBlockArguments>(stream, offset);
+                glBindBufferRange(GL_UNIFORM_BUFFER, a.binding, a.buffer, a.offset, a.size);
+                break;
+            }
+            case Op::SetMatrix: {
+                const auto a = read<MatrixArguments>(stream, offset);
+                glUniformMatrix4fv(a.location, 1, GL_FALSE, a.matrix.data());
+                break;
+            }
+            case Op::SetVector: {
+                const auto a = read<VectorArguments>(stream, offset);
+                glUniform4fv(a.location, 1, a.vector.data());
+                break;
+            }
+            case Op::SetFloat: {
+                const auto a = read<FloatArguments>(stream, offset);
+                glUniform1f(a.location, a.value);
+                break;
+            }
+            case Op::DrawMesh: {
+                TriangleSoup* mesh = read<MeshArguments>(stream, offset).mesh;
+                // The vertex array name can change when a ResidencyManager reloads the mesh
+                GLState::bindVertexArray(mesh->residentVAO());
+                glDrawElements(GL_TRIANGLES, 3 * mesh->ntris_, GL_UNSIGNED_INT, nullptr);
+                stats_.draws++;
+                break;
+            }
+            case Op::BeginScope: {
+                const auto a = read<ScopeArguments>(stream, offset);
+                if (profiler) {
+                    profiler->begin(*a.name);
+                }
+                break;
+            }
+            case Op::EndScope:
+                read<NoArguments>(stream, offset);
+                if (profiler) {
+                    profiler->end();
+                }
+                break;
+        }
+        stats_.commands++;
+    }
+}
+
+size_t CommandList::commands() const { return commands_; }
+
+size_t CommandList::bytes() const { return used_; }
+
+CommandList::Stats CommandList::stats() const { return stats_; }
@@ -0,0 +1,107 @@
+/*
+ * A list of rendering commands recorded into a byte stream, to be replayed on the GL thread.
+ *
+ * Usage: Record commands with bindProgram(), bindTexture(), setUniformBlockRange(),
+ *        setMatrix(), setVector(), setFloat() and drawMesh(), then call execute() on the
+ *        GL thread to submit them, as often as needed. Recording makes no GL calls, so lists
+ *        can be recorded on worker threads, one list per thread. The commands are packed
+ *        into one buffer that is kept by clear(), so recording the same frame again does not
+ *        allocate. The commands that set a matrix or a uniform block range return a Patch,
+ *        which rewrites their arguments in place, to replay a list with new transforms
+ *        without recording it again. Textures and meshes are referenced by pointer and must
+ *        outlive the list. Binds go through GLState when the list is executed.
+ *        Commands between beginScope() and endScope() are timed as a GpuProfiler scope when
+ *        the list is executed with a profiler, and the scope commands do nothing otherwise.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class GpuProfiler;
+class Texture;
+class TriangleSoup;
+
+class CommandList {
+public:
+    // A recorded command whose arguments can be rewritten
+    struct Patch {
+        size_t offset = 0;  // Of the arguments in the stream
+    };
+
+    struct Stats {
+        size_t commands = 0;  // Commands executed by the last execute()
+        size_t draws = 0;     // Of them, mesh draws
+    };
+
+    // Reserve room for a number of bytes of commands
+    explicit CommandList(size_t capacity = 4096);
+
+    // Remove all commands, keeping the buffer
+    void clear();
+
+    void bindProgram(GLuint program);
+
+    // Bind a texture through Texture::bind(), which also reloads it if it was evicted
+    void bindTexture(Texture& texture);
+
+    // Bind a texture by name, for textures that have no Texture object
+    void bindTexture(GLenum target, GLuint texture);
+
+    // Bind a range of a buffer to a uniform block binding point (glBindBufferRange())
+    Patch setUniformBlockRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    Patch setMatrix(GLint location, const std::array<GLfloat, 16>& matrix);
+    void setVector(GLint location, const std::array<GLfloat, 4>& vector);
+    void setFloat(GLint location, GLfloat value);
+
+    void drawMesh(TriangleSoup& mesh);
+
+    // Time the commands up to endScope() under a name, which must outlive the list
+    void beginScope(const std::string& name);
+    void endScope();
+
+    // Rewrite the arguments of a recorded command
+    void patchMatrix(Patch patch, const std::array<GLfloat, 16>& matrix);
+    void patchUniformBlockRange(Patch patch, GLintptr offset);
+
+    // Submit the commands to GL, on the GL thread, timing the scopes if a profiler is given
+    void execute(GpuProfiler* profiler = nullptr);
+
+    size_t commands() const;  // Number of recorded commands
+    size_t bytes() const;     // Size of the recorded stream
+
+    Stats stats() const;
+
+private:
+    enum class Op : std::uint32_t {
+        BindProgram,
+        BindTexture,
+        BindTextureName,
+        SetUniformBlockRange,
+        SetMatrix,
+        SetVector,
+        SetFloat,
+        DrawMesh,
+        BeginScope,
+        EndScope
+    };
+
+    // Append an opcode and its arguments, returns the offset of the arguments
+    template <typename T>
+    size_t record(Op op, const T& arguments);
+
+    // Check that a patch points at the arguments of a recorded command, which take size bytes
+    bool isRecorded(Patch patch, Op op, size_t size) const;
+
+    std::vector<unsigned char> stream_;  // Allocated size, only the first used_ bytes are valid
+    size_t used_;
+    size_t commands_;
+    Stats stats_;
+};
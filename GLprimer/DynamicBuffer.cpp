@@ -0,0 +1,67 @@
+/*
+ * A GL buffer for data written every frame, with one copy per frame in flight.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "DynamicBuffer.hpp"
+#include "FramePacer.hpp"
+#include "MemoryTracker.hpp"
+
+#include <iostream>
+
+DynamicBuffer::DynamicBuffer(GLenum target, GLsizeiptr size)
+    : bufferID_(0), size_(size), stride_(size) {
+    // Ranges bound to uniform block binding points must start at a multiple of the alignment
+    if (target == GL_UNIFORM_BUFFER) {
+        GLint alignment = 1;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride_ = (size + alignment - 1) / alignment * alignment;
+    }
+    // The buffer is written through the copy binding, which unlike the element array binding
+    // is not part of any vertex array state
+    glGenBuffers(1, &bufferID_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID_);
+    glBufferData(GL_COPY_WRITE_BUFFER, stride_ * FramePacer::maxFramesInFlight, nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    MemoryTracker::track(MemoryTracker::OtherBuffers, 0, stride_ * FramePacer::maxFramesInFlight);
+}
+
+DynamicBuffer::~DynamicBuffer() {
+    if (bufferID_ != 0) {
+        glDeleteBuffers(1, &bufferID_);
+        MemoryTracker::track(MemoryTracker::OtherBuffers,
+                             stride_ * FramePacer::maxFramesInFlight, 0);
+    }
+}
+
+void* DynamicBuffer::map(GLuint slot) {
+    if (slot >= FramePacer::maxFramesInFlight) {
+        std::cerr << "No copy of the dynamic buffer for frame slot " << slot << "\n";
+        return nullptr;
+    }
+    // The pacer waited for the GPU to finish with this copy, so no synchronization is needed
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID_);
+    void* data = glMapBufferRange(
+        GL_COPY_WRITE_BUFFER, offset(slot), size_,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!data) {
+        std::cerr << "Could not map the dynamic buffer\n";
+    }
+    return data;
+}
+
+void DynamicBuffer::unmap() {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID_);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+GLuint DynamicBuffer::id() const { return bufferID_; }
+
+GLintptr DynamicBuffer::offset(GLuint slot) const { return stride_ * slot; }
+
+GLsizeiptr DynamicBuffer::size() const { return size_; }
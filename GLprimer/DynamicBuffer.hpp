@@ -0,0 +1,47 @@
+/*
+ * A GL buffer for data written every frame, with one copy per frame in flight.
+ *
+ * Usage: Create the buffer with the size of one frame of data. Each frame, map() the copy
+ *        of the slot returned by FramePacer::beginFrame(), write the data, unmap() it and
+ *        bind the range of that copy, for example with glBindBufferRange() using offset()
+ *        and size(). There are FramePacer::maxFramesInFlight copies, so while the GPU reads
+ *        the copies of the frames in flight the CPU writes another one. The fences of the
+ *        pacer guarantee that the GPU is done with a copy before it is written again, so the
+ *        copies are mapped without synchronization and the driver never stalls or renames.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+
+class DynamicBuffer {
+public:
+    /* Constructor: allocate the copies, each size bytes, aligned for binding to a target */
+    DynamicBuffer(GLenum target, GLsizeiptr size);
+
+    /* Destructor: deletes the buffer */
+    ~DynamicBuffer();
+
+    DynamicBuffer(const DynamicBuffer&) = delete;
+    DynamicBuffer& operator=(const DynamicBuffer&) = delete;
+
+    // Map the copy of a frame slot for writing, returns nullptr on failure
+    void* map(GLuint slot);
+
+    // Unmap the copy mapped last
+    void unmap();
+
+    GLuint id() const;
+
+    // Offset of the copy of a slot in the buffer
+    GLintptr offset(GLuint slot) const;
+
+    // Size of one copy
+    GLsizeiptr size() const;
+
+private:
+    GLuint bufferID_;
+    GLsizeiptr size_;
+    GLsizeiptr stride_;  // Size rounded up to the offset alignment of the target
+};
@@ -0,0 +1,107 @@
+/*
+ * Limits how many frames the CPU runs ahead of the GPU, with a fence per frame.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "FramePacer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+const GLuint64 waitTimeout = 100000000;  // 100 ms in ns, then wait again
+
+}  // namespace
+
+FramePacer::FramePacer(GLuint framesInFlight)
+    : framesInFlight_(std::min(std::max(framesInFlight, 1u), maxFramesInFlight))
+    , slot_(0)
+    , frame_(0)
+    , totalWaitMs_(0.0) {
+    fences_.fill(nullptr);
+}
+
+FramePacer::~FramePacer() {
+    for (GLsync fence : fences_) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+}
+
+bool FramePacer::wait(GLsync& fence) {
+    if (!fence) {
+        return true;
+    }
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    const bool signaled = (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED);
+    // The first wait flushes, in case the fence is still in an unsubmitted command buffer
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (result == GL_TIMEOUT_EXPIRED) {
+        result = glClientWaitSync(fence, flags, waitTimeout);
+        flags = 0;
+    }
+    if (result == GL_WAIT_FAILED) {
+        std::cerr << "Waiting for a frame fence failed\n";
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+    return signaled;
+}
+
+void FramePacer::setFramesInFlight(GLuint framesInFlight) {
+    for (GLsync& fence : fences_) {
+        wait(fence);
+    }
+    framesInFlight_ = std::min(std::max(framesInFlight, 1u), maxFramesInFlight);
+    slot_ = 0;
+}
+
+GLuint FramePacer::framesInFlight() const { return framesInFlight_; }
+
+GLuint FramePacer::beginFrame() {
+    slot_ = static_cast<GLuint>(frame_ % framesInFlight_);
+    const auto start = std::chrono::steady_clock::now();
+    const bool signaled = wait(fences_[slot_]);
+    const double waitMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+
+    totalWaitMs_ += waitMs;
+    stats_.frames++;
+    stats_.stalls += signaled ? 0 : 1;
+    stats_.waitMs = waitMs;
+    stats_.averageWaitMs = totalWaitMs_ / stats_.frames;
+    stats_.maxWaitMs = std::max(stats_.maxWaitMs, waitMs);
+    return slot_;
+}
+
+void FramePacer::endFrame() {
+    fences_[slot_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_++;
+}
+
+GLuint FramePacer::slot() const { return slot_; }
+
+FramePacer::Stats FramePacer::stats() const {
+    Stats current = stats_;
+    current.framesInFlight = framesInFlight_;
+    return current;
+}
+
+void FramePacer::resetStats() {
+    stats_ = Stats();
+    totalWaitMs_ = 0.0;
+}
+
+std::string FramePacer::summary() const {
+    char text[100];
+    snprintf(text, sizeof(text), "fence wait %.2f ms, %u in flight", stats_.averageWaitMs,
+             framesInFlight_);
+    return text;
+}
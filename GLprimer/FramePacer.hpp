@@ -0,0 +1,76 @@
+/*
+ * Limits how many frames the CPU runs ahead of the GPU, with a fence per frame.
+ *
+ * Usage: Call beginFrame() before the first GL command of a frame and endFrame() after the
+ *        last one, before swapping buffers. endFrame() puts a fence after the commands of
+ *        the frame, and beginFrame() waits for the fence of the frame that used the same
+ *        slot framesInFlight() frames ago. With 1 frame in flight the CPU waits for the GPU
+ *        to finish each frame, which gives the lowest latency. With 2 or 3 the CPU and the
+ *        GPU overlap for more throughput, at a cost of one frame of latency each.
+ *        beginFrame() returns the slot of the frame, which selects the copy of the
+ *        per-frame dynamic buffers (see DynamicBuffer) that the GPU is done with.
+ *        stats() reports the CPU time spent waiting for fences.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <array>
+#include <string>
+
+struct __GLsync;
+
+class FramePacer {
+public:
+    static constexpr GLuint maxFramesInFlight = 3;
+
+    struct Stats {
+        GLuint framesInFlight = 0;
+        size_t frames = 0;
+        size_t stalls = 0;         // Frames where the fence was not signaled yet
+        double waitMs = 0.0;       // Time the last beginFrame() waited
+        double averageWaitMs = 0.0;
+        double maxWaitMs = 0.0;
+    };
+
+    /* Constructor: framesInFlight is clamped to 1 to maxFramesInFlight */
+    explicit FramePacer(GLuint framesInFlight = 2);
+
+    /* Destructor: deletes the fences, without waiting for them */
+    ~FramePacer();
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // Change the number of frames in flight, after waiting for all frames that are
+    void setFramesInFlight(GLuint framesInFlight);
+
+    GLuint framesInFlight() const;
+
+    // Wait until the slot of the new frame is free on the GPU, and return the slot
+    GLuint beginFrame();
+
+    // Put a fence after the commands of the frame
+    void endFrame();
+
+    // The slot of the current frame, 0 to framesInFlight() - 1
+    GLuint slot() const;
+
+    Stats stats() const;
+    void resetStats();
+
+    // Fence waits as "fence wait 0.12 ms, 2 in flight"
+    std::string summary() const;
+
+private:
+    // Wait for a fence and delete it, returns false if it had not been signaled yet
+    bool wait(__GLsync*& fence);
+
+    std::array<__GLsync*, maxFramesInFlight> fences_;
+    GLuint framesInFlight_;
+    GLuint slot_;
+    size_t frame_;
+    double totalWaitMs_;
+    Stats stats_;
+};
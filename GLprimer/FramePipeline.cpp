@@ -0,0 +1,208 @@
+/*
+ * Prepares the next frame on worker threads while the GL thread submits the current one.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "FramePipeline.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+const size_t batchSize = 256;  // Objects per job
+
+// Multiply two column-major 4x4 matrices
+std::array<GLfloat, 16> multiply(const std::array<GLfloat, 16>& a,
+                                 const std::array<GLfloat, 16>& b) {
+    std::array<GLfloat, 16> result;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            result[4 * column + row] = a[row] * b[4 * column] + a[4 + row] * b[4 * column + 1] +
+                                       a[8 + row] * b[4 * column + 2] +
+                                       a[12 + row] * b[4 * column + 3];
+        }
+    }
+    return result;
+}
+
+/*
+ * Test a sphere in model coordinates against the six clip planes of a modelview projection
+ * matrix. Each plane is a sum or difference of the last row and one of the others.
+ */
+bool insideFrustum(const std::array<GLfloat, 16>& m, const std::array<GLfloat, 3>& center,
+                   GLfloat radius) {
+    for (int row = 0; row < 3; row++) {
+        for (GLfloat sign : {1.0f, -1.0f}) {
+            const GLfloat a = m[3] + sign * m[row];
+            const GLfloat b = m[7] + sign * m[4 + row];
+            const GLfloat c = m[11] + sign * m[8 + row];
+            const GLfloat d = m[15] + sign * m[12 + row];
+            const GLfloat distance = a * center[0] + b * center[1] + c * center[2] + d;
+            if (distance < -radius * std::sqrt(a * a + b * b + c * c)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+FramePipeline::FramePipeline(unsigned numThreads)
+    : current_(0), started_(false), pool_(numThreads) {}
+
+size_t FramePipeline::add(TriangleSoup& mesh, GLuint program, Texture* texture,
+                          Transform transform, const TexturePacker::Region* region) {
+    pool_.wait();  // The workers read the objects
+    const TriangleSoup::Bounds bounds = mesh.bounds();
+    Object object = {&mesh, program, texture, region, std::move(transform), {}, 0.0f};
+    GLfloat squared = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        object.center[axis] = 0.5f * (bounds.min[axis] + bounds.max[axis]);
+        const GLfloat half = 0.5f * (bounds.max[axis] - bounds.min[axis]);
+        squared += half * half;
+    }
+    object.radius = std::sqrt(squared);
+    objects_.push_back(std::move(object));
+    scopes_.push_back("object " + std::to_string(objects_.size() - 1));
+
+    // The queues record on the workers, where they cannot look up uniform locations. The
+    // recorded lists do not draw the new object, so they are recorded again.
+    for (Slot& slot : slots_) {
+        slot.queue.addProgram(program);
+        slot.recorded = false;
+    }
+    return objects_.size() - 1;
+}
+
+void FramePipeline::prepare(const Frame& frame, Slot& slot) {
+    slot.frame = frame;
+    slot.modelviews.resize(objects_.size());
+    slot.visible.resize(objects_.size());
+    slot.draws.resize(objects_.size());
+    slot.changed = !slot.recorded;
+    slot.started = std::chrono::steady_clock::now();
+    if (objects_.empty()) {
+        slot.commands.clear();
+        slot.visibleCount = 0;
+        slot.prepareMs = 0.0;
+        return;
+    }
+    const size_t batches = (objects_.size() + batchSize - 1) / batchSize;
+    slot.remaining = batches;
+    for (size_t b = 0; b < batches; b++) {
+        const size_t begin = b * batchSize;
+        const size_t end = std::min(begin + batchSize, objects_.size());
+        pool_.enqueue([this, &slot, begin, end]() { prepareBatch(slot, begin, end); });
+    }
+}
+
+/*
+ * slot.visible still holds the objects of the last frame prepared in the slot, which are the
+ * ones its list draws. Each batch patches the matrices of its visible objects into the list
+ * as it goes, and flags the frame as changed if an object appeared or disappeared. The
+ * patches are wasted then, since the last batch records the list again.
+ */
+void FramePipeline::prepareBatch(Slot& slot, size_t begin, size_t end) {
+    TRACE_ZONE("FramePipeline::prepareBatch");
+    const Frame& frame = slot.frame;
+    bool changed = false;
+    for (size_t i = begin; i < end; i++) {
+        const Object& object = objects_[i];
+        slot.modelviews[i] = multiply(frame.view, object.transform(frame));
+        const bool visible = insideFrustum(multiply(frame.projection, slot.modelviews[i]),
+                                           object.center, object.radius);
+        changed |= (visible != (slot.visible[i] != 0));
+        slot.visible[i] = visible;
+        if (visible && slot.recorded) {
+            slot.commands.patchMatrix(slot.queue.patch(slot.draws[i]), slot.modelviews[i]);
+        }
+    }
+    if (changed) {
+        slot.changed = true;
+    }
+    if (--slot.remaining > 0) {
+        return;
+    }
+
+    // All batches are done, the modelview matrices of the frame are complete
+    slot.visibleCount = 0;
+    slot.patched = !slot.changed;
+    for (size_t i = 0; i < objects_.size(); i++) {
+        if (slot.visible[i]) {
+            if (!slot.patched) {
+                const Object& object = objects_[i];
+                slot.draws[i] = slot.queue.submit(*object.mesh, object.program, object.texture,
+                                                  slot.modelviews[i], object.region, &scopes_[i]);
+            }
+            slot.visibleCount++;
+        }
+    }
+    if (!slot.patched) {
+        slot.commands.clear();
+        slot.queue.record(slot.commands);
+        slot.recorded = true;
+    }
+    slot.prepareMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - slot.started)
+            .count();
+}
+
+void FramePipeline::submit(const Frame& frame, GpuProfiler* profiler) {
+    TRACE_ZONE("FramePipeline::submit");
+    const auto start = std::chrono::steady_clock::now();
+    if (!started_) {
+        prepare(frame, slots_[current_]);  // Nothing was prepared yet
+        started_ = true;
+    }
+    pool_.wait();
+    stats_.waitMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+
+    Slot& ready = slots_[current_];
+    current_ = 1 - current_;
+    prepare(frame, slots_[current_]);
+
+    ready.commands.execute(profiler);
+    stats_.objects = objects_.size();
+    stats_.visible = ready.visibleCount;
+    stats_.commands = ready.commands.stats().commands;
+    stats_.patched = ready.patched;
+    stats_.recorded += ready.patched ? 0 : 1;
+    stats_.frames++;
+    stats_.queue = ready.queue.stats();
+    stats_.prepareMs = ready.prepareMs;
+}
+
+const FramePipeline::Frame& FramePipeline::drawnFrame() const {
+    return slots_[1 - current_].frame;  // The workers only write the slot being prepared
+}
+
+bool FramePipeline::drawn(size_t object, std::array<GLfloat, 16>& modelview) const {
+    const Slot& slot = slots_[1 - current_];
+    if (!started_ || object >= slot.visible.size() || !slot.visible[object]) {
+        return false;
+    }
+    modelview = slot.modelviews[object];
+    return true;
+}
+
+FramePipeline::Stats FramePipeline::stats() const { return stats_; }
+
+std::string FramePipeline::summary() const {
+    const RenderQueue::StateChanges& u = stats_.queue.unsorted;
+    const RenderQueue::StateChanges& s = stats_.queue.sorted;
+    char text[160];
+    snprintf(text, sizeof(text),
+             "%zu/%zu visible, %zu commands %s, binds %zu -> %zu, prepare %.2f ms, wait %.2f ms",
+             stats_.visible, stats_.objects, stats_.commands,
+             stats_.patched ? "patched" : "recorded", u.programs + u.textures + u.vaos,
+             s.programs + s.textures + s.vaos, stats_.prepareMs, stats_.waitMs);
+    return text;
+}
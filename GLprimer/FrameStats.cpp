@@ -0,0 +1,158 @@
+/*
+ * Frame time statistics over a rolling window of frames: percentiles, maximum and stutters.
+ *
+ * This code is in the public domain.
+ */
+#include "FrameStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+// Nearest rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+}  // namespace
+
+FrameStats::FrameStats(size_t capacity, double stutterFactor)
+    : times_(std::max(capacity, size_t(1)), 0.0)
+    , next_(0)
+    , count_(0)
+    , frames_(0)
+    , stutterFactor_(stutterFactor)
+    , started_(false) {}
+
+bool FrameStats::frame() {
+    const auto now = std::chrono::steady_clock::now();
+    if (!started_) {
+        started_ = true;
+        last_ = now;
+        updated_ = now;
+        return false;
+    }
+    times_[next_] = std::chrono::duration<double, std::milli>(now - last_).count();
+    next_ = (next_ + 1) % times_.size();
+    count_ = std::min(count_ + 1, times_.size());
+    frames_++;
+    last_ = now;
+
+    // Update only once every second
+    if (now - updated_ < std::chrono::seconds(1)) {
+        return false;
+    }
+    updated_ = now;
+    update();
+    return true;
+}
+
+void FrameStats::update() {
+    std::vector<double> sorted = times();
+    std::sort(sorted.begin(), sorted.end());
+
+    stats_ = Stats();
+    stats_.frames = frames_;
+    stats_.samples = sorted.size();
+    if (sorted.empty()) {
+        return;
+    }
+    double sum = 0.0;
+    for (double time : sorted) {
+        sum += time;
+    }
+    stats_.averageMs = sum / sorted.size();
+    stats_.fps = (stats_.averageMs > 0.0) ? 1000.0 / stats_.averageMs : 0.0;
+    stats_.p50Ms = percentile(sorted, 50.0);
+    stats_.p95Ms = percentile(sorted, 95.0);
+    stats_.p99Ms = percentile(sorted, 99.0);
+    stats_.maxMs = sorted.back();
+    const double stutterMs = stutterFactor_ * stats_.p50Ms;
+    stats_.stutters = sorted.end() - std::upper_bound(sorted.begin(), sorted.end(), stutterMs);
+}
+
+FrameStats::Stats FrameStats::stats() const { return stats_; }
+
+std::vector<double> FrameStats::times() const {
+    std::vector<double> ordered;
+    ordered.reserve(count_);
+    const size_t first = (next_ + times_.size() - count_) % times_.size();
+    for (size_t i = 0; i < count_; i++) {
+        ordered.push_back(times_[(first + i) % times_.size()]);
+    }
+    return ordered;
+}
+
+std::vector<size_t> FrameStats::histogram(double binMs, size_t bins) const {
+    std::vector<size_t> counts(bins, 0);
+    if (bins == 0 || binMs <= 0.0) {
+        return counts;
+    }
+    for (double time : times()) {
+        counts[std::min(static_cast<size_t>(time / binMs), bins - 1)]++;
+    }
+    return counts;
+}
+
+bool FrameStats::writeCSV(const std::string& filename) const {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "Could not write frame times ('" << filename << "')\n";
+        return false;
+    }
+    // Number the frames of the window from the start
+    const size_t first = frames_ - count_;
+    out << "frame,ms\n";
+    char line[100];
+    const std::vector<double> ordered = times();
+    for (size_t i = 0; i < ordered.size(); i++) {
+        snprintf(line, sizeof(line), "%zu,%.4f\n", first + i, ordered[i]);
+        out << line;
+    }
+    if (out.fail()) {
+        std::cerr << "Could not write frame times ('" << filename << "')\n";
+        return false;
+    }
+    return true;
+}
+
+bool FrameStats::writeJSON(const std::string& filename) const {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "Could not write frame times ('" << filename << "')\n";
+        return false;
+    }
+    char line[200];
+    snprintf(line, sizeof(line),
+             "{\n  \"frames\": %zu,\n  \"average_ms\": %.4f,\n  \"p50_ms\": %.4f,\n"
+             "  \"p95_ms\": %.4f,\n  \"p99_ms\": %.4f,\n  \"max_ms\": %.4f,\n",
+             stats_.frames, stats_.averageMs, stats_.p50Ms, stats_.p95Ms, stats_.p99Ms,
+             stats_.maxMs);
+    out << line << "  \"stutters\": " << stats_.stutters << ",\n  \"frame_ms\": [";
+    const std::vector<double> ordered = times();
+    for (size_t i = 0; i < ordered.size(); i++) {
+        snprintf(line, sizeof(line), "%s%.4f", (i == 0) ? "" : ", ", ordered[i]);
+        out << line;
+    }
+    out << "]\n}\n";
+    if (out.fail()) {
+        std::cerr << "Could not write frame times ('" << filename << "')\n";
+        return false;
+    }
+    return true;
+}
+
+std::string FrameStats::summary() const {
+    char text[100];
+    snprintf(text, sizeof(text), "p50 %.1f, p95 %.1f, p99 %.1f, max %.1f ms, %zu stutters",
+             stats_.p50Ms, stats_.p95Ms, stats_.p99Ms, stats_.maxMs, stats_.stutters);
+    return text;
+}
@@ -0,0 +1,71 @@
+/*
+ * Frame time statistics over a rolling window of frames: percentiles, maximum and stutters.
+ *
+ * Usage: Call frame() once per frame, at the same point of each frame. It stores the time
+ *        since the previous call in a ring of the last capacity frames, and once per second
+ *        updates the statistics that stats() and summary() return, so that they are cheap
+ *        to read every frame. A frame that takes more than stutterFactor times the median
+ *        of the window counts as a stutter. histogram() counts the frames of the window per
+ *        frame time bin, and writeCSV() and writeJSON() export the frame times of the
+ *        window with their statistics. Each instance is independent, for example one per
+ *        window.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class FrameStats {
+public:
+    struct Stats {
+        size_t frames = 0;       // Frames measured since the start
+        size_t samples = 0;      // Frames in the window
+        double averageMs = 0.0;
+        double fps = 0.0;        // From the average
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+        double maxMs = 0.0;
+        size_t stutters = 0;     // Frames in the window slower than stutterFactor * p50
+    };
+
+    /* Constructor: keep the last capacity frame times */
+    explicit FrameStats(size_t capacity = 1000, double stutterFactor = 2.0);
+
+    // Record the end of a frame, returns true when the statistics were updated
+    bool frame();
+
+    // Compute the statistics of the window now
+    void update();
+
+    // The statistics of the last update
+    Stats stats() const;
+
+    // Frame times of the window from the oldest, in ms
+    std::vector<double> times() const;
+
+    // Frames of the window per bin of binMs, the last bin also counts all slower frames
+    std::vector<size_t> histogram(double binMs, size_t bins) const;
+
+    // Write the frame times of the window, the JSON file with the statistics of the last
+    // update, returns false on failure
+    bool writeCSV(const std::string& filename) const;
+    bool writeJSON(const std::string& filename) const;
+
+    // Tail latency as "p50 16.7, p95 17.1, p99 20.3, max 33.4 ms, 2 stutters"
+    std::string summary() const;
+
+private:
+    std::vector<double> times_;  // Ring of frame times in ms
+    size_t next_;                // Where the next time goes
+    size_t count_;               // Times in the ring
+    size_t frames_;
+    double stutterFactor_;
+    bool started_;
+    std::chrono::steady_clock::time_point last_;     // End of the previous frame
+    std::chrono::steady_clock::time_point updated_;  // Time of the last update
+    Stats stats_;
+};
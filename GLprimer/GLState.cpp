@@ -0,0 +1,205 @@
+/*
+ * A shadow copy of the GL binding and rasterizer state, to drop calls that change nothing.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "GLState.hpp"
+
+#include <array>
+#include <map>
+
+namespace {
+
+const GLuint unknown = ~0u;  // A value no GL name or enum takes
+const GLuint shadowedUnits = 16;
+
+struct Shadow {
+    GLuint program = unknown;
+    GLuint vertexArray = unknown;
+    GLuint activeUnit = unknown;
+    std::array<GLuint, shadowedUnits> texture2D;
+    std::array<GLuint, shadowedUnits> texture2DArray;
+    std::map<GLenum, bool> enabled;  // Only capabilities that have been set are known
+    GLenum polygonMode = unknown;
+    GLenum cullFace = unknown;
+    GLState::Stats stats;
+
+    // The initial state of a new context
+    Shadow() {
+        program = 0;
+        vertexArray = 0;
+        activeUnit = 0;
+        texture2D.fill(0);
+        texture2DArray.fill(0);
+        polygonMode = GL_FILL;
+        cullFace = GL_BACK;
+    }
+
+    void forget() {
+        program = unknown;
+        vertexArray = unknown;
+        activeUnit = unknown;
+        texture2D.fill(unknown);
+        texture2DArray.fill(unknown);
+        enabled.clear();
+        polygonMode = unknown;
+        cullFace = unknown;
+    }
+};
+
+Shadow& shadow() {
+    static Shadow state;
+    return state;
+}
+
+// Update a shadowed value, returns true if the call has to be passed on to GL
+template <typename T>
+bool change(T& current, T value, GLState::Counters& counters) {
+    counters.calls++;
+    if (current == value) {
+        counters.filtered++;
+        return false;
+    }
+    current = value;
+    return true;
+}
+
+// The shadowed binding of a target on the active unit, or nullptr if it is not shadowed
+GLuint* textureBinding(GLenum target) {
+    Shadow& s = shadow();
+    if (s.activeUnit == unknown) {
+        // Texture binds are per unit, so query the unit once rather than pass on every bind
+        GLint unit = GL_TEXTURE0;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+        s.activeUnit = static_cast<GLuint>(unit - GL_TEXTURE0);
+    }
+    if (s.activeUnit >= shadowedUnits) {
+        return nullptr;
+    }
+    switch (target) {
+        case GL_TEXTURE_2D: return &s.texture2D[s.activeUnit];
+        case GL_TEXTURE_2D_ARRAY: return &s.texture2DArray[s.activeUnit];
+        default: return nullptr;
+    }
+}
+
+}  // namespace
+
+void GLState::useProgram(GLuint program) {
+    Shadow& s = shadow();
+    if (change(s.program, program, s.stats.program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    Shadow& s = shadow();
+    if (change(s.vertexArray, vao, s.stats.vertexArray)) {
+        glBindVertexArray(vao);
+    }
+}
+
+void GLState::activeTexture(GLuint unit) {
+    Shadow& s = shadow();
+    if (change(s.activeUnit, unit, s.stats.texture)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture) {
+    Shadow& s = shadow();
+    GLuint* binding = textureBinding(target);
+    if (!binding) {
+        s.stats.texture.calls++;
+        glBindTexture(target, texture);
+    } else if (change(*binding, texture, s.stats.texture)) {
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::enable(GLenum cap) {
+    Shadow& s = shadow();
+    auto inserted = s.enabled.emplace(cap, false);
+    if (change(inserted.first->second, true, s.stats.rasterizer) || inserted.second) {
+        glEnable(cap);
+    }
+}
+
+void GLState::disable(GLenum cap) {
+    Shadow& s = shadow();
+    auto inserted = s.enabled.emplace(cap, true);
+    if (change(inserted.first->second, false, s.stats.rasterizer) || inserted.second) {
+        glDisable(cap);
+    }
+}
+
+void GLState::polygonMode(GLenum mode) {
+    Shadow& s = shadow();
+    if (change(s.polygonMode, mode, s.stats.rasterizer)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void GLState::cullFace(GLenum mode) {
+    Shadow& s = shadow();
+    if (change(s.cullFace, mode, s.stats.rasterizer)) {
+        glCullFace(mode);
+    }
+}
+
+void GLState::deleteProgram(GLuint program) {
+    if (program == 0) {
+        return;
+    }
+    glDeleteProgram(program);
+    Shadow& s = shadow();
+    if (s.program == program) {
+        // A program in use is only flagged for deletion, so the binding is no longer known
+        s.program = unknown;
+    }
+}
+
+void GLState::deleteVertexArray(GLuint vao) {
+    if (vao == 0) {
+        return;
+    }
+    glDeleteVertexArrays(1, &vao);
+    Shadow& s = shadow();
+    if (s.vertexArray == vao) {
+        s.vertexArray = 0;  // Deleting a bound vertex array binds 0
+    }
+}
+
+void GLState::deleteTexture(GLuint texture) {
+    if (texture == 0) {
+        return;
+    }
+    glDeleteTextures(1, &texture);
+    // Deleting a texture binds 0 in its place on every unit
+    Shadow& s = shadow();
+    for (GLuint unit = 0; unit < shadowedUnits; unit++) {
+        if (s.texture2D[unit] == texture) {
+            s.texture2D[unit] = 0;
+        }
+        if (s.texture2DArray[unit] == texture) {
+            s.texture2DArray[unit] = 0;
+        }
+    }
+}
+
+void GLState::invalidate() { shadow().forget(); }
+
+GLState::Stats GLState::stats() { return shadow().stats; }
+
+void GLState::resetStats() { shadow().stats = Stats(); }
+
+std::string GLState::summary() {
+    const Stats& s = shadow().stats;
+    const size_t calls =
+        s.program.calls + s.vertexArray.calls + s.texture.calls + s.rasterizer.calls;
+    const size_t filtered = s.program.filtered + s.vertexArray.filtered + s.texture.filtered +
+                            s.rasterizer.filtered;
+    return "GL " + std::to_string(filtered) + "/" + std::to_string(calls) + " filtered";
+}
@@ -0,0 +1,62 @@
+/*
+ * A shadow copy of the GL binding and rasterizer state, to drop calls that change nothing.
+ *
+ * Usage: Call the GLState functions instead of glUseProgram(), glBindVertexArray(),
+ *        glActiveTexture(), glBindTexture(), glEnable()/glDisable(), glPolygonMode() and
+ *        glCullFace(). A call is passed on to GL only if it changes the shadowed state.
+ *        Delete programs, vertex arrays and textures with the delete functions, so that a
+ *        reused name is not mistaken for a bound object. After calling GL directly for any
+ *        of this state, call invalidate(), which makes the next call of each kind pass on.
+ *        The shadow starts out with the state of a new context. stats() counts the calls
+ *        and how many of them were filtered. There is a single shadow, use it from the GL
+ *        thread of one context only.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <string>
+
+class GLState {
+public:
+    struct Counters {
+        size_t calls = 0;     // Calls made to GLState
+        size_t filtered = 0;  // Calls that were not passed on to GL
+    };
+
+    struct Stats {
+        Counters program;      // useProgram()
+        Counters vertexArray;  // bindVertexArray()
+        Counters texture;      // activeTexture() and bindTexture()
+        Counters rasterizer;   // enable(), disable(), polygonMode() and cullFace()
+    };
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+
+    // Select a texture unit by its number (0 for GL_TEXTURE0)
+    static void activeTexture(GLuint unit);
+
+    // Bind a texture on the active unit, 2D and 2D array bindings are shadowed
+    static void bindTexture(GLenum target, GLuint texture);
+
+    static void enable(GLenum cap);
+    static void disable(GLenum cap);
+    static void polygonMode(GLenum mode);  // For GL_FRONT_AND_BACK, the only core profile face
+    static void cullFace(GLenum mode);
+
+    // Delete an object and forget the bindings of its name (0 is ignored)
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArray(GLuint vao);
+    static void deleteTexture(GLuint texture);
+
+    // Forget all shadowed state, after GL calls made behind the shadow's back
+    static void invalidate();
+
+    static Stats stats();
+    static void resetStats();
+
+    // Filtered calls as "GL 12/40 filtered"
+    static std::string summary();
+};
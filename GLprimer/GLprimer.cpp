@@ -25,6 +25,8 @@
 #include <iostream>
 // Math header for trigonometric functions
 #include <cmath>
+// For memcpy()
+#include <cstring>
 
 // Include vectors
 #include <vector>
@@ -44,6 +46,32 @@
 
 #include "Texture.hpp"
 
+#include "TextureStreamer.hpp"
+
+#include "TexturePacker.hpp"
+
+#include "ResidencyManager.hpp"
+
+#include "ResourceManager.hpp"
+
+#include "FramePipeline.hpp"
+
+#include "FramePacer.hpp"
+
+#include "DynamicBuffer.hpp"
+
+#include "GpuProfiler.hpp"
+
+#include "FrameStats.hpp"
+
+#include "Trace.hpp"
+
+#include "MemoryTracker.hpp"
+
+#include "GLState.hpp"
+
+#include "Picker.hpp"
+
 #include "Rotator.hpp"
 
 // Include shaders
@@ -174,8 +202,10 @@ std::array<float, 16> mat4perspective(float vfov, float aspect, float znear, flo
  * main(int argc, char* argv[]) - the standard C++ entry point for the program
  */
 int main(int, char*[]) {
+    TRACE_THREAD("main");
     Shader myTrexShader;
     Shader mySphereShader;
+    Shader myBoxShader;
     // Vertex coordinates (x,y,z) for three vertices
     const std::vector<GLfloat> vertexArrayData = {
         /*
@@ -321,7 +351,7 @@ int main(int, char*[]) {
     GLuint vertexArrayID = 0;
     glGenVertexArrays(1, &vertexArrayID);
     // Activate the vertex array object
-    glBindVertexArray(vertexArrayID);
+    GLState::bindVertexArray(vertexArrayID);
 
     // Create the vertex buffer objects for attribute locations 0 and 1
     // (the list of vertex coordinates and the list of vertex colors).
@@ -331,9 +361,24 @@ int main(int, char*[]) {
     GLuint indexBufferID = createIndexBuffer(indexArrayData);
 
     // Deactivate the vertex array object again to be nice
-    glBindVertexArray(0);
+    GLState::bindVertexArray(0);
+
+    // Pack the textures into one array texture, so that switching between objects needs no
+    // texture binds. Set to false to load them as separate textures in the background.
+    const bool packTextures = true;
 
-    myTrexShader.createShader("../shaders/vertex.glsl", "../shaders/fragment.glsl");
+    myTrexShader.createShader("../shaders/vertex_frame.glsl",
+                              packTextures ? "../shaders/fragment_array.glsl"
+                                           : "../shaders/fragment.glsl");
+    // The projection is read from the "Frame" uniform block, at binding point 0
+    const GLuint frameBinding = 0;
+    glUniformBlockBinding(myTrexShader.id(), glGetUniformBlockIndex(myTrexShader.id(), "Frame"),
+                          frameBinding);
+
+    // The box always has a texture of its own, bound instead of a region of the packed array
+    myBoxShader.createShader("../shaders/vertex_frame.glsl", "../shaders/fragment.glsl");
+    glUniformBlockBinding(myBoxShader.id(), glGetUniformBlockIndex(myBoxShader.id(), "Frame"),
+                          frameBinding);
 
     // Do this before the rendering loop
     GLint locationTime = glGetUniformLocation(myTrexShader.id(), "time");
@@ -341,126 +386,263 @@ int main(int, char*[]) {
         std::cout << "Unable to locate variable 'time'in shader!\n";
     }
 
+    // Load the textures in the background, they show a placeholder until they are ready.
+    // The streamer is declared first so that it outlives the textures.
+    TextureStreamer textureStreamer;
+
+    // Keeps the meshes and textures within 256 MB of GPU memory, declared before them so
+    // that it outlives them. Evicted textures are loaded again by the streamer.
+    ResidencyManager residency(256 * 1024 * 1024);
+    residency.setStreamer(&textureStreamer);
+
     //Generate Sphere
     TriangleSoup myTrex;
     TriangleSoup myShpere;
     TriangleSoup myBox;
+    // Meshes free their vertex and index arrays after upload by default, as the box does.
+    // The picker needs the arrays of the others, and the residency manager can evict them
+    // since they keep them.
+    myTrex.setKeepCPUCopy(true);
+    myShpere.setKeepCPUCopy(true);
     myTrex.readOBJ("meshes/trex.obj");
     myShpere.createSphere(0.4f, 50);
-    myBox.createBox(1.0f, 1.0f, 1.0f);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    myBox.createBox(0.3f, 0.3f, 0.3f);
+    residency.add(myTrex);
+    residency.add(myShpere);
+    residency.add(myBox);
+    GLState::enable(GL_CULL_FACE);
+    GLState::enable(GL_DEPTH_TEST);
 
     mat4print(mat4perspective(M_PI / 4.0, 1.0f, 0.1f, 100.0f));
 
     // Locate the sampler2D uniform in the shader program
     GLint locationTex = glGetUniformLocation(myTrexShader.id(), "tex");
-    // Generate one texture object with data from a TGA file
-    Texture trexTexture;
-    trexTexture.createTexture("textures/pyramid.tga");
+    // On machines with little memory, load all textures at a reduced size
+    // Texture::loadOptions().maxSize = 512;
 
+    // Generate one texture object with data from a TGA file
+    std::shared_ptr<Texture> trexTexture;
     Texture earthTexture;
-    earthTexture.createTexture("textures/earth.tga");
-
     Texture pyramidTexture;
-    pyramidTexture.createTexture("textures/trex.tga");
+
+    // Loads each file once, however many objects ask for it
+    ResourceManager resources;
+    std::shared_ptr<Texture> boxTexture = resources.texture("textures/pyramid.tga");
+    if (boxTexture) {
+        residency.add(*boxTexture);
+    }
+
+    // Layer and region of each packed texture, used instead of binding a texture per object.
+    // The file of the box is already loaded, so its texels are read back instead.
+    TexturePacker texturePacker;
+    const size_t trexRegion = boxTexture ? texturePacker.add(*boxTexture)
+                                         : texturePacker.add("textures/pyramid.tga");
+    const size_t earthRegion = texturePacker.add("textures/earth.tga");
+    texturePacker.add("textures/trex.tga");
+
+    if (packTextures) {
+        texturePacker.build();
+    } else {
+        // The same file as the box, the registry hands out the texture it already loaded
+        trexTexture = resources.texture("textures/pyramid.tga");
+        residency.add(earthTexture);
+        residency.add(pyramidTexture);
+        earthTexture.createTextureAsync("textures/earth.tga", textureStreamer);
+        pyramidTexture.createTextureAsync("textures/trex.tga", textureStreamer);
+    }
+
+    // The meshes are transformed, culled and sorted on worker threads for the next frame
+    // while the GL thread draws the current one. The transforms only read the frame input.
+    FramePipeline pipeline;
+    const auto trexTransform = [](const FramePipeline::Frame& frame) {
+        return mat4mult(mat4mult(mat4roty(1), mat4rotx(10 * (M_PI / 100))), frame.matrices[0]);
+    };
+    const auto sphereTransform = [](const FramePipeline::Frame& frame) {
+        const float time = static_cast<float>(frame.time);
+        const std::array<GLfloat, 16> vRot = mat4rotx(5 * (M_PI / 100));
+        const std::array<GLfloat, 16> vOrbit = mat4roty((time / 4 * M_PI));
+        const std::array<GLfloat, 16> cT = mat4translate(0.0f, 0.0f, 0.8f);
+        const std::array<GLfloat, 16> matO = mat4mult(mat4mult(vOrbit, cT), vRot);
+        return mat4mult(mat4mult(mat4roty(time / 4 * M_PI), vRot), matO);
+    };
+    if (packTextures) {
+        pipeline.add(myTrex, myTrexShader.id(), nullptr, trexTransform,
+                     &texturePacker.region(trexRegion));
+        pipeline.add(myShpere, myTrexShader.id(), nullptr, sphereTransform,
+                     &texturePacker.region(earthRegion));
+    } else {
+        pipeline.add(myTrex, myTrexShader.id(), trexTexture.get(), trexTransform);
+        pipeline.add(myShpere, myTrexShader.id(), &earthTexture, sphereTransform);
+    }
+    // The box swings out of view and back, press V for a budget that only fits the meshes:
+    // its texture is then reduced and evicted while it is culled, and streamed in again
+    // behind a placeholder when it returns
+    if (boxTexture) {
+        pipeline.add(myBox, myBoxShader.id(), boxTexture.get(),
+                     [](const FramePipeline::Frame& frame) {
+                         const float time = static_cast<float>(frame.time);
+                         return mat4mult(mat4translate(2.5f * std::sin(0.5f * time), 0.6f, 0.0f),
+                                         mat4roty(time));
+                     });
+    }
+    FramePipeline::Frame frame;
+    frame.view = mat4translate(0.0f, 0.0f, -3.0f);
+
+    // Click on a mesh to print the object, triangle and barycentric coordinates under the
+    // cursor, found with a BVH per mesh on the CPU. The objects are in pipeline order.
+    Picker picker;
+    picker.add(myTrex.mesh());
+    picker.add(myShpere.mesh());
 
     KeyRotator myKeyRotator(window);
     MouseRotator myMouseRotator(window);
 
+    // Keep the CPU at most 2 frames ahead of the GPU, press 1, 2 or 3 to change it. The
+    // per-frame uniforms have a copy for each frame in flight.
+    FramePacer framePacer(2);
+    DynamicBuffer frameUniforms(GL_UNIFORM_BUFFER, 16 * sizeof(GLfloat));
+
+    // GPU and CPU times of the parts of the frame and the frame time percentiles, press P to
+    // write them to profile.csv, frametimes.csv and frametimes.json
+    GpuProfiler profiler;
+    FrameStats frameStats;
+    bool profileKeyDown = false;
+
+    // Print the memory use once the textures are loaded, and when M is pressed
+    bool loaded = false;
+    bool memoryKeyDown = false;
+    bool tightBudget = false;
+    bool budgetKeyDown = false;
+
     // Rendering loop
     while (!glfwWindowShouldClose(window)) {
-        
+        TRACE_ZONE("frame");
+        // Wait until the GPU is done with the frame that used this slot
+        const GLuint frameSlot = framePacer.beginFrame();
+        profiler.beginFrame();
+
         glfwGetWindowSize(window, &width, &height);
         glViewport(0, 0, width, height);
 
-        util ::displayFPS(window);
+        util ::displayFPS(window, frameStats,
+                          profiler.summary() + "  " + residency.summary() + "  " +
+                              pipeline.summary() + "  " + GLState::summary() + "  " +
+                              framePacer.summary());
+        GLState::resetStats();  // Count the filtered calls of one frame
+
+        // Upload textures that finished loading, spending at most 2 ms per frame on it
+        profiler.begin("upload");
+        textureStreamer.update(2.0);
+        profiler.end();
         // Set the clear color to a dark gray (RGBA)
         glClearColor(0.3f, 0.3f, 0.3f, 0.0f);
 
         
         // Clear the color and depth buffers for drawing
+        profiler.begin("clear");
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        profiler.end();
 
         /* ---- Rendering code should go here ---- */
         
         /*
-        glBindTexture(GL_TEXTURE_2D, pyramidTexture.id());
+        pyramidTexture.bind();
         myBox.render();
         */
 
         // restore previous state (no texture, no shader)
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glUseProgram(0);
+        GLState::bindTexture(GL_TEXTURE_2D, 0);
+        GLState::useProgram(0);
 
         // Do this in the rendering loop to update the uniform variable "time"
         float time = static_cast<float>(glfwGetTime());  // Number of seconds since the program was started
-        glUseProgram(myTrexShader.id());                            // Activate the shader to set its variables
+        myTrexShader.use();                                     // Activate the shader to set its variables
         glUniform1f(locationTime, time);                        // Copy the value to the shader program
         myKeyRotator.poll();
         std::array<GLfloat, 16> matKey = mat4mult(mat4rotz(-myKeyRotator.phi()), mat4rotx(-myKeyRotator.theta()));
         myMouseRotator.poll();
+        if (myMouseRotator.clicked()) {
+            // Pick in the frame on screen, which the pipeline drew in the last submit()
+            for (size_t object = 0; object < picker.objectCount(); object++) {
+                std::array<GLfloat, 16> modelview = mat4identity();
+                const bool visible = pipeline.drawn(object, modelview);
+                picker.update(object, modelview, visible);
+            }
+            int windowWidth;
+            int windowHeight;
+            glfwGetWindowSize(window, &windowWidth, &windowHeight);
+            const Picker::Result picked =
+                picker.pick(myMouseRotator.x(), myMouseRotator.y(), windowWidth, windowHeight,
+                            pipeline.drawnFrame().projection);
+            std::cout << "Picked " << picker.summary();
+            if (picked.hit()) {
+                std::cout << ", barycentrics (" << 1.0f - picked.u - picked.v << ", " << picked.u
+                          << ", " << picked.v << ")";
+            }
+            std::cout << "\n";
+        }
         std::array<GLfloat, 16> matMouse = mat4mult(mat4rotz(myMouseRotator.phi()), mat4rotx(-myMouseRotator.theta()));
 
-        glUseProgram(myTrexShader.id()); 
-        std::array<GLfloat, 16> vTranslate = mat4translate(0.0f, 0.0f, -3.0f);
-        std::array<GLfloat, 16> vRot = mat4rotx(10*(M_PI/100));
-
-        std::array<GLfloat, 16> rSpin = mat4mult(mat4mult(mat4mult(vTranslate,mat4roty(1)),vRot),matKey);
-        GLint locationR = glGetUniformLocation(myTrexShader.id(), "MV");
-        glUseProgram(myTrexShader.id());  // Activate the shader to set its variables
-        glUniformMatrix4fv(locationR, 1, GL_FALSE, rSpin.data());  // Copy the value
-        
-        glBindTexture(GL_TEXTURE_2D, trexTexture.id());
-        myTrex.render();
-
-        vRot = mat4rotx(5 * (M_PI / 100));
-        std::array<GLfloat, 16> vOrbit = mat4roty((time / 4 * M_PI));
-        std::array<GLfloat, 16> cT = mat4translate(0.0f,0.0f,0.8f);
-
-         std::array<GLfloat, 16> matO = mat4mult(mat4mult(vOrbit, cT), vRot);
-
-        rSpin = mat4mult(mat4mult(mat4mult(vTranslate, mat4roty(time/4*M_PI)), vRot),matO);
-        locationR = glGetUniformLocation(myTrexShader.id(), "MV");
-        glUseProgram(myTrexShader.id());  // Activate the shader to set its variables
-        glUniformMatrix4fv(locationR, 1, GL_FALSE, rSpin.data());  // Copy the value
-
-
-        glBindTexture(GL_TEXTURE_2D, earthTexture.id());
-        myShpere.render();
-
         std::array<GLfloat, 16> Ilumination = mat4mult(matMouse,mat4identity());
         GLint locationT = glGetUniformLocation(myTrexShader.id(), "T");
-        glUseProgram(myTrexShader.id());  // Activate the shader to set its variables
+        myTrexShader.use();  // Activate the shader to set its variables
         glUniformMatrix4fv(locationT, 1, GL_FALSE, Ilumination.data());  // Copy the value
+        myBoxShader.use();
+        glUniformMatrix4fv(glGetUniformLocation(myBoxShader.id(), "T"), 1, GL_FALSE,
+                           Ilumination.data());
 
         std::array<GLfloat, 16> P = mat4perspective(M_PI/3.0, 1.0f, 0.1f,100.0f);
-        GLint locationP = glGetUniformLocation(myTrexShader.id(), "P");
-        glUseProgram(myTrexShader.id());  // Activate the shader to set its variables
-        glUniformMatrix4fv(locationP, 1, GL_FALSE, P.data());  // Copy the value
-
+        void* frameData = frameUniforms.map(frameSlot);  // The copy of this frame slot
+        if (frameData) {
+            std::memcpy(frameData, P.data(), sizeof(P));
+            frameUniforms.unmap();
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, frameBinding, frameUniforms.id(),
+                          frameUniforms.offset(frameSlot), frameUniforms.size());
+
+        // Draw the meshes prepared from the previous input, and prepare this one meanwhile
+        frame.time = time;
+        frame.projection = P;
+        frame.matrices.assign(1, matKey);
+        if (packTextures) {
+            GLState::bindTexture(GL_TEXTURE_2D_ARRAY, texturePacker.id());
+        }
+        // Each draw of the pipeline is timed too, in the scopes "object 0", "object 1"...
+        profiler.begin("objects");
+        pipeline.submit(frame, &profiler);
+        profiler.end();
 
         
         // Activate the vertex array object we want to draw (we may have several)
-        glBindVertexArray(vertexArrayID);
-        glUseProgram(myTrexShader.id());
+        profiler.begin("box");
+        GLState::bindVertexArray(vertexArrayID);
+        myTrexShader.use();
         // Draw our triangle with 3 vertices.
         // When the last argument of glDrawElements is nullptr, it means
         // "use the previously bound index buffer". (This is not obvious.)
         // The index buffer is part of the VAO state and is bound with it.
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glCullFace(GL_BACK);
+        GLState::polygonMode(GL_FILL);
+        GLState::cullFace(GL_BACK);
 
         // Draw again
         glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glCullFace(GL_BACK);
+        GLState::polygonMode(GL_FILL);
+        GLState::cullFace(GL_BACK);
+        profiler.end();
+
 
 
 
+        // Evict what was not rendered recently if the budget is exceeded
+        profiler.begin("residency");
+        residency.update();
+        profiler.end();
 
-        // Swap buffers, display the image and prepare for next frame
+        // Mark the end of the commands of this frame, then swap buffers, display the image
+        // and prepare for next frame
+        profiler.endFrame();
+        framePacer.endFrame();
         glfwSwapBuffers(window);
 
         // Poll events (read keyboard and mouse input)
@@ -470,14 +652,48 @@ int main(int, char*[]) {
         if (glfwGetKey(window, GLFW_KEY_ESCAPE)) {
             glfwSetWindowShouldClose(window, GL_TRUE);
         }
+        for (GLuint frames = 1; frames <= FramePacer::maxFramesInFlight; frames++) {
+            if (glfwGetKey(window, GLFW_KEY_0 + frames) && framePacer.framesInFlight() != frames) {
+                framePacer.setFramesInFlight(frames);
+            }
+        }
+        const bool profileKey = glfwGetKey(window, GLFW_KEY_P);
+        if (profileKey && !profileKeyDown) {
+            profiler.writeCSV("profile.csv");
+            frameStats.update();
+            frameStats.writeCSV("frametimes.csv");
+            frameStats.writeJSON("frametimes.json");
+        }
+        profileKeyDown = profileKey;
+        const bool memoryKey = glfwGetKey(window, GLFW_KEY_M);
+        if (!loaded && textureStreamer.metrics().queueDepth == 0) {
+            std::cout << "Memory use after loading, with the peak while loading:\n";
+            MemoryTracker::dump(std::cout);
+            loaded = true;
+        } else if (memoryKey && !memoryKeyDown) {
+            MemoryTracker::dump(std::cout);
+        }
+        memoryKeyDown = memoryKey;
+        const bool budgetKey = glfwGetKey(window, GLFW_KEY_V);
+        if (budgetKey && !budgetKeyDown) {
+            tightBudget = !tightBudget;
+            residency.setBudget(tightBudget ? residency.usage().meshBytes : 256 * 1024 * 1024);
+            std::cout << "Residency budget " << residency.summary() << "\n";
+        }
+        budgetKeyDown = budgetKey;
     }
     // release the vertex and index buffers as well as the vertex array
-    glDeleteVertexArrays(1, &vertexArrayID);
+    GLState::deleteVertexArray(vertexArrayID);
     glDeleteBuffers(1, &vertexBufferID);
     glDeleteBuffers(1, &indexBufferID);
     glDeleteBuffers(1, &colorBufferID);
 
 
+    // Write the loading and frame zones, for chrome://tracing or ui.perfetto.dev
+    if (Trace::enabled) {
+        Trace::write("trace.json");
+    }
+
     // Close the OpenGL window and terminate GLFW
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,193 @@
+/*
+ * Measures the GPU and CPU time of named scopes of a frame, with timer queries.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, const std::string& name)
+    : profiler_(profiler) {
+    profiler_.begin(name);
+}
+
+GpuProfiler::Scope::~Scope() { profiler_.end(); }
+
+GpuProfiler::GpuProfiler(GLuint window)
+    : frame_(0)
+    , inFrame_(false)
+    , window_(std::max(window, 1u))
+    , windowFrames_(0)
+    , frames_(0)
+    , dropped_(0) {}
+
+GpuProfiler::~GpuProfiler() {
+    for (FrameQueries& frame : ring_) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        }
+    }
+}
+
+GLuint GpuProfiler::query(FrameQueries& frame) {
+    if (frame.used == frame.queries.size()) {
+        GLuint id = 0;
+        glGenQueries(1, &id);
+        frame.queries.push_back(id);
+    }
+    return frame.queries[frame.used++];
+}
+
+bool GpuProfiler::collect(FrameQueries& frame) {
+    // Queries finish in order, so the last one of the frame is available after all others
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return false;
+    }
+    for (const Record& record : frame.records) {
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(record.beginQuery, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(record.endQuery, GL_QUERY_RESULT, &end);
+        Sums& sums = sums_[record.scope];
+        sums.gpuMs += (end > begin ? end - begin : 0) / 1.0e6;
+        sums.cpuMs += record.cpuMs;
+        sums.calls++;
+    }
+    frame.pending = false;
+    frames_++;
+
+    // Publish the averages once per window
+    if (++windowFrames_ >= window_) {
+        timings_.resize(sums_.size());
+        for (size_t i = 0; i < sums_.size(); i++) {
+            timings_[i].name = sums_[i].name;
+            timings_[i].depth = sums_[i].depth;
+            timings_[i].gpuMs = sums_[i].gpuMs / windowFrames_;
+            timings_[i].cpuMs = sums_[i].cpuMs / windowFrames_;
+            timings_[i].calls = static_cast<double>(sums_[i].calls) / windowFrames_;
+            sums_[i].gpuMs = 0.0;
+            sums_[i].cpuMs = 0.0;
+            sums_[i].calls = 0;
+        }
+        windowFrames_ = 0;
+    }
+    return true;
+}
+
+void GpuProfiler::beginFrame() {
+    if (inFrame_) {
+        std::cerr << "GpuProfiler::beginFrame() called twice without endFrame()\n";
+        endFrame();
+    }
+    // Read the finished frames from the oldest, the ring slot of this frame is the oldest
+    for (size_t i = 0; i < ringSize; i++) {
+        FrameQueries& frame = ring_[(frame_ + i) % ringSize];
+        if (frame.pending && !collect(frame)) {
+            break;
+        }
+    }
+    FrameQueries& current = ring_[frame_ % ringSize];
+    if (current.pending) {
+        dropped_++;
+    }
+    current.records.clear();
+    current.used = 0;
+    current.pending = false;
+    inFrame_ = true;
+    begin("frame");
+}
+
+void GpuProfiler::endFrame() {
+    if (!inFrame_) {
+        std::cerr << "GpuProfiler::endFrame() called without beginFrame()\n";
+        return;
+    }
+    if (open_.size() != 1) {
+        std::cerr << "GpuProfiler: " << open_.size() - 1 << " scopes not ended in the frame\n";
+    }
+    while (!open_.empty()) {
+        end();
+    }
+    ring_[frame_ % ringSize].pending = true;
+    frame_++;
+    inFrame_ = false;
+}
+
+void GpuProfiler::begin(const std::string& name) {
+    if (!inFrame_) {
+        std::cerr << "GpuProfiler scope '" << name << "' begun outside of a frame\n";
+        return;
+    }
+    auto found = scopeIndex_.find(name);
+    if (found == scopeIndex_.end()) {
+        found = scopeIndex_.emplace(name, sums_.size()).first;
+        sums_.push_back({name, static_cast<GLuint>(open_.size()), 0.0, 0.0, 0});
+    }
+    FrameQueries& frame = ring_[frame_ % ringSize];
+    Record record;
+    record.scope = found->second;
+    record.beginQuery = query(frame);
+    record.endQuery = 0;
+    record.cpuMs = 0.0;
+    glQueryCounter(record.beginQuery, GL_TIMESTAMP);
+    record.cpuBegin = std::chrono::steady_clock::now();
+    open_.push_back(frame.records.size());
+    frame.records.push_back(record);
+}
+
+void GpuProfiler::end() {
+    if (open_.empty()) {
+        std::cerr << "GpuProfiler::end() called without begin()\n";
+        return;
+    }
+    FrameQueries& frame = ring_[frame_ % ringSize];
+    Record& record = frame.records[open_.back()];
+    open_.pop_back();
+    record.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                             record.cpuBegin)
+                       .count();
+    record.endQuery = query(frame);
+    glQueryCounter(record.endQuery, GL_TIMESTAMP);
+}
+
+std::vector<GpuProfiler::Timing> GpuProfiler::timings() const { return timings_; }
+
+size_t GpuProfiler::frames() const { return frames_; }
+
+size_t GpuProfiler::dropped() const { return dropped_; }
+
+bool GpuProfiler::writeCSV(const std::string& filename) const {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "Could not write profile ('" << filename << "')\n";
+        return false;
+    }
+    out << "scope,depth,gpu_ms,cpu_ms,calls\n";
+    for (const Timing& timing : timings_) {
+        char line[100];
+        snprintf(line, sizeof(line), ",%u,%.4f,%.4f,%.2f\n", timing.depth, timing.gpuMs,
+                 timing.cpuMs, timing.calls);
+        out << timing.name << line;
+    }
+    if (out.fail()) {
+        std::cerr << "Could not write profile ('" << filename << "')\n";
+        return false;
+    }
+    return true;
+}
+
+std::string GpuProfiler::summary() const {
+    char text[100];
+    // The first scope is always "frame"
+    const Timing frame = timings_.empty() ? Timing() : timings_.front();
+    snprintf(text, sizeof(text), "GPU %.2f ms, CPU %.2f ms", frame.gpuMs, frame.cpuMs);
+    return text;
+}
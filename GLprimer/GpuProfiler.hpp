@@ -0,0 +1,127 @@
+/*
+ * Measures the GPU and CPU time of named scopes of a frame, with timer queries.
+ *
+ * Usage: Call beginFrame() at the start of a frame and endFrame() at its end, and put the
+ *        commands to measure between begin("name") and end(), or in a Scope. Scopes can be
+ *        nested and used several times per frame, the times of a scope in one frame are
+ *        added. Each begin() and end() puts a GL_TIMESTAMP query in the command stream, so
+ *        the GPU time of a scope is from when the GPU reached its begin() to when it reached
+ *        its end(). The queries of a frame are read a few frames later, when they are
+ *        available, so the profiler never waits for the GPU. Frames whose results are still
+ *        not available when their queries are needed again are dropped. The CPU time of a
+ *        scope is measured at the same calls. timings() returns the times per frame averaged
+ *        over the last window of frames, which writeCSV() writes to a file and summary()
+ *        shortens for the window title. The whole frame is the scope "frame".
+ *        All member functions are meant to be called from the GL thread.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <array>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GpuProfiler {
+public:
+    // Frames of queries in flight, more than the frames the CPU can be ahead of the GPU
+    static const GLuint ringSize = 5;
+
+    struct Timing {
+        std::string name;
+        GLuint depth = 0;     // Nesting level, 0 for "frame"
+        double gpuMs = 0.0;   // Average time per frame
+        double cpuMs = 0.0;
+        double calls = 0.0;   // Average number of begin() per frame
+    };
+
+    // Measures the commands of its lifetime
+    class Scope {
+    public:
+        Scope(GpuProfiler& profiler, const std::string& name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        GpuProfiler& profiler_;
+    };
+
+    /* Constructor: average the times over window frames */
+    explicit GpuProfiler(GLuint window = 60);
+
+    /* Destructor: deletes the queries */
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // Read the results of the previous frames that are available, and start a frame
+    void beginFrame();
+
+    // End the frame, all scopes must be ended
+    void endFrame();
+
+    void begin(const std::string& name);
+    void end();
+
+    // Average times of the last window, in the order the scopes were first used
+    std::vector<Timing> timings() const;
+
+    // Frames measured and frames dropped because their results came too late
+    size_t frames() const;
+    size_t dropped() const;
+
+    // Write the timings as CSV, with a header line, returns false on failure
+    bool writeCSV(const std::string& filename) const;
+
+    // Frame times as "GPU 1.23 ms, CPU 0.45 ms"
+    std::string summary() const;
+
+private:
+    // One begin() and end() of a scope
+    struct Record {
+        size_t scope;
+        GLuint beginQuery;
+        GLuint endQuery;
+        std::chrono::steady_clock::time_point cpuBegin;
+        double cpuMs;
+    };
+
+    // The queries of one frame
+    struct FrameQueries {
+        std::vector<GLuint> queries;  // Allocated as needed and reused
+        std::vector<Record> records;
+        size_t used = 0;              // Queries used this frame
+        bool pending = false;         // Recorded but not read yet
+    };
+
+    struct Sums {
+        std::string name;
+        GLuint depth;
+        double gpuMs;
+        double cpuMs;
+        size_t calls;
+    };
+
+    GLuint query(FrameQueries& frame);
+
+    // Read the results of a frame if they are available, returns false if not
+    bool collect(FrameQueries& frame);
+
+    std::array<FrameQueries, ringSize> ring_;
+    size_t frame_;                   // Frames started
+    bool inFrame_;
+    std::vector<size_t> open_;       // Records of the scopes begun and not ended
+    std::unordered_map<std::string, size_t> scopeIndex_;
+    std::vector<Sums> sums_;         // Of the frames collected in the current window
+    std::vector<Timing> timings_;    // Of the last complete window
+    GLuint window_;
+    GLuint windowFrames_;
+    size_t frames_;
+    size_t dropped_;
+};
@@ -0,0 +1,647 @@
+/*
+ * Images in CPU memory, and reading and writing TGA and QOI files.
+ *
+ * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014
+ *          Martin Falk (martin.falk@liu.se) 2021
+ *
+ * This code is in the public domain.
+ */
+#include <cstdio>   // For file I/O
+#include <cstring>  // For memcmp(), memcpy() and memset()
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+
+// pshufb is not part of the x86-64 baseline, so the SSSE3 code is compiled for that target
+// alone and only called after checking the CPU, no -mssse3 is needed
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>  // For _mm_shuffle_epi8() (pshufb)
+#define IMAGE_USE_SSSE3
+#define IMAGE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>     // For __cpuid()
+#include <tmmintrin.h>  // For _mm_shuffle_epi8() (pshufb)
+#define IMAGE_USE_SSSE3
+#define IMAGE_TARGET_SSSE3
+#endif
+
+#include <GL/glew.h>
+
+#include "Image.hpp"
+#include "MappedFile.hpp"
+#include "Trace.hpp"
+
+#ifdef IMAGE_USE_SSSE3
+namespace {
+
+bool cpuHasSSSE3() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// Swap red and blue of whole 16 byte registers, returns the number of bytes done
+IMAGE_TARGET_SSSE3 size_t swizzleRedBlueSSSE3(GLubyte* data, size_t size,
+                                              GLuint bytesPerPixel) {
+    size_t i = 0;
+    if (bytesPerPixel == 4) {
+        // Four pixels per 16 byte register
+        const __m128i mask =
+            _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        for (; i + 16 <= size; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(v, mask));
+        }
+    } else if (bytesPerPixel == 3) {
+        // Five pixels (15 bytes) per 16 byte register, the last byte is passed through
+        const __m128i mask =
+            _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+        for (; i + 16 <= size; i += 15) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(v, mask));
+        }
+    }
+    return i;
+}
+
+}  // namespace
+#endif
+
+/*
+ * Swap the red and blue channels of an image in place, converting BGR(A) to RGB(A) or back.
+ * TGA files store BGR(A) which GL accepts directly, so this is only needed when
+ * the pixels are consumed on the CPU in RGB(A) order.
+ */
+void Image::swizzleRedBlue(GLubyte* data, size_t pixelCount, GLuint bytesPerPixel) {
+    const size_t size = pixelCount * bytesPerPixel;
+    size_t i = 0;
+#ifdef IMAGE_USE_SSSE3
+    static const bool hasSSSE3 = cpuHasSSSE3();
+    if (hasSSSE3) {
+        i = swizzleRedBlueSSSE3(data, size, bytesPerPixel);
+    }
+#endif
+    // Remaining pixels, or all of them without SSSE3
+    for (; i + bytesPerPixel <= size; i += bytesPerPixel) {
+        std::swap(data[i], data[i + 2]);
+    }
+}
+
+/* Convert an image to RGB(A) byte order, if it is not already */
+void Image::convertToRGB(Image& image) {
+    if (image.format == GL_BGR || image.format == GL_BGRA) {
+        const GLuint bytesPerPixel = (image.type == GL_RGBA) ? 4 : 3;
+        swizzleRedBlue(image.data.data(), image.data.size() / bytesPerPixel, bytesPerPixel);
+        image.format = image.type;
+    }
+}
+
+/*
+ * Open and test the file to make sure it is a valid TGA file
+ *
+ * roughly based on NeHe's TGA loading code
+ */
+Image Image::loadUncompressedTGA(const std::string& filename) {
+    std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+
+    if (!in.is_open()) {
+        std::cerr << "Could not open texture file ('" << filename << "')\n";
+        return {};  // return an empty image
+    }
+
+    // Attempt to read 12 byte file header
+    std::array<char, 12> tgaheader;
+
+    in.read(tgaheader.data(), sizeof(tgaheader));
+    if (in.fail()) {
+        std::cerr << "Could not read file header ('" << filename << "')\n";
+        return {};  // return an empty image
+    }
+
+    // headers for compressed and uncompressed TGAs
+    const std::array<char, 12> uncompressedTGA = {{0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    const std::array<char, 12> compressedTGA = {{0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+
+    if (tgaheader == compressedTGA) {
+        return loadCompressedTGA(in, filename);
+    } else if (tgaheader != uncompressedTGA) {
+        std::cerr << "Unsupported image file format ('" << filename << "')\n";
+        return {};
+    }
+
+    std::array<GLubyte, 6> header;  // First 6 useful bytes from the header
+    // std::ifstream::read() only reads 'char', thus we need a type cast for tga.header
+    in.read(reinterpret_cast<char*>(header.data()), sizeof(header));
+    if (in.fail()) {
+        std::cerr << "Could not read TGA header ('" << filename << "')\n";
+        return {};
+    }
+
+    Image image;
+
+    // Determine the TGA width (highbyte*256 + lowbyte)
+    image.width = header[1] * 256 + header[0];
+    // Determine the TGA height	(highbyte*256 + lowbyte)
+    image.height = header[3] * 256 + header[2];
+
+    // Make sure all information is valid
+    if ((image.width <= 0) || (image.height <= 0)) {
+        std::cerr << "Invalid image dimensions ('" << filename << "')\n";
+        return {};
+    }
+
+    // Determine the bits per pixel
+    const GLuint bpp = header[4];
+    // Compute the number of BYTES per pixel
+    const GLuint bytesPerPixel = (bpp / 8);
+    // Compute the total amount of memory needed
+    const GLuint imageSize = (bytesPerPixel * image.width * image.height);
+
+    switch (bpp) {
+        case 24:
+            image.type = GL_RGB;
+            image.format = GL_BGR;
+            std::cout << "Texture type is GL_RGB ('" << filename << "')\n";
+            break;
+        case 32:
+            image.type = GL_RGBA;
+            image.format = GL_BGRA;
+            std::cout << "Texture type is GL_RGBA ('" << filename << "')\n";
+            break;
+        default:
+            std::cerr << "Unsupported number of bits per pixel (" << bpp << ") ('" << filename
+                      << "')\n";
+            return {};
+    }
+
+    image.data.resize(imageSize);  // Allocate memory for image data
+
+    // Attempt to read image data
+    // std::ifstream::read() only reads 'char', thus we need a type cast for tga.header
+    in.read(reinterpret_cast<char*>(image.data.data()), imageSize);
+    if (in.gcount() != imageSize) {
+        std::cerr << "Could not read image data ('" << filename << "')\n";
+        return {};
+    }
+
+    // The pixels are kept in the BGR(A) order of the file, GL takes that order directly.
+    return image;
+}
+
+/*
+ * Decode the RLE packets of a compressed TGA file into an uncompressed pixel array.
+ *
+ * Each packet starts with a one byte header. If the high bit is set, the packet is a run
+ * of (header & 0x7f) + 1 copies of the single pixel that follows. Otherwise it is a raw
+ * packet of (header & 0x7f) + 1 literal pixels. Runs are filled with memset() for gray
+ * pixels and with doubling memcpy() calls otherwise, raw packets are copied as one block.
+ * The pixels keep the BGR(A) byte order of the file.
+ *
+ * Returns the number of pixels decoded, which is less than pixelCount if the data is truncated.
+ */
+size_t Image::decodeRLE(const GLubyte* src, size_t srcSize, GLubyte* dst, size_t pixelCount,
+                          GLuint bytesPerPixel) {
+    const GLubyte* srcEnd = src + srcSize;
+    size_t pixel = 0;
+
+    while (pixel < pixelCount && src < srcEnd) {
+        const GLubyte packet = *src++;
+        // Never write past the end of the image, even for malformed files
+        const size_t count = std::min<size_t>((packet & 0x7f) + 1, pixelCount - pixel);
+        GLubyte* out = dst + pixel * bytesPerPixel;
+
+        if (packet & 0x80) {  // Run-length packet, one pixel repeated count times
+            if (static_cast<size_t>(srcEnd - src) < bytesPerPixel) {
+                break;
+            }
+            std::memcpy(out, src, bytesPerPixel);
+            src += bytesPerPixel;
+
+            const size_t runBytes = count * bytesPerPixel;
+            const bool gray = (out[0] == out[1]) && (out[1] == out[2]) &&
+                              (bytesPerPixel == 3 || out[2] == out[3]);
+            if (gray) {
+                std::memset(out, out[0], runBytes);
+            } else {
+                // Replicate the first pixel by doubling the filled span each step
+                size_t filled = bytesPerPixel;
+                while (filled < runBytes) {
+                    const size_t chunk = std::min(filled, runBytes - filled);
+                    std::memcpy(out + filled, out, chunk);
+                    filled += chunk;
+                }
+            }
+        } else {  // Raw packet, count literal pixels
+            const size_t rawBytes = count * bytesPerPixel;
+            if (static_cast<size_t>(srcEnd - src) < rawBytes) {
+                break;
+            }
+            std::memcpy(out, src, rawBytes);
+            src += rawBytes;
+        }
+        pixel += count;
+    }
+
+    return pixel;
+}
+
+/*
+ * Load the image data of an RLE compressed TGA file, the 12 byte file header
+ * has already been read from the stream by loadUncompressedTGA().
+ */
+Image Image::loadCompressedTGA(std::istream& in, const std::string& filename) {
+    std::array<GLubyte, 6> header;  // First 6 useful bytes from the header
+    in.read(reinterpret_cast<char*>(header.data()), sizeof(header));
+    if (in.fail()) {
+        std::cerr << "Could not read TGA header ('" << filename << "')\n";
+        return {};
+    }
+
+    Image image;
+
+    // Determine the TGA width and height (highbyte*256 + lowbyte)
+    image.width = header[1] * 256 + header[0];
+    image.height = header[3] * 256 + header[2];
+
+    if ((image.width <= 0) || (image.height <= 0)) {
+        std::cerr << "Invalid image dimensions ('" << filename << "')\n";
+        return {};
+    }
+
+    const GLuint bpp = header[4];
+    const GLuint bytesPerPixel = (bpp / 8);
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+
+    switch (bpp) {
+        case 24:
+            image.type = GL_RGB;
+            image.format = GL_BGR;
+            std::cout << "Texture type is GL_RGB, RLE compressed ('" << filename << "')\n";
+            break;
+        case 32:
+            image.type = GL_RGBA;
+            image.format = GL_BGRA;
+            std::cout << "Texture type is GL_RGBA, RLE compressed ('" << filename << "')\n";
+            break;
+        default:
+            std::cerr << "Unsupported number of bits per pixel (" << bpp << ") ('" << filename
+                      << "')\n";
+            return {};
+    }
+
+    // Read the remaining packet data with a single read instead of one read per packet
+    const std::streampos dataStart = in.tellg();
+    in.seekg(0, std::ios_base::end);
+    const std::streamoff dataSize = in.tellg() - dataStart;
+    in.seekg(dataStart);
+
+    std::vector<GLubyte> packets(static_cast<size_t>(std::max<std::streamoff>(dataSize, 0)));
+    in.read(reinterpret_cast<char*>(packets.data()), packets.size());
+    if (in.gcount() != static_cast<std::streamsize>(packets.size())) {
+        std::cerr << "Could not read image data ('" << filename << "')\n";
+        return {};
+    }
+
+    image.data.resize(pixelCount * bytesPerPixel);
+    if (decodeRLE(packets.data(), packets.size(), image.data.data(), pixelCount, bytesPerPixel) !=
+        pixelCount) {
+        std::cerr << "Truncated RLE image data ('" << filename << "')\n";
+        return {};
+    }
+
+    return image;
+}
+
+/*
+ * Parse the 18 byte header of a TGA file held in memory. On success the image dimensions,
+ * type and format are set (but no pixel data), and the offset of the pixel data is returned.
+ * Returns 0 if the header is invalid or unsupported.
+ */
+size_t Image::parseTGAHeader(const GLubyte* file, size_t fileSize, const std::string& filename,
+                               Image& image, bool& compressed) {
+    // headers for compressed and uncompressed TGAs
+    const std::array<GLubyte, 12> uncompressedTGA = {{0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    const std::array<GLubyte, 12> compressedTGA = {{0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    const size_t headerSize = 18;
+
+    if (fileSize < headerSize) {
+        std::cerr << "Could not read TGA header ('" << filename << "')\n";
+        return 0;
+    }
+    if (std::memcmp(file, compressedTGA.data(), compressedTGA.size()) == 0) {
+        compressed = true;
+    } else if (std::memcmp(file, uncompressedTGA.data(), uncompressedTGA.size()) == 0) {
+        compressed = false;
+    } else {
+        std::cerr << "Unsupported image file format ('" << filename << "')\n";
+        return 0;
+    }
+
+    const GLubyte* header = file + 12;
+    image.width = header[1] * 256 + header[0];
+    image.height = header[3] * 256 + header[2];
+    if ((image.width <= 0) || (image.height <= 0)) {
+        std::cerr << "Invalid image dimensions ('" << filename << "')\n";
+        return 0;
+    }
+
+    switch (header[4]) {
+        case 24:
+            image.type = GL_RGB;
+            image.format = GL_BGR;
+            break;
+        case 32:
+            image.type = GL_RGBA;
+            image.format = GL_BGRA;
+            break;
+        default:
+            std::cerr << "Unsupported number of bits per pixel (" << int(header[4]) << ") ('"
+                      << filename << "')\n";
+            return 0;
+    }
+
+    return headerSize;
+}
+
+namespace {
+
+// QOI chunk tags, see https://qoiformat.org/qoi-specification.pdf
+const GLubyte qoiOpIndex = 0x00;  // 00xxxxxx: pixel from the index
+const GLubyte qoiOpDiff = 0x40;   // 01rrggbb: small difference to the previous pixel
+const GLubyte qoiOpLuma = 0x80;   // 10gggggg rrrrbbbb: difference relative to green
+const GLubyte qoiOpRun = 0xc0;    // 11xxxxxx: previous pixel repeated
+const GLubyte qoiOpRGB = 0xfe;
+const GLubyte qoiOpRGBA = 0xff;
+const GLubyte qoiMask = 0xc0;
+const size_t qoiHeaderSize = 14;
+const GLubyte qoiEndMarker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+inline unsigned qoiHash(const GLubyte* px) {
+    return (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+}
+
+// The decoding loop, specialized for the number of channels so the pixel copies are fixed size
+template <GLuint channels>
+size_t decodeQOIPixels(const GLubyte* src, size_t srcSize, GLubyte* dst, size_t pixelCount) {
+    const GLubyte* srcEnd = src + srcSize;
+    GLubyte index[64][4] = {};
+    GLubyte px[4] = {0, 0, 0, 255};
+    size_t pixel = 0;
+
+    while (pixel < pixelCount && src < srcEnd) {
+        const GLubyte op = *src++;
+        size_t run = 1;
+        if (op == qoiOpRGB || op == qoiOpRGBA) {
+            const size_t size = (op == qoiOpRGB) ? 3 : 4;
+            if (static_cast<size_t>(srcEnd - src) < size) {
+                break;
+            }
+            std::memcpy(px, src, size);
+            src += size;
+        } else if ((op & qoiMask) == qoiOpIndex) {
+            std::memcpy(px, index[op], 4);
+        } else if ((op & qoiMask) == qoiOpDiff) {
+            px[0] += ((op >> 4) & 0x03) - 2;
+            px[1] += ((op >> 2) & 0x03) - 2;
+            px[2] += (op & 0x03) - 2;
+        } else if ((op & qoiMask) == qoiOpLuma) {
+            if (src == srcEnd) {
+                break;
+            }
+            const GLubyte next = *src++;
+            const int dg = (op & 0x3f) - 32;
+            px[0] += dg - 8 + ((next >> 4) & 0x0f);
+            px[1] += dg;
+            px[2] += dg - 8 + (next & 0x0f);
+        } else {
+            // Never write past the end of the image, even for malformed files
+            run = std::min<size_t>((op & 0x3f) + 1, pixelCount - pixel);
+        }
+        std::memcpy(index[qoiHash(px)], px, 4);
+
+        GLubyte* out = dst + pixel * channels;
+        for (size_t i = 0; i < run; i++) {
+            std::memcpy(out, px, channels);
+            out += channels;
+        }
+        pixel += run;
+    }
+    return pixel;
+}
+
+void writeBigEndian(GLubyte* dst, std::uint32_t value) {
+    dst[0] = static_cast<GLubyte>(value >> 24);
+    dst[1] = static_cast<GLubyte>(value >> 16);
+    dst[2] = static_cast<GLubyte>(value >> 8);
+    dst[3] = static_cast<GLubyte>(value);
+}
+
+std::uint32_t readBigEndian(const GLubyte* src) {
+    return (std::uint32_t(src[0]) << 24) | (std::uint32_t(src[1]) << 16) |
+           (std::uint32_t(src[2]) << 8) | std::uint32_t(src[3]);
+}
+
+}  // namespace
+
+/*
+ * Parse the 14 byte header of a QOI file held in memory: "qoif", the width and height as
+ * big endian 32 bit values, the number of channels (3 or 4) and the color space.
+ * Returns the offset of the pixel data, or 0 if the header is invalid or unsupported.
+ */
+size_t Image::parseQOIHeader(const GLubyte* file, size_t fileSize, const std::string& filename,
+                               Image& image) {
+    if (fileSize < qoiHeaderSize + sizeof(qoiEndMarker) || std::memcmp(file, "qoif", 4) != 0) {
+        std::cerr << "Invalid QOI file ('" << filename << "')\n";
+        return 0;
+    }
+    image.width = readBigEndian(file + 4);
+    image.height = readBigEndian(file + 8);
+    // The QOI specification limits images to 400 million pixels
+    if (image.width == 0 || image.height == 0 ||
+        static_cast<size_t>(image.width) * image.height > 400000000) {
+        std::cerr << "Invalid image dimensions ('" << filename << "')\n";
+        return 0;
+    }
+
+    switch (file[12]) {
+        case 3:
+            image.type = GL_RGB;
+            image.format = GL_RGB;
+            break;
+        case 4:
+            image.type = GL_RGBA;
+            image.format = GL_RGBA;
+            break;
+        default:
+            std::cerr << "Unsupported number of QOI channels (" << int(file[12]) << ") ('"
+                      << filename << "')\n";
+            return 0;
+    }
+
+    return qoiHeaderSize;
+}
+
+/*
+ * Decode QOI chunks into an uncompressed pixel array in RGB(A) byte order. Each chunk is
+ * a new pixel, a small difference to the previous pixel, a pixel from a 64 entry index of
+ * recently seen pixels, or a run of the previous pixel.
+ *
+ * Returns the number of pixels decoded, which is less than pixelCount if the data is truncated.
+ */
+size_t Image::decodeQOI(const GLubyte* src, size_t srcSize, GLubyte* dst, size_t pixelCount,
+                          GLuint channels) {
+    return (channels == 4) ? decodeQOIPixels<4>(src, srcSize, dst, pixelCount)
+                           : decodeQOIPixels<3>(src, srcSize, dst, pixelCount);
+}
+
+/* Load a QOI file, it is memory mapped and decoded straight into the image */
+Image Image::loadQOI(const std::string& filename) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cerr << "Could not open texture file ('" << filename << "')\n";
+        return {};
+    }
+
+    Image image;
+    const size_t dataOffset = parseQOIHeader(file.data(), file.size(), filename, image);
+    if (dataOffset == 0) {
+        return {};
+    }
+    std::cout << "Texture type is " << (image.type == GL_RGBA ? "GL_RGBA" : "GL_RGB")
+              << ", QOI compressed ('" << filename << "')\n";
+
+    const GLuint channels = (image.type == GL_RGBA) ? 4 : 3;
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    image.data.resize(pixelCount * channels);
+    if (decodeQOI(file.data() + dataOffset, file.size() - dataOffset, image.data.data(),
+                  pixelCount, channels) != pixelCount) {
+        std::cerr << "Truncated QOI image data ('" << filename << "')\n";
+        return {};
+    }
+    return image;
+}
+
+/*
+ * Encode an image as a QOI file in memory. The channels are stored in RGB(A) order, so
+ * BGR(A) pixels from TGA files are swizzled while encoding.
+ */
+std::vector<GLubyte> Image::encodeQOI(const Image& image) {
+    const GLuint channels = (image.type == GL_RGBA) ? 4 : 3;
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    if (pixelCount == 0 || image.data.size() < pixelCount * channels) {
+        return {};
+    }
+    const bool bgr = (image.format == GL_BGR || image.format == GL_BGRA);
+
+    // At most one tag byte more than the raw pixel per pixel
+    std::vector<GLubyte> out(qoiHeaderSize + pixelCount * (channels + 1) + sizeof(qoiEndMarker));
+    GLubyte* dst = out.data();
+    std::memcpy(dst, "qoif", 4);
+    writeBigEndian(dst + 4, image.width);
+    writeBigEndian(dst + 8, image.height);
+    dst[12] = static_cast<GLubyte>(channels);
+    dst[13] = 0;  // sRGB color with linear alpha
+    dst += qoiHeaderSize;
+
+    GLubyte index[64][4] = {};
+    GLubyte prev[4] = {0, 0, 0, 255};
+    GLubyte px[4] = {0, 0, 0, 255};
+    size_t run = 0;
+    const GLubyte* src = image.data.data();
+    for (size_t pixel = 0; pixel < pixelCount; pixel++, src += channels) {
+        px[0] = src[bgr ? 2 : 0];
+        px[1] = src[1];
+        px[2] = src[bgr ? 0 : 2];
+        if (channels == 4) {
+            px[3] = src[3];
+        }
+
+        if (std::memcmp(px, prev, 4) == 0) {
+            run++;
+            if (run == 62 || pixel + 1 == pixelCount) {
+                *dst++ = qoiOpRun | static_cast<GLubyte>(run - 1);
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0) {
+            *dst++ = qoiOpRun | static_cast<GLubyte>(run - 1);
+            run = 0;
+        }
+
+        const unsigned hash = qoiHash(px);
+        if (std::memcmp(index[hash], px, 4) == 0) {
+            *dst++ = qoiOpIndex | static_cast<GLubyte>(hash);
+        } else {
+            std::memcpy(index[hash], px, 4);
+            if (px[3] == prev[3]) {
+                // Differences wrap around, as in the decoder
+                const int dr = static_cast<signed char>(px[0] - prev[0]);
+                const int dg = static_cast<signed char>(px[1] - prev[1]);
+                const int db = static_cast<signed char>(px[2] - prev[2]);
+                const int drg = dr - dg;
+                const int dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    *dst++ = qoiOpDiff | static_cast<GLubyte>(((dr + 2) << 4) | ((dg + 2) << 2) |
+                                                              (db + 2));
+                } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 &&
+                           dbg <= 7) {
+                    *dst++ = qoiOpLuma | static_cast<GLubyte>(dg + 32);
+                    *dst++ = static_cast<GLubyte>(((drg + 8) << 4) | (dbg + 8));
+                } else {
+                    *dst++ = qoiOpRGB;
+                    std::memcpy(dst, px, 3);
+                    dst += 3;
+                }
+            } else {
+                *dst++ = qoiOpRGBA;
+                std::memcpy(dst, px, 4);
+                dst += 4;
+            }
+        }
+        std::memcpy(prev, px, 4);
+    }
+
+    std::memcpy(dst, qoiEndMarker, sizeof(qoiEndMarker));
+    dst += sizeof(qoiEndMarker);
+    out.resize(dst - out.data());
+    return out;
+}
+
+bool Image::writeQOI(const std::string& filename, const Image& image) {
+    const std::vector<GLubyte> encoded = encodeQOI(image);
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    if (encoded.empty() || !out.is_open()) {
+        std::cerr << "Could not write QOI file ('" << filename << "')\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    if (out.fail()) {
+        std::cerr << "Could not write QOI file ('" << filename << "')\n";
+        return false;
+    }
+    return true;
+}
+
+
+// Case insensitive check of a file name extension
+bool Image::hasExtension(const std::string& filename, const std::string& extension) {
+    if (filename.size() < extension.size()) {
+        return false;
+    }
+    return std::equal(extension.begin(), extension.end(), filename.end() - extension.size(),
+                      [](char a, char b) { return std::tolower(a) == std::tolower(b); });
+}
+
+/* Load a TGA or QOI file, chosen by the file name extension */
+Image Image::load(const std::string& filename) {
+    TRACE_ZONE("Image::load");
+    return hasExtension(filename, ".qoi") ? loadQOI(filename) : loadUncompressedTGA(filename);
+}
@@ -0,0 +1,76 @@
+/*
+ * An image in CPU memory, and reading and writing TGA and QOI files.
+ *
+ * Usage: Call load() with a TGA or QOI file, chosen by the file name extension, or
+ *        loadUncompressedTGA() or loadQOI() directly. TGA files can be uncompressed or RLE
+ *        compressed, RGB or RGBA only. TGA pixels are kept in their BGR(A) byte order, which
+ *        GL accepts directly, and convertToRGB() swaps them for use on the CPU. writeQOI()
+ *        saves an image as a lossless QOI ("Quite OK Image") file. parseTGAHeader(),
+ *        decodeRLE(), parseQOIHeader() and decodeQOI() work on files in memory, so a mapped
+ *        file can be decoded straight into a pixel unpack buffer. Nothing here needs a GL
+ *        context, and everything is safe to call from any thread.
+ *
+ * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014
+ *          Martin Falk (martin.falk@liu.se) 2021
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <istream>
+#include <string>
+#include <vector>
+
+class Image {
+public:
+    GLuint width = 0;           // Image width
+    GLuint height = 0;          // Image height
+    GLuint type = 0;            // Image type (3 bytes per pixel: GL_RGB, 4 bytes: GL_RGBA)
+    GLuint format = 0;          // Byte order of data (GL_BGR(A) from TGA, or GL_RGB(A))
+    std::vector<GLubyte> data;  // Image data (3 or 4 bytes per pixel)
+
+    // Swap red and blue in place (BGR(A) <-> RGB(A)), uses SSSE3 if the CPU has it
+    static void swizzleRedBlue(GLubyte* data, size_t pixelCount, GLuint bytesPerPixel);
+
+    // Convert image data to RGB(A) byte order for use on the CPU
+    static void convertToRGB(Image& image);
+
+    // Load data from an uncompressed or RLE compressed TGA file
+    static Image loadUncompressedTGA(const std::string& filename);
+
+    // Load data from a QOI file, in RGB(A) byte order
+    static Image loadQOI(const std::string& filename);
+
+    // Load a TGA or QOI file, chosen by the file name extension
+    static Image load(const std::string& filename);
+
+    // Encode an image in QOI format, the pixels can be in BGR(A) or RGB(A) byte order
+    static std::vector<GLubyte> encodeQOI(const Image& image);
+
+    // Write an image to a QOI file, returns false on failure
+    static bool writeQOI(const std::string& filename, const Image& image);
+
+    // Parse a TGA header in memory, returns the offset of the pixel data or 0 on failure
+    static size_t parseTGAHeader(const GLubyte* file, size_t fileSize, const std::string& filename,
+                                 Image& image, bool& compressed);
+
+    // Decode RLE packets into pixels, returns the number of pixels decoded
+    static size_t decodeRLE(const GLubyte* src, size_t srcSize, GLubyte* dst, size_t pixelCount,
+                            GLuint bytesPerPixel);
+
+    // Parse a QOI header in memory, returns the offset of the pixel data or 0 on failure
+    static size_t parseQOIHeader(const GLubyte* file, size_t fileSize, const std::string& filename,
+                                 Image& image);
+
+    // Decode QOI chunks into RGB(A) pixels, returns the number of pixels decoded
+    static size_t decodeQOI(const GLubyte* src, size_t srcSize, GLubyte* dst, size_t pixelCount,
+                            GLuint channels);
+
+    // Case insensitive check of a file name extension, such as ".qoi"
+    static bool hasExtension(const std::string& filename, const std::string& extension);
+
+private:
+    // Load data from an RLE compressed TGA file, called by loadUncompressedTGA()
+    static Image loadCompressedTGA(std::istream& in, const std::string& filename);
+};
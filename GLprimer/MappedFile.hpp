@@ -0,0 +1,52 @@
+/*
+ * A class to map a file read-only into memory.
+ *
+ * Usage: Call open() with a file name, or use the constructor with a file name argument.
+ *        The contents are available through data() and size() until the object is
+ *        destroyed or close() is called. The pages are read from disk on demand by the OS,
+ *        so no copy of the file is kept in process memory.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile();
+
+    /* Constructor to open and map a file in one go */
+    explicit MappedFile(const std::string& filename);
+
+    /* Destructor, unmaps the file */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map the file, returns false if it could not be opened or mapped
+    bool open(const std::string& filename);
+
+    // Unmap the file and release the file handle
+    void close();
+
+    bool isOpen() const;
+
+    // Start of the mapped file contents (nullptr if not open)
+    const unsigned char* data() const;
+
+    // Size of the file in bytes
+    size_t size() const;
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* file_;     // HANDLE from CreateFile()
+    void* mapping_;  // HANDLE from CreateFileMapping()
+#endif
+};
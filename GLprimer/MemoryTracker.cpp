@@ -0,0 +1,145 @@
+/*
+ * Counts the CPU and GPU memory held by the meshes, textures and buffers, by category.
+ *
+ * This code is in the public domain.
+ */
+#include "MemoryTracker.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <ostream>
+
+namespace {
+
+struct Counter {
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<size_t> allocations{0};
+};
+
+// One counter per category, followed by the CPU and the GPU totals
+const size_t cpuTotal = MemoryTracker::categoryCount;
+const size_t gpuTotal = MemoryTracker::categoryCount + 1;
+Counter counters[MemoryTracker::categoryCount + 2];
+
+void raisePeak(Counter& counter, size_t bytes) {
+    size_t peak = counter.peak.load(std::memory_order_relaxed);
+    while (bytes > peak &&
+           !counter.peak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+}
+
+void change(Counter& counter, size_t oldBytes, size_t newBytes) {
+    if (newBytes >= oldBytes) {
+        const size_t delta = newBytes - oldBytes;
+        raisePeak(counter, counter.bytes.fetch_add(delta, std::memory_order_relaxed) + delta);
+    } else {
+        counter.bytes.fetch_sub(oldBytes - newBytes, std::memory_order_relaxed);
+    }
+    if (oldBytes == 0 && newBytes > 0) {
+        counter.allocations.fetch_add(1, std::memory_order_relaxed);
+    } else if (oldBytes > 0 && newBytes == 0) {
+        counter.allocations.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+MemoryTracker::Usage read(const Counter& counter) {
+    MemoryTracker::Usage usage;
+    usage.bytes = counter.bytes.load(std::memory_order_relaxed);
+    usage.peak = counter.peak.load(std::memory_order_relaxed);
+    usage.allocations = counter.allocations.load(std::memory_order_relaxed);
+    return usage;
+}
+
+double megabytes(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+}  // namespace
+
+MemoryTracker::Allocation::Allocation(Category category, size_t bytes)
+    : category_(category), bytes_(bytes) {
+    track(category_, 0, bytes_);
+}
+
+MemoryTracker::Allocation::~Allocation() { track(category_, bytes_, 0); }
+
+void MemoryTracker::Allocation::resize(size_t bytes) {
+    track(category_, bytes_, bytes);
+    bytes_ = bytes;
+}
+
+void MemoryTracker::track(Category category, size_t oldBytes, size_t newBytes) {
+    if (oldBytes == newBytes) {
+        return;
+    }
+    change(counters[category], oldBytes, newBytes);
+    change(counters[isGPU(category) ? gpuTotal : cpuTotal], oldBytes, newBytes);
+}
+
+MemoryTracker::Usage MemoryTracker::usage(Category category) {
+    return read(counters[category]);
+}
+
+MemoryTracker::Usage MemoryTracker::cpu() { return read(counters[cpuTotal]); }
+
+MemoryTracker::Usage MemoryTracker::gpu() { return read(counters[gpuTotal]); }
+
+bool MemoryTracker::isGPU(Category category) {
+    return category != MeshArrays && category != DecodedImages && category != BVHs;
+}
+
+const char* MemoryTracker::name(Category category) {
+    switch (category) {
+        case MeshArrays:
+            return "mesh arrays";
+        case DecodedImages:
+            return "decoded images";
+        case BVHs:
+            return "BVHs";
+        case MeshBuffers:
+            return "mesh buffers";
+        case Textures:
+            return "textures";
+        case StagingBuffers:
+            return "staging buffers";
+        case OtherBuffers:
+            return "other buffers";
+        default:
+            return "unknown";
+    }
+}
+
+void MemoryTracker::resetPeaks() {
+    for (Counter& counter : counters) {
+        counter.peak.store(counter.bytes.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+    }
+}
+
+void MemoryTracker::dump(std::ostream& out) {
+    char line[100];
+    snprintf(line, sizeof(line), "%-20s %12s %12s %8s\n", "Memory", "MB", "peak MB", "count");
+    out << line;
+    for (int i = 0; i < categoryCount; i++) {
+        const Category category = static_cast<Category>(i);
+        const Usage use = usage(category);
+        snprintf(line, sizeof(line), "%-4s %-15s %12.2f %12.2f %8zu\n",
+                 isGPU(category) ? "GPU" : "CPU", name(category), megabytes(use.bytes),
+                 megabytes(use.peak), use.allocations);
+        out << line;
+    }
+    const Usage cpuUse = cpu();
+    const Usage gpuUse = gpu();
+    snprintf(line, sizeof(line), "%-20s %12.2f %12.2f %8zu\n", "CPU total",
+             megabytes(cpuUse.bytes), megabytes(cpuUse.peak), cpuUse.allocations);
+    out << line;
+    snprintf(line, sizeof(line), "%-20s %12.2f %12.2f %8zu\n", "GPU total",
+             megabytes(gpuUse.bytes), megabytes(gpuUse.peak), gpuUse.allocations);
+    out << line;
+}
+
+std::string MemoryTracker::summary() {
+    char text[100];
+    snprintf(text, sizeof(text), "CPU %.1f MB, GPU %.1f MB", megabytes(cpu().bytes),
+             megabytes(gpu().bytes));
+    return text;
+}
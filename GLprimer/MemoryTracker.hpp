@@ -0,0 +1,74 @@
+/*
+ * Counts the CPU and GPU memory held by the meshes, textures and buffers, by category.
+ *
+ * Usage: The classes that allocate memory call track() with the old and the new size of
+ *        each allocation, as they allocate, resize and free it. usage() returns the bytes
+ *        held now and at the peak for a category, and cpu() and gpu() the sums over the
+ *        categories of each side. An Allocation counts the bytes of an allocation until it
+ *        is destroyed, for local buffers and members. Call resetPeaks() before loading a
+ *        scene and dump() after it to see where the memory goes, including the transient
+ *        peak while loading.
+ *        The counters are atomic, track() can be called from any thread.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <iosfwd>
+#include <string>
+
+class MemoryTracker {
+public:
+    enum Category {
+        MeshArrays,      // CPU copies of the vertex and index arrays of TriangleSoup
+        DecodedImages,   // CPU images decoded for textures and not uploaded yet
+        BVHs,            // Nodes and triangles of the BVHs for ray queries
+        MeshBuffers,     // GL vertex and index buffers
+        Textures,        // GL texture storage, including all mip levels
+        StagingBuffers,  // GL pixel buffers and render targets for uploads and readbacks
+        OtherBuffers,    // Other GL buffers, such as uniform buffers
+        categoryCount
+    };
+
+    // Counts bytes of a category for its lifetime
+    class Allocation {
+    public:
+        explicit Allocation(Category category, size_t bytes = 0);
+        ~Allocation();
+
+        Allocation(const Allocation&) = delete;
+        Allocation& operator=(const Allocation&) = delete;
+
+        void resize(size_t bytes);
+
+    private:
+        Category category_;
+        size_t bytes_;
+    };
+
+    struct Usage {
+        size_t bytes = 0;        // Held now
+        size_t peak = 0;         // Most bytes held since the last resetPeaks()
+        size_t allocations = 0;  // Allocations held now
+    };
+
+    // Record that an allocation of a category changed from oldBytes to newBytes. Pass 0 as
+    // oldBytes for a new allocation and 0 as newBytes when it is freed.
+    static void track(Category category, size_t oldBytes, size_t newBytes);
+
+    static Usage usage(Category category);
+    static Usage cpu();
+    static Usage gpu();
+
+    static bool isGPU(Category category);
+    static const char* name(Category category);
+
+    // Start measuring the peaks from the current use
+    static void resetPeaks();
+
+    // Print a table of the current and peak use per category
+    static void dump(std::ostream& out);
+
+    // Totals as "CPU 1.2 MB, GPU 45.6 MB"
+    static std::string summary();
+};
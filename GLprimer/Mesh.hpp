@@ -0,0 +1,80 @@
+/*
+ * A triangle mesh in CPU memory: an interleaved vertex array and an index array.
+ *
+ * Usage: The methods createXXX() create geometry from fixed arrays or procedural
+ *        descriptions, readOBJ() loads it from an OBJ file. Only triangles are supported,
+ *        material information is ignored. vertices() has 8 floats per vertex, x y z nx ny nz
+ *        s t, and indices() 3 vertex numbers per triangle. bounds() is the axis-aligned box
+ *        around the vertices. A Mesh makes no GL calls, so tools without a GL context such
+ *        as the SoftwareRasterizer and the BVH can use it directly. TriangleSoup uploads one
+ *        for rendering.
+ *
+ * Authors: Stefan Gustavson (stegu@itn.liu.se) 2013-2014
+ *          Martin Falk (martin.falk@liu.se) 2021
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <array>
+#include <string>
+#include <vector>
+
+class Mesh {
+public:
+    struct Bounds {
+        std::array<GLfloat, 3> min = {{0.0f, 0.0f, 0.0f}};
+        std::array<GLfloat, 3> max = {{0.0f, 0.0f, 0.0f}};
+    };
+
+    /* Constructor: an empty mesh */
+    Mesh();
+
+    /* Free the arrays and make the mesh empty */
+    void clear();
+
+    /* Create a very simple demo mesh with a single triangle */
+    void createTriangle();
+
+    /* Create a simple box geometry */
+    void createBox(float xsize, float ysize, float zsize);
+
+    /* Create a sphere (approximated by polygon segments) */
+    void createSphere(float radius, int segments);
+
+    /* Load geometry from an OBJ file, the mesh is left empty if it cannot be read */
+    bool readOBJ(const std::string& filename);
+
+    /* Print the vertex and index data, for debugging purposes */
+    void print() const;
+
+    /* Print the number of vertices and triangles and the extents */
+    void printInfo() const;
+
+    int vertexCount() const;
+    int triangleCount() const;
+    bool empty() const;
+
+    /* The interleaved vertex array, 8 floats per vertex: x y z nx ny nz s t */
+    const std::vector<GLfloat>& vertices() const;
+
+    /* The index array, 3 vertex numbers per triangle */
+    const std::vector<GLuint>& indices() const;
+
+    /* Return the extents of the mesh in model coordinates */
+    Bounds bounds() const;
+
+    /* Return the bytes allocated by the arrays */
+    size_t sizeInBytes() const;
+
+private:
+    /* Set bounds_ from the vertex array */
+    void computeBounds();
+
+    int nverts_;                        // Number of vertices in the vertex array
+    int ntris_;                         // Number of triangles in the index array (may be zero)
+    std::vector<GLfloat> vertexarray_;  // Vertex array on interleaved format: x y z nx ny nz s t
+    std::vector<GLuint> indexarray_;    // Element index array
+    Bounds bounds_;                     // Extents of the vertex coordinates
+};
@@ -0,0 +1,458 @@
+/*
+ * CPU generation and caching of texture mipmap chains.
+ *
+ * This code is in the public domain.
+ */
+#if defined(WIN32) && !defined(_USE_MATH_DEFINES)
+#define _USE_MATH_DEFINES
+#endif
+
+#include <GL/glew.h>
+
+#include "MipChain.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPCHAIN_USE_SSE2
+#endif
+
+namespace {
+
+// Cache file layout: this header followed by the levels, largest first, tightly packed
+struct CacheHeader {
+    char magic[8];
+    std::uint64_t sourceStamp;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t type;
+    std::uint32_t format;
+    std::uint32_t filter;
+    std::uint32_t levelCount;
+};
+const char cacheMagic[8] = {'T', 'N', 'M', 'M', 'I', 'P', 'S', '1'};
+
+// The workers of the filter passes, kept for all levels and images instead of being started
+// for every pass. Callers such as the TextureStreamer workers take turns on the mutex, so
+// there are never more filter threads than one pool, however many images are in flight.
+struct SharedPool {
+    std::mutex mutex;
+    std::unique_ptr<ThreadPool> pool;
+    unsigned numThreads = 0;
+};
+
+SharedPool& sharedPool() {
+    static SharedPool instance;
+    return instance;
+}
+
+// Run func(begin, end) over [0, count) split in bands, on the shared pool if worthwhile
+template <typename Func>
+void parallelRows(GLuint count, size_t bytesPerRow, unsigned numThreads, Func func) {
+    const unsigned poolSize =
+        numThreads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : numThreads;
+    // Handing out bands costs more than filtering a small image
+    const size_t minBytesPerBand = 256 * 1024;
+    const size_t total = static_cast<size_t>(count) * bytesPerRow;
+    const GLuint bands = static_cast<GLuint>(
+        std::min<size_t>({poolSize, count, std::max<size_t>(1, total / minBytesPerBand)}));
+
+    if (bands <= 1) {
+        func(0u, count);
+        return;
+    }
+
+    SharedPool& shared = sharedPool();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (!shared.pool || shared.numThreads != numThreads) {
+        shared.pool.reset();  // Join the old workers before starting the new ones
+        shared.pool.reset(new ThreadPool(numThreads));
+        shared.numThreads = numThreads;
+    }
+    ThreadPool& pool = *shared.pool;
+    for (GLuint t = 0; t < bands; t++) {
+        const GLuint begin = static_cast<GLuint>(static_cast<size_t>(count) * t / bands);
+        const GLuint end = static_cast<GLuint>(static_cast<size_t>(count) * (t + 1) / bands);
+        pool.enqueue([&func, begin, end] { func(begin, end); });
+    }
+    pool.wait();
+}
+
+/*
+ * Average 2x2 blocks of pixels. For odd sizes the last row or column is not included,
+ * except for a size of 1 which is kept. The SSE2 path handles two RGBA pixels per step.
+ */
+void boxDownsample(const GLubyte* src, GLuint srcWidth, GLuint srcHeight, GLubyte* dst,
+                   GLuint dstWidth, GLuint dstHeight, GLuint bpp, unsigned numThreads) {
+    parallelRows(dstHeight, static_cast<size_t>(dstWidth) * bpp * 4, numThreads,
+                 [=](GLuint begin, GLuint end) {
+        for (GLuint y = begin; y < end; y++) {
+            const GLubyte* row0 = src + static_cast<size_t>(std::min(2 * y, srcHeight - 1)) *
+                                            srcWidth * bpp;
+            const GLubyte* row1 = src + static_cast<size_t>(std::min(2 * y + 1, srcHeight - 1)) *
+                                            srcWidth * bpp;
+            GLubyte* out = dst + static_cast<size_t>(y) * dstWidth * bpp;
+            GLuint x = 0;
+#ifdef MIPCHAIN_USE_SSE2
+            if (bpp == 4 && srcWidth >= 2) {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i two = _mm_set1_epi16(2);
+                // Four source pixels per row make two output pixels
+                for (; x + 2 <= dstWidth && 2 * x + 4 <= srcWidth; x += 2) {
+                    const __m128i a =
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+                    const __m128i b =
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+                    // Vertical sums as 16 bit lanes: lo = pixels 0 and 1, hi = pixels 2 and 3
+                    const __m128i lo =
+                        _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    const __m128i hi =
+                        _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                    // Horizontal sums of neighbouring pixels
+                    const __m128i sumLo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                    const __m128i sumHi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                    __m128i sum = _mm_unpacklo_epi64(sumLo, sumHi);
+                    sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);  // Rounded average
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 4 * x),
+                                     _mm_packus_epi16(sum, zero));
+                }
+            }
+#endif
+            for (; x < dstWidth; x++) {
+                const GLuint x0 = std::min(2 * x, srcWidth - 1) * bpp;
+                const GLuint x1 = std::min(2 * x + 1, srcWidth - 1) * bpp;
+                for (GLuint c = 0; c < bpp; c++) {
+                    out[x * bpp + c] = static_cast<GLubyte>(
+                        (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+    });
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 25; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser windowed sinc, x in units of destination pixels
+double kaiserSinc(double x) {
+    const double radius = 3.0;
+    const double alpha = 4.0;
+    if (std::abs(x) >= radius) {
+        return 0.0;
+    }
+    const double sinc = (x == 0.0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+    const double r = x / radius;
+    return sinc * besselI0(alpha * std::sqrt(1.0 - r * r)) / besselI0(alpha);
+}
+
+struct Taps {
+    int first;                   // First source index (may be outside the image, clamped on use)
+    std::vector<float> weights;  // Normalized weights for source pixels first, first+1, ...
+};
+
+// Filter taps mapping srcSize pixels to dstSize pixels along one axis
+std::vector<Taps> computeTaps(GLuint srcSize, GLuint dstSize, MipChain::Filter filter) {
+    std::vector<Taps> taps(dstSize);
+    const double scale = static_cast<double>(srcSize) / dstSize;
+    // When minifying, stretch the filter to cover the source pixels of each output pixel
+    const double support = std::max(scale, 1.0);
+
+    for (GLuint i = 0; i < dstSize; i++) {
+        const double center = (i + 0.5) * scale;  // In continuous source coordinates
+        const double radius = (filter == MipChain::Filter::Box) ? 0.5 * support : 3.0 * support;
+        const int first = static_cast<int>(std::floor(center - radius));
+        const int last = static_cast<int>(std::ceil(center + radius));
+
+        Taps& t = taps[i];
+        t.first = first;
+        double total = 0.0;
+        for (int s = first; s <= last; s++) {
+            const double d = (s + 0.5 - center) / support;
+            double w;
+            if (filter == MipChain::Filter::Box) {
+                w = (std::abs(d) <= 0.5) ? 1.0 : 0.0;
+            } else {
+                w = kaiserSinc(d);
+            }
+            t.weights.push_back(static_cast<float>(w));
+            total += w;
+        }
+        if (total <= 0.0) {  // Can only happen for a box filter narrower than a pixel
+            t.first = static_cast<int>(center);
+            t.weights.assign(1, 1.0f);
+            total = 1.0;
+        }
+        for (float& w : t.weights) {
+            w = static_cast<float>(w / total);
+        }
+    }
+    return taps;
+}
+
+}  // namespace
+
+MipChain::MipChain() : type_(0), format_(0), filter_(Filter::Box) {}
+
+/*
+ * Separable resampling: a horizontal pass into a float buffer, then a vertical pass
+ * into the destination. Both passes are split in row bands across threads.
+ */
+void MipChain::resample(const GLubyte* src, GLuint srcWidth, GLuint srcHeight, GLubyte* dst,
+                        GLuint dstWidth, GLuint dstHeight, GLuint bytesPerPixel, Filter filter,
+                        unsigned numThreads) {
+    const std::vector<Taps> xTaps = computeTaps(srcWidth, dstWidth, filter);
+    const std::vector<Taps> yTaps = computeTaps(srcHeight, dstHeight, filter);
+    const GLuint bpp = bytesPerPixel;
+    std::vector<float> tmp(static_cast<size_t>(dstWidth) * srcHeight * bpp);
+
+    parallelRows(srcHeight, static_cast<size_t>(srcWidth) * bpp, numThreads,
+                 [&](GLuint begin, GLuint end) {
+        for (GLuint y = begin; y < end; y++) {
+            const GLubyte* in = src + static_cast<size_t>(y) * srcWidth * bpp;
+            float* out = tmp.data() + static_cast<size_t>(y) * dstWidth * bpp;
+            for (GLuint x = 0; x < dstWidth; x++) {
+                const Taps& t = xTaps[x];
+#ifdef MIPCHAIN_USE_SSE2
+                if (bpp == 4) {
+                    // All four channels in one register, one multiply-add per tap
+                    const __m128i zero = _mm_setzero_si128();
+                    __m128 sum = _mm_setzero_ps();
+                    for (size_t k = 0; k < t.weights.size(); k++) {
+                        const int s = std::clamp(t.first + static_cast<int>(k), 0,
+                                                 static_cast<int>(srcWidth) - 1);
+                        std::int32_t packed;
+                        std::memcpy(&packed, in + 4 * s, 4);
+                        const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+                        const __m128 pixel = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(t.weights[k]), pixel));
+                    }
+                    _mm_storeu_ps(out + 4 * x, sum);
+                    continue;
+                }
+#endif
+                std::array<float, 4> acc = {0.0f, 0.0f, 0.0f, 0.0f};
+                for (size_t k = 0; k < t.weights.size(); k++) {
+                    const int s = std::clamp(t.first + static_cast<int>(k), 0,
+                                             static_cast<int>(srcWidth) - 1);
+                    for (GLuint c = 0; c < bpp; c++) {
+                        acc[c] += t.weights[k] * in[s * bpp + c];
+                    }
+                }
+                for (GLuint c = 0; c < bpp; c++) {
+                    out[x * bpp + c] = acc[c];
+                }
+            }
+        }
+    });
+
+    const size_t rowLength = static_cast<size_t>(dstWidth) * bpp;
+    parallelRows(dstHeight, rowLength * sizeof(float), numThreads, [&](GLuint begin, GLuint end) {
+        std::vector<float> acc(rowLength);
+        for (GLuint y = begin; y < end; y++) {
+            const Taps& t = yTaps[y];
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (size_t k = 0; k < t.weights.size(); k++) {
+                const int s = std::clamp(t.first + static_cast<int>(k), 0,
+                                         static_cast<int>(srcHeight) - 1);
+                const float* in = tmp.data() + s * rowLength;
+                const float w = t.weights[k];
+                for (size_t i = 0; i < rowLength; i++) {  // Contiguous, auto-vectorized
+                    acc[i] += w * in[i];
+                }
+            }
+            GLubyte* out = dst + y * rowLength;
+            for (size_t i = 0; i < rowLength; i++) {
+                out[i] = static_cast<GLubyte>(std::clamp(acc[i] + 0.5f, 0.0f, 255.0f));
+            }
+        }
+    });
+}
+
+void MipChain::generate(const GLubyte* pixels, GLuint width, GLuint height, GLuint type,
+                        GLuint format, Filter filter, unsigned numThreads) {
+    cache_.close();
+    levels_.clear();
+    storage_.clear();
+    type_ = type;
+    format_ = format;
+    filter_ = filter;
+
+    const GLuint bpp = (type == GL_RGBA) ? 4 : 3;
+    const size_t baseSize = static_cast<size_t>(width) * height * bpp;
+    storage_.emplace_back(pixels, pixels + baseSize);
+    levels_.push_back({width, height, nullptr, baseSize});
+
+    while (width > 1 || height > 1) {
+        const GLuint w = std::max(width / 2, 1u);
+        const GLuint h = std::max(height / 2, 1u);
+        std::vector<GLubyte> next(static_cast<size_t>(w) * h * bpp);
+
+        const GLubyte* prev = storage_.back().data();
+        if (filter == Filter::Box) {
+            boxDownsample(prev, width, height, next.data(), w, h, bpp, numThreads);
+        } else {
+            // Each level is filtered from the previous one, the wide Kaiser kernel
+            // keeps the accumulated blur low
+            resample(prev, width, height, next.data(), w, h, bpp, filter, numThreads);
+        }
+
+        storage_.push_back(std::move(next));
+        levels_.push_back({w, h, nullptr, storage_.back().size()});
+        width = w;
+        height = h;
+    }
+
+    // Set the pointers last, storage_ may have reallocated while growing
+    for (size_t i = 0; i < levels_.size(); i++) {
+        levels_[i].data = storage_[i].data();
+    }
+}
+
+bool MipChain::writeCache(const std::string& cacheFile, std::uint64_t sourceStamp) const {
+    if (levels_.empty()) {
+        return false;
+    }
+
+    // Write to a temporary file and rename it, so that a partial file is never read.
+    // The name is unique per thread, as several threads may build the same chain.
+    const size_t threadHash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    const std::string tmpFile = cacheFile + ".tmp" + std::to_string(threadHash);
+    {
+        std::ofstream out(tmpFile, std::ios_base::out | std::ios_base::binary);
+        if (!out.is_open()) {
+            return false;
+        }
+
+        CacheHeader header;
+        std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+        header.sourceStamp = sourceStamp;
+        header.width = levels_[0].width;
+        header.height = levels_[0].height;
+        header.type = type_;
+        header.format = format_;
+        header.filter = static_cast<std::uint32_t>(filter_);
+        header.levelCount = static_cast<std::uint32_t>(levels_.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const Level& level : levels_) {
+            out.write(reinterpret_cast<const char*>(level.data), level.size);
+        }
+        if (out.fail()) {
+            out.close();
+            std::filesystem::remove(tmpFile);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmpFile, cacheFile, error);
+    return !error;
+}
+
+bool MipChain::readCache(const std::string& cacheFile, std::uint64_t sourceStamp, Filter filter) {
+    MappedFile file;
+    if (sourceStamp == 0 || !file.open(cacheFile) || file.size() < sizeof(CacheHeader)) {
+        return false;
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        header.sourceStamp != sourceStamp || header.filter != static_cast<std::uint32_t>(filter) ||
+        (header.type != GL_RGB && header.type != GL_RGBA) || header.width == 0 ||
+        header.height == 0 || header.levelCount == 0 || header.levelCount > 32) {
+        return false;
+    }
+
+    // Rebuild the level table from the base size and check it against the file size
+    const GLuint bpp = (header.type == GL_RGBA) ? 4 : 3;
+    std::vector<Level> levels;
+    size_t offset = sizeof(CacheHeader);
+    GLuint w = header.width;
+    GLuint h = header.height;
+    for (std::uint32_t i = 0; i < header.levelCount; i++) {
+        const size_t size = static_cast<size_t>(w) * h * bpp;
+        if (offset + size > file.size()) {
+            return false;
+        }
+        levels.push_back({w, h, file.data() + offset, size});
+        offset += size;
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+
+    storage_.clear();
+    levels_ = std::move(levels);
+    cache_ = std::move(file);  // Moving the mapping keeps the level pointers valid
+    type_ = header.type;
+    format_ = header.format;
+    filter_ = filter;
+    return true;
+}
+
+bool MipChain::empty() const { return levels_.empty(); }
+
+size_t MipChain::levelCount() const { return levels_.size(); }
+
+const MipChain::Level& MipChain::level(size_t i) const { return levels_[i]; }
+
+GLuint MipChain::type() const { return type_; }
+
+GLuint MipChain::format() const { return format_; }
+
+MipChain::Filter MipChain::filter() const { return filter_; }
+
+bool MipChain::isMapped() const { return cache_.isOpen(); }
+
+size_t MipChain::totalSize() const {
+    size_t total = 0;
+    for (const Level& level : levels_) {
+        total += level.size;
+    }
+    return total;
+}
+
+void MipChain::dropLevels(size_t count) {
+    count = std::min(count, levels_.empty() ? 0 : levels_.size() - 1);
+    levels_.erase(levels_.begin(), levels_.begin() + count);
+    if (!storage_.empty()) {
+        // Moving the vectors keeps their data, so the level pointers stay valid
+        storage_.erase(storage_.begin(), storage_.begin() + count);
+    }
+}
+
+std::string MipChain::cacheFilename(const std::string& textureFile) {
+    return textureFile + ".mips";
+}
+
+std::uint64_t MipChain::sourceStamp(const std::string& filename) {
+    std::error_code error;
+    const std::uint64_t size = std::filesystem::file_size(filename, error);
+    if (error) {
+        return 0;
+    }
+    const auto time = std::filesystem::last_write_time(filename, error);
+    if (error) {
+        return 0;
+    }
+    const std::uint64_t ticks = static_cast<std::uint64_t>(time.time_since_epoch().count());
+    // Mix the two values so that neither alone decides the stamp
+    return (size * 0x9E3779B97F4A7C15ull) ^ ticks ^ 1;
+}
@@ -0,0 +1,84 @@
+/*
+ * CPU generation and caching of texture mipmap chains.
+ *
+ * Usage: Call generate() with the base level pixels to build all mip levels on the CPU,
+ *        using a 2x2 box filter or a Kaiser windowed sinc filter. writeCache() stores the
+ *        chain in a file, and readCache() maps such a file back so that the levels can be
+ *        uploaded without any filtering work. The cache records the size and time stamp
+ *        of the source file, and is rejected if the source has changed.
+ *        This class uses no OpenGL calls and can be used without a GL context.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+class MipChain {
+public:
+    enum class Filter { Box, Kaiser };
+
+    struct Level {
+        GLuint width = 0;
+        GLuint height = 0;
+        const GLubyte* data = nullptr;  // Points into the chain's own storage or the cache file
+        size_t size = 0;                // Size of data in bytes
+    };
+
+    MipChain();
+
+    // Build the full chain down to 1x1 from the base level. The base level is copied.
+    // type is GL_RGB or GL_RGBA, format is the byte order of the pixels (kept as is).
+    // numThreads = 0 uses one thread per hardware thread. The threads are shared by all
+    // chains, concurrent calls take turns on them.
+    void generate(const GLubyte* pixels, GLuint width, GLuint height, GLuint type, GLuint format,
+                  Filter filter, unsigned numThreads = 0);
+
+    // Store the chain in a cache file, sourceStamp identifies the version of the source image
+    bool writeCache(const std::string& cacheFile, std::uint64_t sourceStamp) const;
+
+    // Map a cache file written by writeCache(), fails if it is invalid or the stamps differ
+    bool readCache(const std::string& cacheFile, std::uint64_t sourceStamp, Filter filter);
+
+    bool empty() const;
+    size_t levelCount() const;
+    const Level& level(size_t i) const;
+    GLuint type() const;    // GL_RGB or GL_RGBA
+    GLuint format() const;  // Byte order, GL_BGR(A) or GL_RGB(A)
+    Filter filter() const;
+
+    // True if the levels point into a mapped cache file rather than heap memory
+    bool isMapped() const;
+
+    // Total size in bytes of all levels
+    size_t totalSize() const;
+
+    // Remove the count largest levels, the smallest level is always kept
+    void dropLevels(size_t count);
+
+    // Name of the cache file that belongs to a texture file
+    static std::string cacheFilename(const std::string& textureFile);
+
+    // A value that changes when the file changes (size and modification time), 0 if missing
+    static std::uint64_t sourceStamp(const std::string& filename);
+
+    // Resample an image to a new size with a separable filter. Used to build each level
+    // of the chain, but works for any scale factor (both down and up). The horizontal pass
+    // uses SSE2 when available, both passes run on the numThreads shared threads.
+    static void resample(const GLubyte* src, GLuint srcWidth, GLuint srcHeight, GLubyte* dst,
+                         GLuint dstWidth, GLuint dstHeight, GLuint bytesPerPixel, Filter filter,
+                         unsigned numThreads = 0);
+
+private:
+    std::vector<Level> levels_;
+    std::vector<std::vector<GLubyte>> storage_;  // Level data for generated chains
+    MappedFile cache_;                           // Level data for chains read from a cache
+    GLuint type_;
+    GLuint format_;
+    Filter filter_;
+};
@@ -0,0 +1,230 @@
+/*
+ * Finds the object and triangle under the mouse cursor on the CPU.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "Picker.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+namespace {
+
+using Matrix = std::array<GLfloat, 16>;
+
+// The inverse of a column-major 4 x 4 matrix by cofactors, in double precision so that the
+// steep depth mapping of a perspective matrix inverts cleanly. Returns false if singular.
+bool invert(const Matrix& m, Matrix& result) {
+    double a[16];
+    for (int i = 0; i < 16; i++) {
+        a[i] = m[i];
+    }
+    double inv[16];
+    inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] +
+             a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+    inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] -
+             a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+    inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] +
+             a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+    inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] -
+              a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+    inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] -
+             a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+    inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] +
+             a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+    inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] -
+             a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+    inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] +
+              a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+    inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] +
+             a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+    inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] -
+             a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+    inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] +
+              a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+    inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] -
+              a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+    inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] -
+             a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+    inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] +
+             a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+    inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] -
+              a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+    inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] +
+              a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+    const double det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+    if (det == 0.0 || !std::isfinite(det)) {
+        return false;
+    }
+    for (int i = 0; i < 16; i++) {
+        result[i] = static_cast<GLfloat>(inv[i] / det);
+    }
+    return true;
+}
+
+// Transform (x, y, z, w) by a column-major matrix
+std::array<float, 4> transform(const Matrix& m, float x, float y, float z, float w) {
+    std::array<float, 4> result;
+    for (int row = 0; row < 4; row++) {
+        result[row] = m[row] * x + m[4 + row] * y + m[8 + row] * z + m[12 + row] * w;
+    }
+    return result;
+}
+
+// Where the ray enters the box, or infinity if it misses it before tMax
+float enterBox(const BVH::Ray& ray, const Mesh::Bounds& bounds) {
+    float tNear = 0.0f;
+    float tFar = ray.tMax;
+    for (int axis = 0; axis < 3; axis++) {
+        const float inverse = 1.0f / ray.direction[axis];
+        float t0 = (bounds.min[axis] - ray.origin[axis]) * inverse;
+        float t1 = (bounds.max[axis] - ray.origin[axis]) * inverse;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        // Written so that the NaN of a ray in the plane of a side keeps the old limits
+        tNear = (t0 > tNear) ? t0 : tNear;
+        tFar = (t1 < tFar) ? t1 : tFar;
+    }
+    return (tNear <= tFar) ? tNear : std::numeric_limits<float>::infinity();
+}
+
+}  // namespace
+
+Picker::Picker(unsigned numThreads) : numThreads_(numThreads) {}
+
+size_t Picker::add(const Mesh& mesh) {
+    auto found = meshIndex_.find(&mesh);
+    if (found == meshIndex_.end()) {
+        Shape entry;
+        entry.bvh.reset(new BVH());
+        if (!entry.bvh->build(mesh, numThreads_)) {
+            std::cerr << "Picker: the mesh has no vertex and index arrays, it cannot be picked\n";
+        }
+        entry.bounds = mesh.bounds();
+        meshes_.push_back(std::move(entry));
+        found = meshIndex_.emplace(&mesh, meshes_.size() - 1).first;
+    }
+    Object object;
+    object.mesh = found->second;
+    object.inverseMV = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    object.visible = false;  // Until update() says where it is
+    objects_.push_back(object);
+    return objects_.size() - 1;
+}
+
+void Picker::update(size_t object, const std::array<GLfloat, 16>& MV, bool visible) {
+    Object& entry = objects_.at(object);
+    entry.visible = visible && invert(MV, entry.inverseMV);
+}
+
+Picker::Result Picker::pick(double x, double y, int width, int height,
+                            const std::array<GLfloat, 16>& P) {
+    Matrix inverseP;
+    if (width <= 0 || height <= 0 || !invert(P, inverseP)) {
+        stats_ = Stats();
+        last_ = Result();
+        return last_;
+    }
+
+    // The cursor in normalized device coordinates, y up, unprojected to the near and the far
+    // plane. The ray runs between them, so t is 0 at the near plane and 1 at the far plane.
+    const float ndcX = static_cast<float>(2.0 * x / width - 1.0);
+    const float ndcY = static_cast<float>(1.0 - 2.0 * y / height);
+    const std::array<float, 4> nearPoint = transform(inverseP, ndcX, ndcY, -1.0f, 1.0f);
+    const std::array<float, 4> farPoint = transform(inverseP, ndcX, ndcY, 1.0f, 1.0f);
+    BVH::Ray ray;
+    for (int axis = 0; axis < 3; axis++) {
+        ray.origin[axis] = nearPoint[axis] / nearPoint[3];
+        ray.direction[axis] = farPoint[axis] / farPoint[3] - ray.origin[axis];
+    }
+    ray.tMax = 1.0f;
+    return pick(ray);
+}
+
+Picker::Result Picker::pick(const BVH::Ray& ray) {
+    TRACE_ZONE("Picker::pick");
+    const auto start = std::chrono::steady_clock::now();
+    stats_ = Stats();
+
+    // The ray in model coordinates of each visible object whose bounds it enters. An affine
+    // modelview matrix keeps t the same in both spaces, so hits of all objects compare.
+    struct Candidate {
+        float enter;
+        size_t object;
+        BVH::Ray ray;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < objects_.size(); i++) {
+        const Object& object = objects_[i];
+        const Shape& mesh = meshes_[object.mesh];
+        if (!object.visible || mesh.bvh->empty()) {
+            continue;
+        }
+        Candidate candidate;
+        candidate.object = i;
+        const std::array<float, 4> origin = transform(
+            object.inverseMV, ray.origin[0], ray.origin[1], ray.origin[2], 1.0f);
+        const std::array<float, 4> direction = transform(
+            object.inverseMV, ray.direction[0], ray.direction[1], ray.direction[2], 0.0f);
+        candidate.ray.origin = {{origin[0], origin[1], origin[2]}};
+        candidate.ray.direction = {{direction[0], direction[1], direction[2]}};
+        candidate.ray.tMax = ray.tMax;
+        candidate.enter = enterBox(candidate.ray, mesh.bounds);
+        stats_.boxesTested++;
+        if (candidate.enter < ray.tMax) {
+            candidates.push_back(candidate);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.enter < b.enter; });
+
+    // Nearest box first, until the closest hit is nearer than the next box
+    Result result;
+    BVH::Hit best;
+    best.t = ray.tMax;
+    for (Candidate& candidate : candidates) {
+        if (candidate.enter >= best.t) {
+            break;
+        }
+        candidate.ray.tMax = best.t;
+        stats_.bvhsTraced++;
+        if (meshes_[objects_[candidate.object].mesh].bvh->intersect(candidate.ray, best)) {
+            result.object = candidate.object;
+        }
+    }
+    if (result.hit()) {
+        result.triangle = best.triangle;
+        result.u = best.u;
+        result.v = best.v;
+        for (int axis = 0; axis < 3; axis++) {
+            result.position[axis] = ray.origin[axis] + best.t * ray.direction[axis];
+        }
+    }
+
+    stats_.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                          start)
+                    .count();
+    last_ = result;
+    return result;
+}
+
+std::string Picker::summary() const {
+    char text[100];
+    if (last_.hit()) {
+        snprintf(text, sizeof(text), "object %zu, triangle %u in %.3f ms", last_.object,
+                 last_.triangle, stats_.ms);
+    } else {
+        snprintf(text, sizeof(text), "nothing in %.3f ms", stats_.ms);
+    }
+    return text;
+}
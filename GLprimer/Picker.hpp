@@ -0,0 +1,97 @@
+/*
+ * Finds the object and triangle under the mouse cursor on the CPU, without reading back from
+ * the GPU.
+ *
+ * Usage: add() each object with its mesh, in the same order as to the FramePipeline so that
+ *        the numbers match. Each mesh gets a BVH the first time it is added, and objects that
+ *        share a mesh share it, so the mesh must keep its vertex and index arrays until then.
+ *        Before picking, update() every object with the modelview matrix it was drawn with
+ *        and whether it was visible, then call pick() with the cursor position in window
+ *        coordinates and the projection matrix. The cursor is unprojected into a ray from
+ *        the near to the far plane. The ray is tested against the bounds of each visible
+ *        object, nearest first, and then against the BVH of its mesh in model coordinates,
+ *        until no box is closer than the closest hit. The result names the object, the
+ *        triangle in its mesh, the barycentric coordinates and the hit point in eye
+ *        coordinates.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "BVH.hpp"
+#include "Mesh.hpp"
+
+class Picker {
+public:
+    static constexpr size_t noObject = static_cast<size_t>(-1);
+
+    struct Result {
+        size_t object = noObject;
+        uint32_t triangle = BVH::noHit;  // Index of the triangle in the mesh of the object
+        float u = 0.0f;  // Barycentric weights of the second and the third vertex
+        float v = 0.0f;
+        std::array<GLfloat, 3> position = {{0.0f, 0.0f, 0.0f}};  // Eye coordinates
+
+        bool hit() const { return object != noObject; }
+    };
+
+    struct Stats {
+        size_t boxesTested = 0;  // Visible objects tested against their bounds
+        size_t bvhsTraced = 0;   // Objects whose BVH was traced
+        double ms = 0.0;         // Time of the last pick
+    };
+
+    /* Constructor: build the BVHs with numThreads threads, 0 means one per hardware thread */
+    explicit Picker(unsigned numThreads = 0);
+
+    Picker(const Picker&) = delete;
+    Picker& operator=(const Picker&) = delete;
+
+    // Add an object drawn with the mesh and return its number, builds the BVH of a new mesh.
+    // For a TriangleSoup, pass its mesh(), which needs setKeepCPUCopy(true).
+    size_t add(const Mesh& mesh);
+
+    // Set the modelview matrix of an object as it is on screen, hidden objects are not picked
+    void update(size_t object, const std::array<GLfloat, 16>& MV, bool visible = true);
+
+    // Pick at a cursor position in pixels from the top left corner of a window of
+    // width x height pixels, as GLFW reports it, seen through the projection matrix P
+    Result pick(double x, double y, int width, int height, const std::array<GLfloat, 16>& P);
+
+    // Pick along a ray in eye coordinates, hits are found up to origin + tMax * direction
+    Result pick(const BVH::Ray& ray);
+
+    size_t objectCount() const { return objects_.size(); }
+    Stats stats() const { return stats_; }
+
+    // As "object 1, triangle 1234 in 0.021 ms", or "nothing in 0.004 ms"
+    std::string summary() const;
+
+private:
+    // The BVH of a mesh, shared by the objects drawn with it
+    struct Shape {
+        std::unique_ptr<BVH> bvh;
+        Mesh::Bounds bounds;
+    };
+
+    struct Object {
+        size_t mesh;
+        std::array<GLfloat, 16> inverseMV;
+        bool visible;
+    };
+
+    unsigned numThreads_;
+    std::vector<Shape> meshes_;
+    std::unordered_map<const Mesh*, size_t> meshIndex_;
+    std::vector<Object> objects_;
+    Result last_;
+    Stats stats_;
+};
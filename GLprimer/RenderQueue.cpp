@@ -0,0 +1,192 @@
+/*
+ * A queue of mesh draws that is sorted by render state before it is submitted to GL.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Bit fields of the sort key, from the most significant: the most expensive state first
+const int programBits = 8;
+const int textureBits = 16;
+const int meshBits = 16;
+const int depthBits = 24;
+
+// Depth as an unsigned value that sorts like the distance, for distances of 0 and more
+std::uint64_t depthKey(float distance) {
+    distance = std::max(distance, 0.0f);
+    std::uint32_t bits;
+    std::memcpy(&bits, &distance, sizeof(bits));  // Positive floats sort like their bits
+    return bits >> (32 - depthBits);
+}
+
+}  // namespace
+
+RenderQueue::RenderQueue() {}
+
+size_t RenderQueue::submit(TriangleSoup& mesh, GLuint program, Texture* texture,
+                           const std::array<GLfloat, 16>& MV,
+                           const TexturePacker::Region* region, const std::string* scope) {
+    draws_.push_back({&mesh, texture, region, scope, program, MV});
+    return draws_.size() - 1;
+}
+
+/*
+ * Number the programs, textures and meshes in order of first use and pack them into the
+ * keys. Objects beyond the width of their field share numbers, which only costs extra
+ * state changes. The depth is the distance of the mesh origin along the view direction.
+ */
+void RenderQueue::buildKeys() {
+    ids_.clear();
+    size_t programs = 0;
+    size_t textures = 0;
+    size_t meshes = 0;
+    const auto id = [this](const void* object, size_t& count, int bits) {
+        auto inserted = ids_.emplace(object, count);
+        if (inserted.second) {
+            count++;
+        }
+        return inserted.first->second & ((std::uint64_t(1) << bits) - 1);
+    };
+
+    items_.resize(draws_.size());
+    for (size_t i = 0; i < draws_.size(); i++) {
+        const Draw& draw = draws_[i];
+        // Program names are small integers, offset so they never clash with object addresses
+        const void* program = reinterpret_cast<const void*>(std::uintptr_t(draw.program) + 1);
+        std::uint64_t key = id(program, programs, programBits);
+        key = (key << textureBits) | (draw.texture ? id(draw.texture, textures, textureBits) : 0);
+        key = (key << meshBits) | id(draw.mesh, meshes, meshBits);
+        key = (key << depthBits) | depthKey(-draw.MV[14]);
+        items_[i] = {key, static_cast<std::uint32_t>(i)};
+    }
+}
+
+/*
+ * Least significant digit first radix sort, which is stable, so draws with equal keys stay
+ * in submission order. The histograms of all eight digits are built in one pass.
+ */
+void RenderQueue::radixSort() {
+    const size_t count = items_.size();
+    std::array<std::array<size_t, 256>, 8> histograms = {};
+    for (const SortItem& item : items_) {
+        for (int d = 0; d < 8; d++) {
+            histograms[d][(item.key >> (8 * d)) & 0xff]++;
+        }
+    }
+
+    scratch_.resize(count);
+    for (int d = 0; d < 8; d++) {
+        std::array<size_t, 256>& histogram = histograms[d];
+        if (histogram[(items_[0].key >> (8 * d)) & 0xff] == count) {
+            continue;  // All keys have the same digit, the pass would not move anything
+        }
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            const size_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (const SortItem& item : items_) {
+            scratch_[histogram[(item.key >> (8 * d)) & 0xff]++] = item;
+        }
+        items_.swap(scratch_);
+    }
+}
+
+const RenderQueue::Locations& RenderQueue::locations(GLuint program) {
+    auto found = locations_.find(program);
+    if (found == locations_.end()) {
+        const Locations l = {glGetUniformLocation(program, "MV"),
+                             glGetUniformLocation(program, "layer"),
+                             glGetUniformLocation(program, "uvRect"),
+                             glGetUniformLocation(program, "maxLod")};
+        found = locations_.emplace(program, l).first;
+    }
+    return found->second;
+}
+
+void RenderQueue::flush() {
+    list_.clear();
+    record(list_);
+    list_.execute();
+}
+
+void RenderQueue::record(CommandList& list) {
+    stats_ = Stats();
+    stats_.draws = draws_.size();
+    if (draws_.empty()) {
+        return;
+    }
+    buildKeys();
+
+    // Count the changes the submission order would need, with the same redundancy checks
+    const Draw* previous = nullptr;
+    const Texture* bound = nullptr;
+    for (const Draw& draw : draws_) {
+        stats_.unsorted.programs += (!previous || draw.program != previous->program) ? 1 : 0;
+        stats_.unsorted.vaos += (!previous || draw.mesh != previous->mesh) ? 1 : 0;
+        if (draw.texture && draw.texture != bound) {
+            bound = draw.texture;
+            stats_.unsorted.textures++;
+        }
+        previous = &draw;
+    }
+
+    radixSort();
+
+    patches_.resize(draws_.size());
+    GLuint program = 0;
+    const Texture* texture = nullptr;
+    const TriangleSoup* mesh = nullptr;
+    const Locations* l = nullptr;
+    for (size_t i = 0; i < items_.size(); i++) {
+        const Draw& draw = draws_[items_[i].draw];
+        if (i == 0 || draw.program != program) {
+            program = draw.program;
+            list.bindProgram(program);
+            l = &locations(program);
+            stats_.sorted.programs++;
+        }
+        if (draw.texture && draw.texture != texture) {
+            texture = draw.texture;
+            list.bindTexture(*draw.texture);
+            stats_.sorted.textures++;
+        }
+        patches_[items_[i].draw] = list.setMatrix(l->MV, draw.MV);
+        if (draw.region) {
+            list.setFloat(l->layer, static_cast<GLfloat>(draw.region->layer));
+            list.setVector(l->uvRect, draw.region->uvRect);
+            list.setFloat(l->maxLod, draw.region->maxLod);
+        }
+        stats_.sorted.vaos += (draw.mesh != mesh) ? 1 : 0;
+        mesh = draw.mesh;
+        if (draw.scope) {
+            list.beginScope(*draw.scope);
+        }
+        list.drawMesh(*draw.mesh);
+        if (draw.scope) {
+            list.endScope();
+        }
+    }
+    draws_.clear();
+}
+
+void RenderQueue::addProgram(GLuint program) { locations(program); }
+
+CommandList::Patch RenderQueue::patch(size_t draw) const { return patches_.at(draw); }
+
+RenderQueue::Stats RenderQueue::stats() const { return stats_; }
+
+std::string RenderQueue::summary() const {
+    const StateChanges& u = stats_.unsorted;
+    const StateChanges& s = stats_.sorted;
+    return "binds " + std::to_string(u.programs + u.textures + u.vaos) + " -> " +
+           std::to_string(s.programs + s.textures + s.vaos);
+}
@@ -0,0 +1,119 @@
+/*
+ * A queue of mesh draws that is sorted by render state before it is submitted to GL.
+ *
+ * Usage: Set the uniforms that are the same for all draws of a frame (such as P and T) on
+ *        each program, then submit() every mesh with its program, texture and modelview
+ *        matrix, in any order. flush() sorts the draws by a 64 bit key made of the program,
+ *        the texture, the mesh and the depth, with a radix sort, and renders them so that
+ *        each program, texture and vertex array is bound once per run of equal draws.
+ *        Draws of the same mesh are rendered front to back. The modelview matrix is set
+ *        on the "MV" uniform, and a TexturePacker region on "layer", "uvRect" and "maxLod".
+ *        A draw with a scope name is recorded between CommandList::beginScope() and
+ *        endScope(), to time it with a GpuProfiler.
+ *        stats() reports the state changes of the last flush in submission order and in
+ *        sorted order. To replay the same draws every frame without sorting them again,
+ *        record() them into a CommandList once and update the matrices with patch().
+ *        flush() records into a list of the queue and executes it.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CommandList.hpp"
+#include "Texture.hpp"
+#include "TexturePacker.hpp"
+#include "TriangleSoup.hpp"
+
+class RenderQueue {
+public:
+    struct StateChanges {
+        size_t programs = 0;  // glUseProgram() calls
+        size_t textures = 0;  // Texture binds
+        size_t vaos = 0;      // Vertex array binds
+    };
+
+    struct Stats {
+        size_t draws = 0;
+        StateChanges unsorted;  // Changes needed to render the draws in submission order
+        StateChanges sorted;    // Changes made when rendering in sorted order
+    };
+
+    RenderQueue();
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Queue a draw of a mesh and return its number in the queue. A null texture keeps the
+    // texture that is bound, a region sets the uniforms of shaders/fragment_array.glsl.
+    // The mesh, texture and scope name must stay alive until flush(), or as long as a
+    // recorded list.
+    size_t submit(TriangleSoup& mesh, GLuint program, Texture* texture,
+                  const std::array<GLfloat, 16>& MV, const TexturePacker::Region* region = nullptr,
+                  const std::string* scope = nullptr);
+
+    // Sort and render the queued draws, then empty the queue. Leaves the last program,
+    // texture and vertex array bound, the binds go through GLState.
+    void flush();
+
+    // Sort the queued draws and append them to a list, then empty the queue. Looks up the
+    // uniform locations of programs the queue has not seen, which needs the GL thread.
+    void record(CommandList& list);
+
+    // Look up the uniform locations of a program on the GL thread, after which record()
+    // can run on any thread for draws with that program
+    void addProgram(GLuint program);
+
+    // The modelview matrix of a draw, by its number, in the list of the last record()
+    CommandList::Patch patch(size_t draw) const;
+
+    Stats stats() const;
+
+    // State changes as "binds 6 -> 4", unsorted and sorted
+    std::string summary() const;
+
+private:
+    struct Draw {
+        TriangleSoup* mesh;
+        Texture* texture;
+        const TexturePacker::Region* region;
+        const std::string* scope;
+        GLuint program;
+        std::array<GLfloat, 16> MV;
+    };
+
+    struct SortItem {
+        std::uint64_t key;
+        std::uint32_t draw;  // Index in draws_
+    };
+
+    struct Locations {
+        GLint MV;
+        GLint layer;
+        GLint uvRect;
+        GLint maxLod;
+    };
+
+    // Build the sort keys, the objects are numbered in order of first use this frame
+    void buildKeys();
+
+    // Sort items_ by key, 8 bits per pass, skipping passes where all keys share the digit
+    void radixSort();
+
+    const Locations& locations(GLuint program);
+
+    std::vector<Draw> draws_;
+    std::vector<SortItem> items_;
+    std::vector<SortItem> scratch_;  // Second buffer for the radix sort passes
+    std::unordered_map<const void*, std::uint64_t> ids_;
+    std::unordered_map<GLuint, Locations> locations_;
+    std::vector<CommandList::Patch> patches_;  // By draw number
+    CommandList list_;                         // Recorded and executed by flush()
+    Stats stats_;
+};
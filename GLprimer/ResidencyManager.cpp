@@ -0,0 +1,205 @@
+/*
+ * Tracks the GPU memory used by textures and meshes and keeps it within a budget.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "ResidencyManager.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+const GLuint minReducedSize = 64;  // Textures are not reduced below this width or height
+
+}  // namespace
+
+ResidencyManager::ResidencyManager(size_t budget)
+    : budget_(budget), streamer_(nullptr), frame_(0) {}
+
+ResidencyManager::~ResidencyManager() {
+    for (auto& item : entries_) {
+        if (item.second.texture) {
+            item.second.texture->residency_ = nullptr;
+        } else {
+            item.second.mesh->residency_ = nullptr;
+        }
+    }
+}
+
+void ResidencyManager::setBudget(size_t budget) { budget_ = budget; }
+
+void ResidencyManager::setStreamer(TextureStreamer* streamer) { streamer_ = streamer; }
+
+void ResidencyManager::add(Texture& texture) {
+    entries_[&texture] = Entry{&texture, nullptr, frame_, false, 0};
+    texture.residency_ = this;
+}
+
+void ResidencyManager::add(TriangleSoup& mesh) {
+    entries_[&mesh] = Entry{nullptr, &mesh, frame_, false, 0};
+    mesh.residency_ = this;
+}
+
+void ResidencyManager::remove(Texture& texture) {
+    entries_.erase(&texture);
+    texture.residency_ = nullptr;
+}
+
+void ResidencyManager::remove(TriangleSoup& mesh) {
+    entries_.erase(&mesh);
+    mesh.residency_ = nullptr;
+}
+
+void ResidencyManager::use(Texture& texture) {
+    auto found = entries_.find(&texture);
+    if (found != entries_.end()) {
+        touch(found->second);
+    }
+}
+
+void ResidencyManager::use(TriangleSoup& mesh) {
+    auto found = entries_.find(&mesh);
+    if (found != entries_.end()) {
+        touch(found->second);
+    }
+}
+
+void ResidencyManager::touch(Entry& entry) {
+    entry.lastUsed = frame_;
+    if (entry.evicted) {
+        reload(entry);
+    } else if (entry.droppedLevels > 0) {
+        // Each dropped level quartered the size, restore it only if that fits
+        const size_t size = sizeOf(entry);
+        const size_t fullSize = size << (2 * entry.droppedLevels);
+        if (used() - size + fullSize <= budget_) {
+            reload(entry);
+        }
+    }
+}
+
+void ResidencyManager::reload(Entry& entry) {
+    if (entry.texture) {
+        entry.texture->reload(streamer_);
+    } else {
+        entry.mesh->upload();
+    }
+    entry.evicted = false;
+    entry.droppedLevels = 0;
+    totals_.reloads++;
+}
+
+void ResidencyManager::evict(Entry& entry) {
+    if (entry.texture) {
+        entry.texture->release();
+    } else {
+        entry.mesh->release();
+    }
+    entry.evicted = true;
+    entry.droppedLevels = 0;
+    totals_.evictions++;
+}
+
+size_t ResidencyManager::sizeOf(const Entry& entry) const {
+    return entry.texture ? entry.texture->sizeInBytes() : entry.mesh->sizeInBytes();
+}
+
+size_t ResidencyManager::used() const {
+    size_t bytes = 0;
+    for (const auto& item : entries_) {
+        bytes += sizeOf(item.second);
+    }
+    return bytes;
+}
+
+/*
+ * Reduce the least recently rendered textures first, since they stay usable at a lower
+ * resolution without a reload, and evict objects only if that was not enough. Textures
+ * that are still loading are left alone, the upload would replace what was freed.
+ */
+void ResidencyManager::update() {
+    size_t current = used();
+    if (current > budget_) {
+        std::vector<Entry*> candidates;
+        for (auto& item : entries_) {
+            Entry& entry = item.second;
+            const bool loading = entry.texture && entry.texture->streamer_;
+            if (entry.lastUsed != frame_ && !entry.evicted && !loading && sizeOf(entry) > 0) {
+                candidates.push_back(&entry);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Entry* a, const Entry* b) { return a->lastUsed < b->lastUsed; });
+
+        // Only textures that can be loaded again are reduced, so they can be restored
+        for (Entry* entry : candidates) {
+            Texture* texture = entry->texture;
+            while (current > budget_ && texture && !texture->filename_.empty() &&
+                   std::max(texture->width(), texture->height()) > minReducedSize) {
+                const size_t before = sizeOf(*entry);
+                if (!texture->dropTopLevel()) {
+                    break;
+                }
+                current -= before - sizeOf(*entry);
+                entry->droppedLevels++;
+                totals_.reductions++;
+            }
+        }
+
+        for (Entry* entry : candidates) {
+            if (current <= budget_) {
+                break;
+            }
+            const bool reloadable = entry->texture ? !entry->texture->filename_.empty()
+                                                   : !entry->mesh->mesh_.empty();
+            if (reloadable) {
+                current -= sizeOf(*entry);
+                evict(*entry);
+            }
+        }
+    }
+    totals_.peak = std::max(totals_.peak, current);
+    frame_++;
+}
+
+ResidencyManager::Usage ResidencyManager::usage() const {
+    Usage usage = totals_;
+    usage.budget = budget_;
+    usage.resources = entries_.size();
+    for (const auto& item : entries_) {
+        const Entry& entry = item.second;
+        (entry.texture ? usage.textureBytes : usage.meshBytes) += sizeOf(entry);
+        usage.evicted += entry.evicted ? 1 : 0;
+        usage.reduced += (entry.droppedLevels > 0) ? 1 : 0;
+    }
+    usage.used = usage.textureBytes + usage.meshBytes;
+    return usage;
+}
+
+std::map<GLenum, size_t> ResidencyManager::bytesByFormat() const {
+    std::map<GLenum, size_t> bytes;
+    for (const auto& item : entries_) {
+        const Entry& entry = item.second;
+        if (sizeOf(entry) > 0) {
+            bytes[entry.texture ? entry.texture->internalFormat_ : GL_ARRAY_BUFFER] +=
+                sizeOf(entry);
+        }
+    }
+    return bytes;
+}
+
+std::string ResidencyManager::summary() const {
+    const Usage current = usage();
+    char text[100];
+    snprintf(text, sizeof(text), "VRAM %.1f/%.1f MB", current.used / (1024.0 * 1024.0),
+             current.budget / (1024.0 * 1024.0));
+    std::string result = text;
+    if (current.evicted > 0) {
+        result += ", " + std::to_string(current.evicted) + " evicted";
+    }
+    return result;
+}
@@ -0,0 +1,109 @@
+/*
+ * Tracks the GPU memory used by textures and meshes and keeps it within a budget.
+ *
+ * Usage: Create a ResidencyManager with a budget in bytes before the objects it manages,
+ *        and add() each Texture and TriangleSoup. Bind the textures with Texture::bind(),
+ *        so that the manager sees which objects are rendered. Call update() once per frame
+ *        after rendering. When the objects take more memory than the budget, the least
+ *        recently rendered textures first lose their top mip levels, and then the least
+ *        recently rendered objects are evicted. Evicted objects are loaded again (textures
+ *        from their file, meshes from their CPU copy) the next time they are rendered, and
+ *        reduced textures get their full resolution back when it fits in the budget.
+ *        With setStreamer(), textures are loaded again in the background instead of in the
+ *        middle of the frame that binds them. An evicted texture shows the streamer's
+ *        placeholder until then, a reduced one keeps its reduced levels.
+ *        usage() and bytesByFormat() report the memory use, and summary() returns a short
+ *        text for the window title. All member functions are meant to be called from the
+ *        GL thread.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include "Texture.hpp"
+#include "TextureStreamer.hpp"
+#include "TriangleSoup.hpp"
+
+class ResidencyManager {
+public:
+    struct Usage {
+        size_t budget = 0;        // Bytes allowed
+        size_t used = 0;          // Bytes allocated now
+        size_t peak = 0;          // Most bytes allocated at the end of a frame
+        size_t textureBytes = 0;
+        size_t meshBytes = 0;
+        size_t resources = 0;     // Objects managed
+        size_t evicted = 0;       // Objects evicted now
+        size_t reduced = 0;       // Textures with dropped mip levels now
+        size_t evictions = 0;     // Total number of evictions
+        size_t reductions = 0;    // Total number of mip levels dropped
+        size_t reloads = 0;       // Total number of objects loaded again
+    };
+
+    /* Constructor: the budget is in bytes */
+    explicit ResidencyManager(size_t budget);
+
+    /* Destructor, stops managing all remaining objects */
+    ~ResidencyManager();
+
+    ResidencyManager(const ResidencyManager&) = delete;
+    ResidencyManager& operator=(const ResidencyManager&) = delete;
+
+    void setBudget(size_t budget);
+
+    // Reload textures through a streamer from now on, null reloads them synchronously
+    void setStreamer(TextureStreamer* streamer);
+
+    // Start managing an object. Only textures loaded from a file can be evicted, and meshes
+    // as long as they keep their CPU copy.
+    void add(Texture& texture);
+    void add(TriangleSoup& mesh);
+
+    // Stop managing an object (called by its destructor)
+    void remove(Texture& texture);
+    void remove(TriangleSoup& mesh);
+
+    // Mark an object as rendered this frame, and load it again if it has been evicted
+    // (called by Texture::bind() and TriangleSoup::render())
+    void use(Texture& texture);
+    void use(TriangleSoup& mesh);
+
+    // Bring the memory use within the budget, objects rendered this frame are kept
+    void update();
+
+    Usage usage() const;
+
+    // Bytes allocated per internal format, meshes are listed under GL_ARRAY_BUFFER
+    std::map<GLenum, size_t> bytesByFormat() const;
+
+    // Memory use as "VRAM 12.3/256.0 MB", followed by the number of evicted objects if any
+    std::string summary() const;
+
+private:
+    struct Entry {
+        Texture* texture;
+        TriangleSoup* mesh;
+        unsigned long long lastUsed;  // Frame the object was last rendered
+        bool evicted;
+        GLsizei droppedLevels;
+    };
+
+    size_t sizeOf(const Entry& entry) const;
+    size_t used() const;
+
+    // Evict or restore an object
+    void evict(Entry& entry);
+    void reload(Entry& entry);
+    void touch(Entry& entry);
+
+    size_t budget_;
+    TextureStreamer* streamer_;  // Loads evicted and reduced textures, if set
+    std::unordered_map<const void*, Entry> entries_;
+    unsigned long long frame_;
+    Usage totals_;  // The counters that are not computed from the entries
+};
@@ -0,0 +1,212 @@
+/*
+ * A registry of loaded textures and meshes that shares each file between all its users.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "ResourceManager.hpp"
+#include "MappedFile.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+
+inline std::uint64_t rotl64(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline std::uint64_t fmix64(std::uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+/*
+ * MurmurHash3 x64 128 by Austin Appleby (public domain), seed 0. Every input bit affects
+ * all 128 output bits, unlike a single 64-bit multiply chain.
+ */
+void murmur3_128(const unsigned char* data, size_t size, std::uint64_t hash[2]) {
+    const std::uint64_t c1 = 0x87c37b91114253d5ull;
+    const std::uint64_t c2 = 0x4cf5ad432745937full;
+    std::uint64_t h1 = 0;
+    std::uint64_t h2 = 0;
+
+    const size_t blocks = size / 16;
+    for (size_t i = 0; i < blocks; i++) {
+        std::uint64_t k1;
+        std::uint64_t k2;
+        std::memcpy(&k1, data + i * 16, 8);
+        std::memcpy(&k2, data + i * 16 + 8, 8);
+
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = rotl64(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+        h2 = rotl64(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // The last 0 to 15 bytes, little endian
+    const unsigned char* tail = data + blocks * 16;
+    const size_t rest = size & 15;
+    std::uint64_t k1 = 0;
+    std::uint64_t k2 = 0;
+    for (size_t i = rest; i > 8; i--) {
+        k2 = (k2 << 8) | tail[i - 1];
+    }
+    for (size_t i = (rest < 8) ? rest : 8; i > 0; i--) {
+        k1 = (k1 << 8) | tail[i - 1];
+    }
+    if (rest > 8) {
+        k2 *= c2;
+        k2 = rotl64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+    }
+    if (rest > 0) {
+        k1 *= c1;
+        k1 = rotl64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    hash[0] = h1;
+    hash[1] = h2;
+}
+
+}  // namespace
+
+std::shared_ptr<Texture> ResourceManager::texture(const std::string& filename) {
+    return acquire(textures_, filename, [](const std::string& path) {
+        auto texture = std::make_shared<Texture>(path);
+        return (texture->id() != 0) ? texture : nullptr;
+    });
+}
+
+std::shared_ptr<TriangleSoup> ResourceManager::mesh(const std::string& filename) {
+    return acquire(meshes_, filename, [](const std::string& path) {
+        auto mesh = std::make_shared<TriangleSoup>();
+        mesh->readOBJ(path);
+        return (mesh->sizeInBytes() != 0) ? mesh : nullptr;
+    });
+}
+
+ResourceManager::Stats ResourceManager::stats() const {
+    Stats stats = stats_;
+    addResident(textures_, stats);
+    addResident(meshes_, stats);
+    return stats;
+}
+
+/*
+ * A repeated path costs one hash map lookup. A new path is hashed and looked up by content,
+ * which catches copies of a file under another name, and only then is the file loaded.
+ * A content match is only shared after comparing the two files, if they differ after all
+ * the new file is loaded and takes over the entry, the old object stays reachable by path.
+ */
+template <typename T, typename Load>
+std::shared_ptr<T> ResourceManager::acquire(Registry<T>& registry, const std::string& filename,
+                                            Load load) {
+    const std::string path = canonicalPath(filename);
+    auto byPath = registry.byPath.find(path);
+    if (byPath != registry.byPath.end()) {
+        if (std::shared_ptr<T> resource = byPath->second.lock()) {
+            stats_.duplicatesAvoided++;
+            stats_.bytesSaved += resource->sizeInBytes();
+            return resource;
+        }
+    }
+
+    ContentKey key;
+    if (!contentKey(path, key)) {
+        std::cerr << "Unable to open resource file ('" << filename << "')\n";
+        return nullptr;
+    }
+    auto byContent = registry.byContent.find(key);
+    if (byContent != registry.byContent.end()) {
+        std::shared_ptr<T> resource = byContent->second.resource.lock();
+        if (resource && sameContents(byContent->second.path, path)) {
+            registry.byPath[path] = resource;
+            stats_.duplicatesAvoided++;
+            stats_.bytesSaved += resource->sizeInBytes();
+            return resource;
+        }
+    }
+
+    prune(registry);
+    std::shared_ptr<T> resource = load(path);
+    if (!resource) {
+        return nullptr;
+    }
+    registry.byPath[path] = resource;
+    registry.byContent[key] = ContentEntry<T>{path, resource};
+    stats_.loads++;
+    return resource;
+}
+
+template <typename T>
+void ResourceManager::prune(Registry<T>& registry) {
+    for (auto it = registry.byPath.begin(); it != registry.byPath.end();) {
+        it = it->second.expired() ? registry.byPath.erase(it) : std::next(it);
+    }
+    for (auto it = registry.byContent.begin(); it != registry.byContent.end();) {
+        it = it->second.resource.expired() ? registry.byContent.erase(it) : std::next(it);
+    }
+}
+
+template <typename T>
+void ResourceManager::addResident(const Registry<T>& registry, Stats& stats) {
+    for (const auto& entry : registry.byContent) {
+        if (std::shared_ptr<T> resource = entry.second.resource.lock()) {
+            stats.resident++;
+            stats.residentBytes += resource->sizeInBytes();
+        }
+    }
+}
+
+/* Resolve ".", ".." and symbolic links, so that every spelling of a path shares one entry */
+std::string ResourceManager::canonicalPath(const std::string& filename) {
+    std::error_code error;
+    const std::filesystem::path path = std::filesystem::weakly_canonical(filename, error);
+    return error ? filename : path.string();
+}
+
+bool ResourceManager::contentKey(const std::string& filename, ContentKey& key) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        return false;
+    }
+    key.size = file.size();
+    murmur3_128(file.data(), file.size(), key.hash);
+    return true;
+}
+
+bool ResourceManager::sameContents(const std::string& filename1, const std::string& filename2) {
+    MappedFile file1(filename1);
+    MappedFile file2(filename2);
+    if (!file1.isOpen() || !file2.isOpen() || file1.size() != file2.size()) {
+        return false;
+    }
+    return file1.size() == 0 || std::memcmp(file1.data(), file2.data(), file1.size()) == 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * A registry of loaded textures and meshes that shares each file between all its users.
+ *
+ * Usage: Call texture() or mesh() with a file name instead of Texture::createTexture() or
+ *        TriangleSoup::readOBJ(). The first request loads the file, later requests for the
+ *        same path, or for another file with identical contents, return a shared handle to
+ *        the object already loaded. The GL objects are freed when the last handle is released.
+ *        Files are matched by content with a 128-bit hash and their size, and the contents
+ *        are compared byte by byte before an object is shared, so a hash collision only
+ *        costs a load. A null handle is returned if the file can not be loaded.
+ *        stats() reports the number of loads, the duplicate loads avoided and the GPU memory
+ *        they would have taken. All member functions are meant to be called from the GL thread.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "Texture.hpp"
+#include "TriangleSoup.hpp"
+
+class ResourceManager {
+public:
+    struct Stats {
+        size_t loads = 0;              // Files read, decoded and uploaded
+        size_t duplicatesAvoided = 0;  // Requests served by an object that was already loaded
+        size_t bytesSaved = 0;         // GPU memory those requests would have allocated
+        size_t resident = 0;           // Textures and meshes currently alive
+        size_t residentBytes = 0;      // GPU memory used by them
+    };
+
+    // Return a shared texture loaded from a file, see Texture::createTexture()
+    std::shared_ptr<Texture> texture(const std::string& filename);
+
+    // Return a shared mesh loaded from an OBJ file, see TriangleSoup::readOBJ()
+    std::shared_ptr<TriangleSoup> mesh(const std::string& filename);
+
+    Stats stats() const;
+
+private:
+    // Files with a different size or content hash differ, others are compared to be sure
+    struct ContentKey {
+        std::uint64_t size;
+        std::uint64_t hash[2];
+        bool operator<(const ContentKey& other) const {
+            if (size != other.size) {
+                return size < other.size;
+            }
+            return (hash[0] != other.hash[0]) ? hash[0] < other.hash[0]
+                                              : hash[1] < other.hash[1];
+        }
+    };
+
+    // An object and the file it was loaded from, to compare the contents of a new file with
+    template <typename T>
+    struct ContentEntry {
+        std::string path;
+        std::weak_ptr<T> resource;
+    };
+
+    template <typename T>
+    struct Registry {
+        std::unordered_map<std::string, std::weak_ptr<T>> byPath;  // Canonical path lookup
+        std::map<ContentKey, ContentEntry<T>> byContent;           // One entry per object
+    };
+
+    // Look a file up by path, then by content, and call load() only if both miss
+    template <typename T, typename Load>
+    std::shared_ptr<T> acquire(Registry<T>& registry, const std::string& filename, Load load);
+
+    // Drop the entries of objects whose last handle has been released
+    template <typename T>
+    static void prune(Registry<T>& registry);
+
+    template <typename T>
+    static void addResident(const Registry<T>& registry, Stats& stats);
+
+    static std::string canonicalPath(const std::string& filename);
+
+    // Hash the contents of a file, returns false if it can not be read
+    static bool contentKey(const std::string& filename, ContentKey& key);
+
+    // Compare two files byte by byte, returns false if they differ or can not be read
+    static bool sameContents(const std::string& filename1, const std::string& filename2);
+
+    Registry<Texture> textures_;
+    Registry<TriangleSoup> meshes_;
+    Stats stats_;
+};
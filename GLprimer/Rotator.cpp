@@ -55,7 +55,15 @@ double KeyRotator::phi() const { return phi_; }
 double KeyRotator::theta() const { return theta_; }
 
 MouseRotator::MouseRotator(GLFWwindow* window)
-    : window_(window), phi_(0.0), theta_(0.0), leftPressed_(false), rightPressed_(false) {
+    : window_(window),
+      phi_(0.0),
+      theta_(0.0),
+      leftPressed_(false),
+      rightPressed_(false),
+      pressX_(0.0),
+      pressY_(0.0),
+      dragged_(false),
+      clicked_(false) {
     glfwGetCursorPos(window, &lastX_, &lastY_);
 }
 
@@ -92,6 +100,17 @@ void MouseRotator::poll() {
         }
     }
 
+    // A press and release with the cursor staying close to where it went down is a click
+    if (currentLeft && !leftPressed_) {
+        pressX_ = currentX;
+        pressY_ = currentY;
+        dragged_ = false;
+    }
+    if (currentLeft && std::hypot(currentX - pressX_, currentY - pressY_) >= clickDistance) {
+        dragged_ = true;
+    }
+    clicked_ = !currentLeft && leftPressed_ && !dragged_;
+
     leftPressed_ = currentLeft;
     rightPressed_ = currentRight;
     lastX_ = currentX;
@@ -101,3 +120,9 @@ void MouseRotator::poll() {
 double MouseRotator::phi() const { return phi_; }
 
 double MouseRotator::theta() const { return theta_; }
+
+double MouseRotator::x() const { return lastX_; }
+
+double MouseRotator::y() const { return lastY_; }
+
+bool MouseRotator::clicked() const { return clicked_; }
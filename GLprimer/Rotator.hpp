@@ -5,6 +5,8 @@
  * Usage: call init() before the rendering loop, call poll() once per frame,
  * read public members phi and theta to construct a rotation matrix.
  * The suggested composite rotation matrix is RotX(theta)*RotY(phi).
+ * clicked() is true in the frame the left button is released without a drag,
+ * and x() and y() give the cursor position, for picking what was clicked.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2013-2015
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -32,6 +34,9 @@ private:
 
 class MouseRotator {
 public:
+    // Presses that move the cursor less than this many pixels are clicks, not drags
+    static constexpr double clickDistance = 3.0;
+
     MouseRotator(GLFWwindow* window);
 
     void poll();
@@ -39,6 +44,11 @@ public:
     double phi() const;
     double theta() const;
 
+    // Cursor position in pixels from the top left corner of the window, as of the last poll()
+    double x() const;
+    double y() const;
+    bool clicked() const;
+
 private:
     GLFWwindow* window_;
 
@@ -49,4 +59,9 @@ private:
     double lastY_;
     bool leftPressed_;
     bool rightPressed_;
+
+    double pressX_;  // Where the left button went down
+    double pressY_;
+    bool dragged_;  // The cursor moved too far since then for a click
+    bool clicked_;
 };
@@ -10,24 +10,27 @@
 #include <GLFW/glfw3.h>
 
 #include "Shader.hpp"
+#include "GLState.hpp"
+#include "Trace.hpp"
 
 #include <iostream>
 #include <fstream>
 
 Shader::Shader() : programID_(0) {}
 
-Shader::Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile) {
+Shader::Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile)
+    : programID_(0) {
     createShader(vertexshaderfile, fragmentshaderfile);
 }
 
 Shader::~Shader() {
-    if (programID_ != 0) {
-        glDeleteProgram(programID_);  // free program resources
-    }
+    GLState::deleteProgram(programID_);  // free program resources
 }
 
 GLuint Shader::id() const { return programID_; }
 
+void Shader::use() const { GLState::useProgram(programID_); }
+
 std::string readFile(const std::string& filename) {
     std::ifstream in(filename.c_str());
     if (!in.is_open()) {
@@ -78,10 +81,9 @@ GLuint loadShader(GLenum shaderType, const std::string& filename) {
 
 void Shader::createShader(const std::string& vertexshaderfile,
                           const std::string& fragmentshaderfile) {
+    TRACE_ZONE("Shader::createShader");
     // If a program is already stored in this object, delete it
-    if (programID_ != 0) {
-        glDeleteProgram(programID_);
-    }
+    GLState::deleteProgram(programID_);
 
     // Create the vertex shader.
     GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexshaderfile);
@@ -3,7 +3,7 @@
  *
  * Usage: call createShader() to load and compile a program object
  * or use the constructor with two filenames.
- * Call glUseProgram() with the public member programID as argument.
+ * Call use() to make it the current program.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -31,6 +31,9 @@ public:
 
     GLuint id() const;
 
+    // Make this the current program, through GLState
+    void use() const;
+
 private:
     GLuint programID_;
 };
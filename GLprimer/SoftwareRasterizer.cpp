@@ -0,0 +1,485 @@
+/*
+ * A CPU renderer for triangle meshes, for machines without a GPU.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "SoftwareRasterizer.hpp"
+#include "Mesh.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFTWARERASTERIZER_USE_SSE2
+#endif
+
+namespace {
+
+const size_t verticesPerJob = 4096;
+const size_t trianglesPerJob = 4096;
+
+// out = m * in, with m column major
+void transform(const std::array<GLfloat, 16>& m, const float in[4], float out[4]) {
+    for (int row = 0; row < 4; row++) {
+        out[row] = m[row] * in[0] + m[4 + row] * in[1] + m[8 + row] * in[2] + m[12 + row] * in[3];
+    }
+}
+
+void normalize(float v[3]) {
+    const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+float clamp01(float value) { return std::min(std::max(value, 0.0f), 1.0f); }
+
+GLubyte toByte(float value) { return static_cast<GLubyte>(clamp01(value) * 255.0f + 0.5f); }
+
+float evaluate(const float plane[3], float x, float y) {
+    return plane[0] + plane[1] * x + plane[2] * y;
+}
+
+}  // namespace
+
+SoftwareRasterizer::Sampler::Sampler(const Image& image)
+    : width_(static_cast<int>(image.width)), height_(static_cast<int>(image.height)) {
+    Image rgb = image;
+    Image::convertToRGB(rgb);
+    const size_t pixelCount = static_cast<size_t>(width_) * height_;
+    const size_t bytesPerPixel = (rgb.type == GL_RGBA) ? 4 : 3;
+    if (rgb.data.size() < pixelCount * bytesPerPixel) {
+        width_ = 0;
+        height_ = 0;
+        return;
+    }
+    texels_.resize(pixelCount * 4);
+    for (size_t i = 0; i < pixelCount; i++) {
+        texels_[4 * i + 0] = rgb.data[bytesPerPixel * i + 0];
+        texels_[4 * i + 1] = rgb.data[bytesPerPixel * i + 1];
+        texels_[4 * i + 2] = rgb.data[bytesPerPixel * i + 2];
+        texels_[4 * i + 3] = (bytesPerPixel == 4) ? rgb.data[bytesPerPixel * i + 3] : 255;
+    }
+}
+
+/* Bilinear filtering between the four nearest texel centers, wrapping around the edges like
+ * GL_REPEAT. An empty sampler is white. */
+std::array<float, 4> SoftwareRasterizer::Sampler::sample(float s, float t) const {
+    if (texels_.empty() || !std::isfinite(s) || !std::isfinite(t)) {
+        return {{1.0f, 1.0f, 1.0f, 1.0f}};
+    }
+    const float u = (s - std::floor(s)) * width_ - 0.5f;
+    const float v = (t - std::floor(t)) * height_ - 0.5f;
+    const float u0 = std::floor(u);
+    const float v0 = std::floor(v);
+    const float fu = u - u0;
+    const float fv = v - v0;
+    const int x0 = (static_cast<int>(u0) + width_) % width_;
+    const int y0 = (static_cast<int>(v0) + height_) % height_;
+    const int x1 = (x0 + 1) % width_;
+    const int y1 = (y0 + 1) % height_;
+    const GLubyte* t00 = &texels_[4 * (static_cast<size_t>(y0) * width_ + x0)];
+    const GLubyte* t10 = &texels_[4 * (static_cast<size_t>(y0) * width_ + x1)];
+    const GLubyte* t01 = &texels_[4 * (static_cast<size_t>(y1) * width_ + x0)];
+    const GLubyte* t11 = &texels_[4 * (static_cast<size_t>(y1) * width_ + x1)];
+    std::array<float, 4> color;
+    for (int c = 0; c < 4; c++) {
+        const float top = t00[c] + (t10[c] - t00[c]) * fu;
+        const float bottom = t01[c] + (t11[c] - t01[c]) * fu;
+        color[c] = (top + (bottom - top) * fv) / 255.0f;
+    }
+    return color;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(GLuint width, GLuint height, unsigned numThreads)
+    : width_(width)
+    , height_(height)
+    , depthStride_((width + 3) & ~3u)
+    , tilesX_(static_cast<int>((width + tileSize - 1) / tileSize))
+    , tilesY_(static_cast<int>((height + tileSize - 1) / tileSize))
+    , culling_(true)
+    , color_(static_cast<size_t>(width) * height * 4)
+    , depth_(static_cast<size_t>(depthStride_) * height)
+    , bins_(static_cast<size_t>(tilesX_) * tilesY_)
+    , pool_(numThreads) {
+    clear(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+void SoftwareRasterizer::clear(float r, float g, float b, float a) {
+    const GLubyte rgba[4] = {toByte(r), toByte(g), toByte(b), toByte(a)};
+    for (size_t i = 0; i < color_.size(); i += 4) {
+        std::copy(rgba, rgba + 4, &color_[i]);
+    }
+    std::fill(depth_.begin(), depth_.end(), 1.0f);
+    stats_ = Stats();
+}
+
+bool SoftwareRasterizer::draw(const Mesh& mesh, const std::array<GLfloat, 16>& MV,
+                              const std::array<GLfloat, 16>& P, const std::array<GLfloat, 16>& T,
+                              const Sampler& texture) {
+    TRACE_ZONE("SoftwareRasterizer::draw");
+    const size_t vertexCount = static_cast<size_t>(mesh.vertexCount());
+    const size_t triangleCount = static_cast<size_t>(mesh.triangleCount());
+    if (mesh.empty() || triangleCount == 0 || mesh.vertices().size() < 8 * vertexCount ||
+        mesh.indices().size() < 3 * triangleCount) {
+        std::cerr << "Software rendering needs a mesh with vertex and index arrays and at "
+                     "least one triangle\n";
+        return false;
+    }
+    if (width_ == 0 || height_ == 0) {
+        return true;
+    }
+
+    // Vertex stage, like vertex_frame.glsl
+    vertices_.resize(vertexCount);
+    for (size_t first = 0; first < vertexCount; first += verticesPerJob) {
+        const size_t last = std::min(first + verticesPerJob, vertexCount);
+        pool_.enqueue([this, &mesh, &MV, &P, first, last]() {
+            const GLfloat* in = mesh.vertices().data();
+            for (size_t i = first; i < last; i++) {
+                const GLfloat* v = in + 8 * i;
+                const float position[4] = {v[0], v[1], v[2], 1.0f};
+                float eye[4];
+                transform(MV, position, eye);
+                Vertex& out = vertices_[i];
+                transform(P, eye, out.clip);
+                // vec3(MV) in the shader is the first column of MV, not its upper 3x3
+                out.normal[0] = MV[0] * v[3];
+                out.normal[1] = MV[1] * v[4];
+                out.normal[2] = MV[2] * v[5];
+                normalize(out.normal);
+                out.st[0] = v[6];
+                out.st[1] = v[7];
+            }
+        });
+    }
+    pool_.wait();
+
+    // Clip, cull and set up the triangles
+    const size_t jobCount = (triangleCount + trianglesPerJob - 1) / trianglesPerJob;
+    chunks_.resize(jobCount);
+    std::atomic<size_t> culled(0);
+    for (size_t job = 0; job < jobCount; job++) {
+        pool_.enqueue([this, &mesh, &culled, job, triangleCount]() {
+            const GLuint* indices = mesh.indices().data();
+            std::vector<Setup>& out = chunks_[job];
+            out.clear();
+            size_t jobCulled = 0;
+            const size_t last = std::min((job + 1) * trianglesPerJob, triangleCount);
+            for (size_t i = job * trianglesPerJob; i < last; i++) {
+                const size_t before = out.size();
+                setupTriangle(vertices_[indices[3 * i]], vertices_[indices[3 * i + 1]],
+                              vertices_[indices[3 * i + 2]], out);
+                if (out.size() == before) {
+                    jobCulled++;
+                }
+            }
+            culled.fetch_add(jobCulled, std::memory_order_relaxed);
+        });
+    }
+    pool_.wait();
+
+    // Bin the triangles into the tiles they overlap, in submission order
+    triangles_.clear();
+    for (std::vector<unsigned>& bin : bins_) {
+        bin.clear();
+    }
+    for (const std::vector<Setup>& chunk : chunks_) {
+        for (const Setup& setup : chunk) {
+            const unsigned index = static_cast<unsigned>(triangles_.size());
+            triangles_.push_back(setup);
+            for (int ty = setup.minY / tileSize; ty <= setup.maxY / tileSize; ty++) {
+                for (int tx = setup.minX / tileSize; tx <= setup.maxX / tileSize; tx++) {
+                    bins_[ty * tilesX_ + tx].push_back(index);
+                }
+            }
+        }
+    }
+
+    // Light direction of fragment.glsl, constant for the draw
+    std::array<float, 3> light;
+    for (int row = 0; row < 3; row++) {
+        light[row] = T[4 + row] * 0.1f + T[8 + row] * 1.0f;
+    }
+    normalize(light.data());
+
+    // Each tile is rasterized by one job, so the triangles of a tile keep their order
+    std::atomic<size_t> pixels(0);
+    for (int tile = 0; tile < tilesX_ * tilesY_; tile++) {
+        if (bins_[tile].empty()) {
+            continue;
+        }
+        pool_.enqueue([this, &pixels, &texture, &light, tile]() {
+            pixels.fetch_add(rasterizeTile(tile, texture, light), std::memory_order_relaxed);
+        });
+    }
+    pool_.wait();
+
+    stats_.triangles += triangleCount;
+    stats_.culled += culled.load();
+    stats_.pixels += pixels.load();
+    return true;
+}
+
+/* Clip the triangle against the near plane z > -w, which leaves zero, one or two triangles.
+ * The other planes need no clipping, the tiles only cover the image and the depth test
+ * rejects what is beyond the far plane. */
+void SoftwareRasterizer::setupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+                                       std::vector<Setup>& out) const {
+    const Vertex* in[3] = {&v0, &v1, &v2};
+    float distance[3];
+    int insideCount = 0;
+    for (int i = 0; i < 3; i++) {
+        distance[i] = in[i]->clip[2] + in[i]->clip[3];
+        insideCount += (distance[i] >= 0.0f) ? 1 : 0;
+    }
+    if (insideCount == 3) {
+        setupClipped(in, out);
+        return;
+    }
+    if (insideCount == 0) {
+        return;
+    }
+
+    Vertex polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; i++) {
+        const int j = (i + 1) % 3;
+        if (distance[i] >= 0.0f) {
+            polygon[count++] = *in[i];
+        }
+        if ((distance[i] >= 0.0f) != (distance[j] >= 0.0f)) {
+            const float f = distance[i] / (distance[i] - distance[j]);
+            Vertex& v = polygon[count++];
+            for (int k = 0; k < 4; k++) {
+                v.clip[k] = in[i]->clip[k] + (in[j]->clip[k] - in[i]->clip[k]) * f;
+            }
+            for (int k = 0; k < 3; k++) {
+                v.normal[k] = in[i]->normal[k] + (in[j]->normal[k] - in[i]->normal[k]) * f;
+            }
+            for (int k = 0; k < 2; k++) {
+                v.st[k] = in[i]->st[k] + (in[j]->st[k] - in[i]->st[k]) * f;
+            }
+        }
+    }
+    for (int i = 2; i < count; i++) {
+        const Vertex* fan[3] = {&polygon[0], &polygon[i - 1], &polygon[i]};
+        setupClipped(fan, out);
+    }
+}
+
+/* Project the triangle to pixels, cull it and compute its edge functions and attribute
+ * planes. The edges and planes are computed in double precision, since the triangles can
+ * extend far outside of the image. */
+void SoftwareRasterizer::setupClipped(const Vertex* v[3], std::vector<Setup>& out) const {
+    double x[3], y[3], attributes[3][7];
+    for (int i = 0; i < 3; i++) {
+        const double invW = 1.0 / v[i]->clip[3];
+        // Window coordinates with y down, so row 0 is the top of the image
+        x[i] = (v[i]->clip[0] * invW * 0.5 + 0.5) * width_;
+        y[i] = (0.5 - v[i]->clip[1] * invW * 0.5) * height_;
+        attributes[i][0] = v[i]->clip[2] * invW * 0.5 + 0.5;
+        attributes[i][1] = invW;
+        attributes[i][2] = v[i]->st[0] * invW;
+        attributes[i][3] = v[i]->st[1] * invW;
+        attributes[i][4] = v[i]->normal[0] * invW;
+        attributes[i][5] = v[i]->normal[1] * invW;
+        attributes[i][6] = v[i]->normal[2] * invW;
+    }
+
+    // Counterclockwise front faces in GL are clockwise with y down, with a negative area
+    double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(area != 0.0) || (culling_ && area > 0.0)) {
+        return;
+    }
+    int order[3] = {0, 1, 2};
+    if (area < 0.0) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    Setup setup;
+    const double limit = 1e9;  // Keeps the bounds within int before they are clamped
+    const double minX = std::max(std::min({x[0], x[1], x[2]}), -limit);
+    const double maxX = std::min(std::max({x[0], x[1], x[2]}), limit);
+    const double minY = std::max(std::min({y[0], y[1], y[2]}), -limit);
+    const double maxY = std::min(std::max({y[0], y[1], y[2]}), limit);
+    // Pixel centers are at half coordinates
+    setup.minX = std::max(static_cast<int>(std::ceil(minX - 0.5)), 0);
+    setup.maxX = std::min(static_cast<int>(std::floor(maxX - 0.5)), static_cast<int>(width_) - 1);
+    setup.minY = std::max(static_cast<int>(std::ceil(minY - 0.5)), 0);
+    setup.maxY = std::min(static_cast<int>(std::floor(maxY - 0.5)), static_cast<int>(height_) - 1);
+    if (setup.minX > setup.maxX || setup.minY > setup.maxY) {
+        return;
+    }
+
+    // Edge e is opposite to vertex e, and is positive on its side
+    double A[3], B[3], C[3];
+    for (int e = 0; e < 3; e++) {
+        const int a = order[(e + 1) % 3];
+        const int b = order[(e + 2) % 3];
+        A[e] = y[a] - y[b];
+        B[e] = x[b] - x[a];
+        C[e] = x[a] * y[b] - x[b] * y[a];
+        setup.edge[e][0] = static_cast<float>(A[e]);
+        setup.edge[e][1] = static_cast<float>(B[e]);
+        setup.edge[e][2] = static_cast<float>(C[e]);
+        // Pixels on a top or left edge belong to the triangle, like in GL
+        const bool topLeft = A[e] > 0.0 || (A[e] == 0.0 && B[e] > 0.0);
+        setup.bias[e] = topLeft ? 0.0f : std::numeric_limits<float>::denorm_min();
+    }
+    // Barycentric weight of vertex e is edge e over the area
+    for (int k = 0; k < 7; k++) {
+        double plane[3] = {0.0, 0.0, 0.0};
+        for (int e = 0; e < 3; e++) {
+            const double value = attributes[order[e]][k] / area;
+            plane[0] += value * C[e];
+            plane[1] += value * A[e];
+            plane[2] += value * B[e];
+        }
+        for (int c = 0; c < 3; c++) {
+            setup.plane[k][c] = static_cast<float>(plane[c]);
+        }
+    }
+    out.push_back(setup);
+}
+
+/* Walk the pixels of each triangle in the tile four at a time, test them against the edges
+ * and the depth buffer, and shade the ones that pass like fragment.glsl */
+size_t SoftwareRasterizer::rasterizeTile(int tile, const Sampler& texture,
+                                         const std::array<float, 3>& light) {
+    const int tileX = (tile % tilesX_) * tileSize;
+    const int tileY = (tile / tilesX_) * tileSize;
+    const int tileMaxX = std::min(tileX + tileSize, static_cast<int>(width_)) - 1;
+    const int tileMaxY = std::min(tileY + tileSize, static_cast<int>(height_)) - 1;
+    float view[3] = {-0.4f, -0.4f, -1.0f};
+    normalize(view);
+    size_t shaded = 0;
+
+    for (unsigned index : bins_[tile]) {
+        const Setup& setup = triangles_[index];
+        const int startX = std::max(setup.minX, tileX) & ~3;  // Aligned with the depth rows
+        const int endX = std::min(setup.maxX, tileMaxX);
+        const int startY = std::max(setup.minY, tileY);
+        const int endY = std::min(setup.maxY, tileMaxY);
+
+        for (int y = startY; y <= endY; y++) {
+            const float py = y + 0.5f;
+            float* depthRow = &depth_[static_cast<size_t>(y) * depthStride_];
+            for (int x = startX; x <= endX; x += 4) {
+                // Bit i is set for pixel x + i if it is inside and closer than the depth buffer
+                unsigned mask = 0;
+#ifdef SOFTWARERASTERIZER_USE_SSE2
+                const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)),
+                                             _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+                __m128 inside = _mm_cmplt_ps(px, _mm_set1_ps(endX + 1.0f));
+                for (int e = 0; e < 3; e++) {
+                    const __m128 value = _mm_add_ps(
+                        _mm_mul_ps(_mm_set1_ps(setup.edge[e][0]), px),
+                        _mm_set1_ps(setup.edge[e][1] * py + setup.edge[e][2]));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(value, _mm_set1_ps(setup.bias[e])));
+                }
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(setup.plane[0][1]), px),
+                                            _mm_set1_ps(setup.plane[0][0] +
+                                                        setup.plane[0][2] * py));
+                const __m128 stored = _mm_loadu_ps(depthRow + x);
+                const __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, stored));
+                mask = static_cast<unsigned>(_mm_movemask_ps(pass));
+                if (mask == 0) {
+                    continue;
+                }
+                _mm_storeu_ps(depthRow + x,
+                             _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+#else
+                for (int i = 0; i < 4 && x + i <= endX; i++) {
+                    const float px = x + i + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++) {
+                        const float value =
+                            setup.edge[e][0] * px + setup.edge[e][1] * py + setup.edge[e][2];
+                        inside = inside && value >= setup.bias[e];
+                    }
+                    const float z = evaluate(setup.plane[0], px, py);
+                    if (inside && z < depthRow[x + i]) {
+                        depthRow[x + i] = z;
+                        mask |= 1u << i;
+                    }
+                }
+#endif
+                for (int i = 0; i < 4; i++) {
+                    if (!(mask & (1u << i))) {
+                        continue;
+                    }
+                    const float px = x + i + 0.5f;
+                    const float w = 1.0f / evaluate(setup.plane[1], px, py);
+                    const float s = evaluate(setup.plane[2], px, py) * w;
+                    const float t = evaluate(setup.plane[3], px, py) * w;
+                    float normal[3];
+                    for (int k = 0; k < 3; k++) {
+                        normal[k] = evaluate(setup.plane[4 + k], px, py) * w;
+                    }
+
+                    // Phong shading of fragment.glsl, the normal is not normalized again
+                    const std::array<float, 4> texel = texture.sample(s, t);
+                    const float dotNLSigned =
+                        normal[0] * light[0] + normal[1] * light[1] + normal[2] * light[2];
+                    const float dotNL = std::max(dotNLSigned, 0.0f);
+                    float dotRV = 0.0f;
+                    for (int k = 0; k < 3; k++) {
+                        dotRV += (2.0f * dotNLSigned * normal[k] - light[k]) * view[k];
+                    }
+                    dotRV = (dotNL == 0.0f) ? 0.0f : std::max(dotRV, 0.0f);
+                    const float specular = 0.9f * 0.1f * std::pow(dotRV, 100.0f);
+
+                    GLubyte* pixel =
+                        &color_[4 * (static_cast<size_t>(y) * width_ + x + i)];
+                    for (int c = 0; c < 3; c++) {
+                        const float shadedColor =
+                            0.5f * 0.9f * texel[c] + 0.8f * texel[c] * dotNL + specular;
+                        pixel[c] = toByte(shadedColor * texel[c]);
+                    }
+                    pixel[3] = toByte(texel[3]);
+                    shaded++;
+                }
+            }
+        }
+    }
+    return shaded;
+}
+
+Image SoftwareRasterizer::image() const {
+    Image image;
+    image.width = width_;
+    image.height = height_;
+    image.type = GL_RGBA;
+    image.format = GL_RGBA;
+    image.data = color_;
+    return image;
+}
+
+bool SoftwareRasterizer::write(const std::string& filename) const {
+    return Image::writeQOI(filename, image());
+}
+
+std::string SoftwareRasterizer::throughput(const Stats& stats, double seconds) {
+    char text[100];
+    if (seconds <= 0.0) {
+        return "no time measured";
+    }
+    snprintf(text, sizeof(text), "%.2f Mtris/s, %.2f Mpixels/s",
+             stats.triangles / seconds / 1e6, stats.pixels / seconds / 1e6);
+    return text;
+}
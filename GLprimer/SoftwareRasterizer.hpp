@@ -0,0 +1,128 @@
+/*
+ * A CPU renderer for triangle meshes, for machines without a GPU.
+ *
+ * Usage: Create a rasterizer with the size of the image, clear() it, and draw() meshes with
+ *        the same matrices that GLprimer passes to vertex.glsl. A draw transforms and lights
+ *        the vertices like vertex.glsl and fragment.glsl: Phong shading with one light,
+ *        modulated by a bilinear sampled texture. The image is split into tiles that are
+ *        rasterized in parallel on a ThreadPool, with edge functions tested four pixels at a
+ *        time with SSE2 and a depth buffer. Triangles are clipped against the near plane and
+ *        back faces are culled like GL_CULL_FACE. draw() takes a Mesh, or the mesh() of a
+ *        TriangleSoup made after setKeepCPUCopy(true). image() returns the colors with the
+ *        top row first, and write() saves them as a QOI file. stats() counts the triangles
+ *        and pixels drawn since the last clear().
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <array>
+#include <string>
+#include <vector>
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+
+class Mesh;
+
+class SoftwareRasterizer {
+public:
+    static const int tileSize = 64;
+
+    // An image converted to RGBA for sampling, with GL_REPEAT wrapping and bilinear filtering
+    class Sampler {
+    public:
+        Sampler() = default;
+        explicit Sampler(const Image& image);
+
+        // The color at texture coordinates (s, t), row 0 of the image is at t = 0 like in GL
+        std::array<float, 4> sample(float s, float t) const;
+
+        bool empty() const { return texels_.empty(); }
+
+    private:
+        int width_ = 0;
+        int height_ = 0;
+        std::vector<GLubyte> texels_;
+    };
+
+    struct Stats {
+        size_t triangles = 0;  // Submitted to draw()
+        size_t culled = 0;     // Back facing, behind the near plane or outside the image
+        size_t pixels = 0;     // Pixels that passed the depth test and were shaded
+    };
+
+    /* Constructor: an image of width x height pixels, rendered by numThreads threads, 0 means
+     * one per hardware thread */
+    SoftwareRasterizer(GLuint width, GLuint height, unsigned numThreads = 0);
+
+    SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+    GLuint width() const { return width_; }
+    GLuint height() const { return height_; }
+
+    // Set every pixel to the color and the depth to the far plane, and reset the stats
+    void clear(float r, float g, float b, float a);
+
+    void setCulling(bool cull) { culling_ = cull; }
+
+    // Draw the mesh with the modelview, projection and light matrices of vertex.glsl, column
+    // major like GL. Returns false if the mesh has no triangles or no vertex and index
+    // arrays, like the mesh() of a TriangleSoup that dropped its copy.
+    bool draw(const Mesh& mesh, const std::array<GLfloat, 16>& MV,
+              const std::array<GLfloat, 16>& P, const std::array<GLfloat, 16>& T,
+              const Sampler& texture);
+
+    // The rendered RGBA image, top row first
+    Image image() const;
+
+    bool write(const std::string& filename) const;
+
+    Stats stats() const { return stats_; }
+
+    // Triangles per second and pixels per second as "12.3 Mtris/s, 45.6 Mpixels/s"
+    static std::string throughput(const Stats& stats, double seconds);
+
+private:
+    // A vertex after the vertex shader
+    struct Vertex {
+        float clip[4];    // Clip coordinates
+        float normal[3];  // Eye space normal
+        float st[2];
+    };
+
+    // A triangle ready for the tiles: edge functions and attribute planes over pixel positions
+    struct Setup {
+        float edge[3][3];   // A x + B y + C >= bias inside
+        float bias[3];      // 0 for top-left edges, the smallest float above 0 for the others
+        float plane[7][3];  // Depth, 1/w, s/w, t/w and normal/w as a + dx x + dy y
+        int minX, minY, maxX, maxY;
+    };
+
+    // Clip, cull and set up one triangle, appending zero to two triangles to out
+    void setupTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+                       std::vector<Setup>& out) const;
+    void setupClipped(const Vertex* v[3], std::vector<Setup>& out) const;
+
+    // Rasterize and shade the binned triangles of one tile, returns the pixels shaded
+    size_t rasterizeTile(int tile, const Sampler& texture, const std::array<float, 3>& light);
+
+    GLuint width_;
+    GLuint height_;
+    GLuint depthStride_;  // Width rounded up to four pixels
+    int tilesX_;
+    int tilesY_;
+    bool culling_;
+    std::vector<GLubyte> color_;  // RGBA, top row first
+    std::vector<float> depth_;    // Window depth from 0 to 1
+
+    // Scratch arrays of a draw
+    std::vector<Vertex> vertices_;              // Vertex shader outputs
+    std::vector<std::vector<Setup>> chunks_;    // Triangles set up by each job
+    std::vector<Setup> triangles_;              // All triangles set up, in submission order
+    std::vector<std::vector<unsigned>> bins_;   // Indices into triangles_ for each tile
+    Stats stats_;
+    ThreadPool pool_;
+};
@@ -7,24 +7,46 @@
  * This code is in the public domain.
  */
 #include <cstdio>   // For file I/O
-#include <cstring>  // For memcmp()
+#include <cstring>  // For memcmp(), memcpy() and memset()
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <array>
+#include <cmath>
 
 #include <GL/glew.h>
 
 #include "Texture.hpp"
+#include "GLState.hpp"
+#include "MemoryTracker.hpp"
+#include "MappedFile.hpp"
+#include "ResidencyManager.hpp"
+#include "TextureStreamer.hpp"
+#include "Trace.hpp"
 
 /* Constructor to load and intialize the texture all at once */
-Texture::Texture(const std::string& filename) : textureID_(0) { createTexture(filename); }
+Texture::Texture(const std::string& filename)
+    : textureID_(0)
+    , target_(GL_TEXTURE_2D)
+    , layers_(0)
+    , levels_(0)
+    , internalFormat_(0)
+    , sizeInBytes_(0)
+    , streamer_(nullptr)
+    , residency_(nullptr) {
+    createTexture(filename);
+}
 
 /* Destructor */
 Texture::~Texture() {
-    if (textureID_ != 0) {
-        glDeleteTextures(1, &textureID_);
+    if (streamer_) {
+        streamer_->cancel(this);
+    }
+    if (residency_) {
+        residency_->remove(*this);
     }
+    GLState::deleteTexture(textureID_);
+    MemoryTracker::track(MemoryTracker::Textures, sizeInBytes_, 0);
 }
 
 GLuint Texture::id() const { return textureID_; }
@@ -35,130 +57,852 @@ GLuint Texture::height() const { return image_.height; }
 
 GLuint Texture::type() const { return image_.type; }
 
+GLenum Texture::target() const { return target_; }
+
+GLuint Texture::layers() const { return layers_; }
+
+size_t Texture::sizeInBytes() const { return sizeInBytes_; }
+
+void Texture::bind() {
+    if (residency_) {
+        residency_->use(*this);  // Reloads the texture if it has been evicted
+    }
+    GLState::bindTexture(target_, textureID_);
+}
+
+namespace {
+
+void logDownscale(const std::string& filename, GLuint width, GLuint height, GLuint newWidth,
+                  GLuint newHeight) {
+    std::cout << "Texture downscaled from " << width << "x" << height << " to " << newWidth
+              << "x" << newHeight << " ('" << filename << "')\n";
+}
+
+}  // namespace
+
+
+/* Options shared by all texture loads */
+Texture::LoadOptions& Texture::loadOptions() {
+    static LoadOptions options;
+    return options;
+}
+
 /*
- * Open and test the file to make sure it is a valid TGA file
+ * Load and activate a 2D texture from a TGA file.
  *
- * roughly based on NeHe's TGA loading code
+ * With LoadOptions::cpuMipmaps set (the default), the mipmap chain is taken from the cache
+ * file next to the texture, or built on the CPU and written to the cache on the first load.
+ * The levels are then copied from the mapped cache file into a pixel unpack buffer, like
+ * the pixels of an image file, and never held in a heap allocation.
+ * Otherwise, the level 0 pixels are uploaded and GL generates the other levels.
  */
-Texture::ImageData Texture::loadUncompressedTGA(const std::string& filename) const {
-    std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+void Texture::createTexture(const std::string& filename) {
+    TRACE_ZONE("Texture::createTexture");
+    if (streamer_) {
+        streamer_->cancel(this);  // A synchronous load replaces any pending asynchronous one
+    }
+    image_ = Image();
+    filename_ = filename;
+
+    if (Image::hasExtension(filename, ".dds")) {
+        createTextureDDS(filename);
+        return;
+    }
+    if (Image::hasExtension(filename, ".ktx2")) {
+        createTextureKTX2(filename);
+        return;
+    }
 
-    if (!in.is_open()) {
+    if (loadOptions().cpuMipmaps) {
+        const MipChain chain = loadMipChain(filename);
+        const MemoryTracker::Allocation decoded(MemoryTracker::DecodedImages,
+                                                chain.isMapped() ? 0 : chain.totalSize());
+        if (!chain.empty()) {
+            uploadLevels(chain);
+        }
+        return;
+    }
+
+    // The file is memory mapped and its pixels are copied (or RLE or QOI decoded) straight
+    // into a mapped pixel unpack buffer, so the image is never held in a heap allocation.
+    MappedFile file(filename);
+    if (!file.isOpen()) {
         std::cerr << "Could not open texture file ('" << filename << "')\n";
-        return {};  // return an empty image
+        return;
     }
 
-    // Attempt to read 12 byte file header
-    std::array<char, 12> tgaheader;
+    bool compressed = false;
+    const bool qoi = Image::hasExtension(filename, ".qoi");
+    const size_t dataOffset =
+        qoi ? Image::parseQOIHeader(file.data(), file.size(), filename, image_)
+            : Image::parseTGAHeader(file.data(), file.size(), filename, image_, compressed);
+    if (dataOffset == 0) {
+        image_ = Image();
+        return;
+    }
+    if (skippedLevels(image_.width, image_.height, fullMipLevels(image_.width, image_.height))) {
+        // The image has to be resampled on the CPU before it can be uploaded
+        file.close();
+        Image image = Image::load(filename);
+        MemoryTracker::Allocation decoded(MemoryTracker::DecodedImages, image.data.size());
+        downscale(image, filename);
+        decoded.resize(image.data.size());
+        uploadImage(image);
+        return;
+    }
+
+    const GLuint bytesPerPixel = (image_.type == GL_RGBA) ? 4 : 3;
+    const size_t pixelCount = static_cast<size_t>(image_.width) * image_.height;
+    const size_t imageSize = pixelCount * bytesPerPixel;
+    const GLubyte* pixels = file.data() + dataOffset;
+    const size_t available = file.size() - dataOffset;
 
-    in.read(tgaheader.data(), sizeof(tgaheader));
-    if (in.fail()) {
-        std::cerr << "Could not read file header ('" << filename << "')\n";
-        return {};  // return an empty image
+    if (!compressed && !qoi && available < imageSize) {
+        std::cerr << "Could not read image data ('" << filename << "')\n";
+        image_ = Image();
+        return;
     }
 
-    // headers for compressed and uncompressed TGAs
-    const std::array<char, 12> uncompressedTGA = {{0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
-    const std::array<char, 12> compressedTGA = {{0, 0, 10, 0, 0, 0, 0, 0, 0, 0, 0, 0}};
+    std::cout << "Texture type is " << (image_.type == GL_RGBA ? "GL_RGBA" : "GL_RGB")
+              << (compressed ? ", RLE compressed" : "") << (qoi ? ", QOI compressed" : "")
+              << " ('" << filename << "')\n";
 
-    if (tgaheader == compressedTGA) {
-        std::cerr << "RLE compressed TGA files are not supported ('" << filename << "')\n";
-        return {};
-    } else if (tgaheader != uncompressedTGA) {
-        std::cerr << "Unsupported image file format ('" << filename << "')\n";
-        return {};
+    allocateStorage(fullMipLevels(image_.width, image_.height), sizedFormat(image_.type));
+
+    GLuint pbo = 0;
+    GLubyte* staging = mapUnpackBuffer(imageSize, pbo);
+    bool valid = (staging != nullptr);
+    if (valid) {
+        if (qoi) {
+            valid = (Image::decodeQOI(pixels, available, staging, pixelCount, bytesPerPixel) ==
+                     pixelCount);
+        } else if (compressed) {
+            valid = (Image::decodeRLE(pixels, available, staging, pixelCount, bytesPerPixel) ==
+                     pixelCount);
+        } else {
+            std::memcpy(staging, pixels, imageSize);
+        }
     }
+    valid = unmapUnpackBuffer(pbo) && valid;
 
-    std::array<GLubyte, 6> header;  // First 6 useful bytes from the header
-    // std::ifstream::read() only reads 'char', thus we need a type cast for tga.header
-    in.read(reinterpret_cast<char*>(header.data()), sizeof(header));
-    if (in.fail()) {
-        std::cerr << "Could not read TGA header ('" << filename << "')\n";
-        return {};
+    if (valid) {
+        // With a pixel unpack buffer bound, the data pointer is an offset into the buffer.
+        // The driver can then perform the transfer asynchronously.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        uploadPixels(nullptr);
+    } else {
+        std::cerr << "Could not upload image data ('" << filename << "')\n";
     }
 
-    ImageData image;
+    // The buffer is released by GL once the pending transfer from it has completed
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    deleteUnpackBuffer(pbo, imageSize);
 
-    // Determine the TGA width (highbyte*256 + lowbyte)
-    image.width = header[1] * 256 + header[0];
-    // Determine the TGA height	(highbyte*256 + lowbyte)
-    image.height = header[3] * 256 + header[2];
+    if (!valid) {
+        release();
+        image_ = Image();
+    }
+}
 
-    // Make sure all information is valid
-    if ((image.width <= 0) || (image.height <= 0)) {
-        std::cerr << "Invalid image dimensions ('" << filename << "')\n";
-        return {};
+/*
+ * Load a block compressed (BC1/DXT1 or BC3/DXT5) texture with all its mip levels from a
+ * DDS file, as written by BlockCompressor::writeDDS(). The blocks are uploaded as they are
+ * stored, through a pixel unpack buffer, with no decoding or filtering.
+ */
+void Texture::createTextureDDS(const std::string& filename) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cerr << "Could not open texture file ('" << filename << "')\n";
+        return;
+    }
+    if (!GLEW_EXT_texture_compression_s3tc) {
+        std::cerr << "S3TC texture compression is not supported ('" << filename << "')\n";
+        return;
     }
 
-    // Determine the bits per pixel
-    const GLuint bpp = header[4];
-    // Compute the number of BYTES per pixel
-    const GLuint bytesPerPixel = (bpp / 8);
-    // Compute the total amount of memory needed
-    const GLuint imageSize = (bytesPerPixel * image.width * image.height);
+    // "DDS " followed by a 124 byte header
+    const size_t headerSize = 4 + 124;
+    if (file.size() < headerSize || std::memcmp(file.data(), "DDS ", 4) != 0) {
+        std::cerr << "Invalid DDS file ('" << filename << "')\n";
+        return;
+    }
+    auto field = [&file](size_t offset) {
+        std::uint32_t value;
+        std::memcpy(&value, file.data() + 4 + offset, sizeof(value));
+        return value;
+    };
+    const std::uint32_t height = field(8);
+    const std::uint32_t width = field(12);
+    const std::uint32_t mipMapCount = std::max<std::uint32_t>(field(24), 1);
+    const std::uint32_t pixelFormatFlags = field(76);
+    const std::uint32_t fourCC = field(80);
 
-    switch (bpp) {
-        case 24:
-            image.type = GL_RGB;
-            std::cout << "Texture type is GL_RGB ('" << filename << "')\n";
-            break;
-        case 32:
-            image.type = GL_RGBA;
-            std::cout << "Texture type is GL_RGB ('" << filename << "')\n";
-            break;
-        default:
-            std::cerr << "Unsupported number of bits per pixel (" << bpp << ") ('" << filename
-                      << "')\n";
-            return {};
+    size_t blockSize;
+    if ((pixelFormatFlags & 0x4) && std::memcmp(&fourCC, "DXT1", 4) == 0) {
+        image_.type = GL_RGB;
+        image_.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        blockSize = 8;
+    } else if ((pixelFormatFlags & 0x4) && std::memcmp(&fourCC, "DXT5", 4) == 0) {
+        image_.type = GL_RGBA;
+        image_.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        blockSize = 16;
+    } else {
+        std::cerr << "Unsupported DDS pixel format, only DXT1 and DXT5 ('" << filename << "')\n";
+        return;
+    }
+    image_.width = width;
+    image_.height = height;
+    if (width == 0 || height == 0 ||
+        mipMapCount > static_cast<std::uint32_t>(fullMipLevels(width, height))) {
+        std::cerr << "Invalid DDS dimensions ('" << filename << "')\n";
+        image_ = Image();
+        return;
     }
 
-    image.data.resize(imageSize);  // Allocate memory for image data
+    // The levels are stored back to back after the header, largest first
+    size_t payload = 0;
+    for (std::uint32_t i = 0; i < mipMapCount; i++) {
+        const size_t w = std::max(width >> i, 1u);
+        const size_t h = std::max(height >> i, 1u);
+        payload += ((w + 3) / 4) * ((h + 3) / 4) * blockSize;
+    }
+    if (file.size() - headerSize < payload) {
+        std::cerr << "Truncated DDS file ('" << filename << "')\n";
+        image_ = Image();
+        return;
+    }
 
-    // Attempt to read image data
-    // std::ifstream::read() only reads 'char', thus we need a type cast for tga.header
-    in.read(reinterpret_cast<char*>(image.data.data()), imageSize);
-    if (in.gcount() != imageSize) {
-        std::cerr << "Could not read image data ('" << filename << "')\n";
-        return {};
+    // Start at the first level kept by the load options, the larger ones are not read
+    const std::uint32_t skip = skippedLevels(width, height, mipMapCount);
+    size_t skipped = 0;
+    for (std::uint32_t i = 0; i < skip; i++) {
+        const size_t w = std::max(width >> i, 1u);
+        const size_t h = std::max(height >> i, 1u);
+        skipped += ((w + 3) / 4) * ((h + 3) / 4) * blockSize;
     }
+    const std::uint32_t levelCount = mipMapCount - skip;
+    image_.width = std::max(width >> skip, 1u);
+    image_.height = std::max(height >> skip, 1u);
+    payload -= skipped;
 
-    // Swap the BGR(A) byte order in the TGA file to the standard RGB(A) byte order for OpenGL.
-    for (size_t cswap = 0; cswap < imageSize; cswap += bytesPerPixel) {
-        std::swap(image.data[cswap], image.data[cswap + 2]);
+    std::cout << "Texture type is " << (blockSize == 8 ? "BC1 (DXT1)" : "BC3 (DXT5)") << ", "
+              << levelCount << " levels, " << image_.width << "x" << image_.height << " ('"
+              << filename << "')\n";
+    if (skip > 0) {
+        logDownscale(filename, width, height, image_.width, image_.height);
     }
 
-    return image;
+    allocateStorage(static_cast<GLsizei>(levelCount), image_.format);
+
+    GLuint pbo = 0;
+    GLubyte* staging = mapUnpackBuffer(payload, pbo);
+    if (staging) {
+        std::memcpy(staging, file.data() + headerSize + skipped, payload);
+    }
+    const bool staged = unmapUnpackBuffer(pbo) && staging;
+    if (staged) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    }
+
+    size_t offset = 0;
+    for (std::uint32_t i = 0; i < levelCount; i++) {
+        const GLuint w = std::max(image_.width >> i, 1u);
+        const GLuint h = std::max(image_.height >> i, 1u);
+        const size_t size = ((w + 3) / 4) * ((h + 3) / 4) * blockSize;
+        // From the unpack buffer if staging worked, otherwise from the mapped file
+        const GLvoid* blocks = staged ? reinterpret_cast<const GLvoid*>(offset)
+                                      : file.data() + headerSize + skipped + offset;
+        uploadCompressedLevel(static_cast<GLint>(i), w, h, static_cast<GLsizei>(size), blocks);
+        offset += size;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    deleteUnpackBuffer(pbo, payload);
 }
 
+namespace {
+
+// GL formats for a KTX2 vkFormat
+struct KTX2Format {
+    std::uint32_t vkFormat;
+    GLenum internalFormat;
+    GLenum format;           // Pixel transfer format, 0 for block compressed formats
+    GLuint type;             // GL_RGB or GL_RGBA
+    std::uint32_t texelSize;  // Bytes per pixel, or per 4x4 block if compressed
+};
+
+const KTX2Format ktx2Formats[] = {
+    {23, GL_RGB8, GL_RGB, GL_RGB, 3},                                        // R8G8B8_UNORM
+    {29, GL_SRGB8, GL_RGB, GL_RGB, 3},                                       // R8G8B8_SRGB
+    {30, GL_RGB8, GL_BGR, GL_RGB, 3},                                        // B8G8R8_UNORM
+    {36, GL_SRGB8, GL_BGR, GL_RGB, 3},                                       // B8G8R8_SRGB
+    {37, GL_RGBA8, GL_RGBA, GL_RGBA, 4},                                     // R8G8B8A8_UNORM
+    {43, GL_SRGB8_ALPHA8, GL_RGBA, GL_RGBA, 4},                              // R8G8B8A8_SRGB
+    {44, GL_RGBA8, GL_BGRA, GL_RGBA, 4},                                     // B8G8R8A8_UNORM
+    {50, GL_SRGB8_ALPHA8, GL_BGRA, GL_RGBA, 4},                              // B8G8R8A8_SRGB
+    {131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 0, GL_RGB, 8},                    // BC1_RGB_UNORM
+    {132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 0, GL_RGB, 8},                   // BC1_RGB_SRGB
+    {133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 0, GL_RGBA, 8},                  // BC1_RGBA_UNORM
+    {134, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 0, GL_RGBA, 8},            // BC1_RGBA_SRGB
+    {137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 0, GL_RGBA, 16},                 // BC3_UNORM
+    {138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 0, GL_RGBA, 16},           // BC3_SRGB
+    {145, GL_COMPRESSED_RGBA_BPTC_UNORM, 0, GL_RGBA, 16},                    // BC7_UNORM
+    {146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 0, GL_RGBA, 16},              // BC7_SRGB
+};
+
+}  // namespace
+
 /*
- * Load and activate a 2D texture from a TGA file
+ * Load a texture from a KTX2 file. The file is memory mapped, the level index is checked
+ * against the header and the file size, and every stored mip level (and array layer) is
+ * uploaded as it is. Block compressed payloads are passed straight to GL, and no mipmaps
+ * are generated. Supercompressed files and cube maps are not supported.
  */
-void Texture::createTexture(const std::string& filename) {
-    image_ = loadUncompressedTGA(filename);
+void Texture::createTextureKTX2(const std::string& filename) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cerr << "Could not open texture file ('" << filename << "')\n";
+        return;
+    }
+
+    const GLubyte identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32,
+                                    0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    const size_t levelIndexOffset = 80;  // Identifier, header and index
+    if (file.size() < levelIndexOffset ||
+        std::memcmp(file.data(), identifier, sizeof(identifier)) != 0) {
+        std::cerr << "Invalid KTX2 file ('" << filename << "')\n";
+        return;
+    }
+    auto u32 = [&file](size_t offset) {
+        std::uint32_t value;
+        std::memcpy(&value, file.data() + offset, sizeof(value));
+        return value;
+    };
+    auto u64 = [&file](size_t offset) {
+        std::uint64_t value;
+        std::memcpy(&value, file.data() + offset, sizeof(value));
+        return value;
+    };
+
+    const std::uint32_t vkFormat = u32(12);
+    const std::uint32_t width = u32(20);
+    const std::uint32_t height = u32(24);
+    const std::uint32_t depth = u32(28);
+    const std::uint32_t layerCount = u32(32);
+    const std::uint32_t faceCount = u32(36);
+    const std::uint32_t levelCount = std::max<std::uint32_t>(u32(40), 1);
+    const std::uint32_t supercompression = u32(44);
 
-    if (image_.data.empty()) {
+    const KTX2Format* fmt = nullptr;
+    for (const KTX2Format& f : ktx2Formats) {
+        if (f.vkFormat == vkFormat) {
+            fmt = &f;
+        }
+    }
+    if (!fmt) {
+        std::cerr << "Unsupported KTX2 format " << vkFormat << " ('" << filename << "')\n";
         return;
     }
+    if (supercompression != 0 || faceCount != 1 || depth > 1 || width == 0 || height == 0 ||
+        levelCount > static_cast<std::uint32_t>(fullMipLevels(width, height))) {
+        std::cerr << "Unsupported KTX2 layout, only plain 2D textures and arrays ('"
+                  << filename << "')\n";
+        return;
+    }
+    const bool compressed = (fmt->format == 0);
+    const bool bptc = (vkFormat == 145 || vkFormat == 146);
+    if ((compressed && !bptc && !GLEW_EXT_texture_compression_s3tc) ||
+        (bptc && !GLEW_ARB_texture_compression_bptc)) {
+        std::cerr << "Texture compression format is not supported ('" << filename << "')\n";
+        return;
+    }
+
+    // Validate the level index: each level must fit in the file and hold all its layers
+    const std::uint32_t layers = std::max<std::uint32_t>(layerCount, 1);
+    if (file.size() < levelIndexOffset + 24 * static_cast<size_t>(levelCount)) {
+        std::cerr << "Truncated KTX2 level index ('" << filename << "')\n";
+        return;
+    }
+    // Only the levels kept by the load options are uploaded
+    const std::uint32_t skip = skippedLevels(width, height, levelCount);
+    std::vector<size_t> levelOffsets(levelCount);
+    std::vector<size_t> levelSizes(levelCount);
+    size_t payload = 0;
+    for (std::uint32_t i = 0; i < levelCount; i++) {
+        const std::uint64_t offset = u64(levelIndexOffset + 24 * i);
+        const std::uint64_t length = u64(levelIndexOffset + 24 * i + 8);
+        const size_t w = std::max(width >> i, 1u);
+        const size_t h = std::max(height >> i, 1u);
+        const size_t imageSize =
+            compressed ? ((w + 3) / 4) * ((h + 3) / 4) * fmt->texelSize : w * h * fmt->texelSize;
+        const size_t expected = imageSize * layers;
+        if (offset > file.size() || length > file.size() - offset || length < expected) {
+            std::cerr << "Invalid KTX2 level " << i << " ('" << filename << "')\n";
+            return;
+        }
+        levelOffsets[i] = static_cast<size_t>(offset);
+        levelSizes[i] = expected;
+        payload += (i >= skip) ? expected : 0;
+    }
+
+    image_.width = std::max(width >> skip, 1u);
+    image_.height = std::max(height >> skip, 1u);
+    image_.type = fmt->type;
+    image_.format = compressed ? fmt->internalFormat : fmt->format;
+
+    std::cout << "Texture is KTX2 format " << vkFormat << ", " << levelCount - skip
+              << " levels, " << layerCount << " layers, " << image_.width << "x"
+              << image_.height << " ('" << filename << "')\n";
+    if (skip > 0) {
+        logDownscale(filename, width, height, image_.width, image_.height);
+    }
+
+    allocateStorage(static_cast<GLsizei>(levelCount - skip), fmt->internalFormat, layerCount);
+
+    // Stage all kept levels in one pixel unpack buffer, packed in upload order
+    GLuint pbo = 0;
+    GLubyte* staging = mapUnpackBuffer(payload, pbo);
+    if (staging) {
+        size_t offset = 0;
+        for (std::uint32_t i = skip; i < levelCount; i++) {
+            std::memcpy(staging + offset, file.data() + levelOffsets[i], levelSizes[i]);
+            offset += levelSizes[i];
+        }
+    }
+    const bool staged = unmapUnpackBuffer(pbo) && staging;
+    if (staged) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    }
 
-    if (textureID_ == 0) {
-        glGenTextures(1, &textureID_);  // Create the texture ID if it does not exist
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // KTX2 rows are tightly packed
+    const bool immutable = GLEW_ARB_texture_storage;
+    size_t offset = 0;
+    for (std::uint32_t i = skip; i < levelCount; i++) {
+        const GLint level = static_cast<GLint>(i - skip);
+        const GLsizei w = static_cast<GLsizei>(std::max(width >> i, 1u));
+        const GLsizei h = static_cast<GLsizei>(std::max(height >> i, 1u));
+        const GLsizei size = static_cast<GLsizei>(levelSizes[i]);
+        const GLvoid* data = staged ? reinterpret_cast<const GLvoid*>(offset)
+                                    : file.data() + levelOffsets[i];
+        const GLenum internalFormat = fmt->internalFormat;
+        const GLsizei l = static_cast<GLsizei>(layerCount);
+
+        if (layerCount > 0 && compressed) {
+            if (immutable) {
+                glCompressedTexSubImage3D(target_, level, 0, 0, 0, w, h, l, internalFormat, size,
+                                          data);
+            } else {
+                glCompressedTexImage3D(target_, level, internalFormat, w, h, l, 0, size, data);
+            }
+        } else if (layerCount > 0) {
+            if (immutable) {
+                glTexSubImage3D(target_, level, 0, 0, 0, w, h, l, fmt->format, GL_UNSIGNED_BYTE,
+                                data);
+            } else {
+                glTexImage3D(target_, level, internalFormat, w, h, l, 0, fmt->format,
+                             GL_UNSIGNED_BYTE, data);
+            }
+        } else if (compressed) {
+            uploadCompressedLevel(level, w, h, size, data);
+        } else if (immutable) {
+            glTexSubImage2D(target_, level, 0, 0, w, h, fmt->format, GL_UNSIGNED_BYTE, data);
+        } else {
+            glTexImage2D(target_, level, internalFormat, w, h, 0, fmt->format, GL_UNSIGNED_BYTE,
+                         data);
+        }
+        offset += levelSizes[i];
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    deleteUnpackBuffer(pbo, payload);
+}
+
+/*
+ * Get the full mipmap chain for a TGA or QOI file from its cache file, or decode the file and
+ * filter the chain on the CPU, then write it to the cache for the next load. A chain that
+ * was written is mapped back from the cache, which frees the filtered levels on the heap.
+ * Makes no GL calls, so it can run on any thread.
+ */
+MipChain Texture::loadMipChain(const std::string& filename) {
+    TRACE_ZONE("Texture::loadMipChain");
+    const LoadOptions options = loadOptions();
+    const std::string cacheFile = MipChain::cacheFilename(filename);
+    const std::uint64_t stamp = MipChain::sourceStamp(filename);
+
+    MipChain chain;
+    if (options.mipCache && chain.readCache(cacheFile, stamp, options.mipFilter)) {
+        std::cout << "Mipmaps read from cache ('" << cacheFile << "')\n";
+        // The cache holds the full chain, a reduced size texture just starts further down
+        const MipChain::Level base = chain.level(0);
+        const GLuint skip = skippedLevels(base.width, base.height,
+                                          static_cast<GLuint>(chain.levelCount()));
+        if (skip > 0) {
+            chain.dropLevels(skip);
+            logDownscale(filename, base.width, base.height, chain.level(0).width,
+                         chain.level(0).height);
+        }
+        return chain;
+    }
+
+    Image image = Image::load(filename);
+    if (image.data.empty()) {
+        return chain;
+    }
+    // Filtering the levels that would be dropped anyway is skipped, and so is writing the
+    // cache, which must hold the full chain
+    const bool reduced = downscale(image, filename);
+    chain.generate(image.data.data(), image.width, image.height, image.type, image.format,
+                   options.mipFilter);
+
+    if (options.mipCache && stamp != 0 && !reduced) {
+        if (!chain.writeCache(cacheFile, stamp)) {
+            std::cerr << "Could not write mipmap cache ('" << cacheFile << "')\n";
+        } else {
+            MipChain cached;
+            if (cached.readCache(cacheFile, stamp, options.mipFilter)) {
+                chain = std::move(cached);
+            }
+        }
+    }
+    return chain;
+}
+
+/* Number of levels in a full mipmap chain down to 1x1 */
+GLsizei Texture::fullMipLevels(GLuint width, GLuint height) {
+    return 1 + static_cast<GLsizei>(std::floor(std::log2(std::max(width, height))));
+}
+
+GLuint Texture::skippedLevels(GLuint width, GLuint height, GLuint levelCount) {
+    const LoadOptions options = loadOptions();
+    GLuint skip = options.skipLevels;
+    if (options.maxSize > 0) {
+        while (std::max(width >> skip, height >> skip) > options.maxSize) {
+            skip++;
+        }
+    }
+    return std::min(skip, std::max(levelCount, 1u) - 1);
+}
+
+/*
+ * Resample an image to the size of the first mip level kept by LoadOptions, in one pass
+ * from the full image with the mipmap filter (multithreaded, see MipChain::resample()).
+ * The result matches the level a cached chain would start at.
+ */
+bool Texture::downscale(Image& image, const std::string& filename) {
+    const GLuint skip = skippedLevels(image.width, image.height,
+                                      fullMipLevels(image.width, image.height));
+    if (skip == 0 || image.data.empty()) {
+        return false;
     }
+    Image reduced;
+    reduced.width = std::max(image.width >> skip, 1u);
+    reduced.height = std::max(image.height >> skip, 1u);
+    reduced.type = image.type;
+    reduced.format = image.format;
+    const GLuint bytesPerPixel = (image.type == GL_RGBA) ? 4 : 3;
+    reduced.data.resize(static_cast<size_t>(reduced.width) * reduced.height * bytesPerPixel);
+    MipChain::resample(image.data.data(), image.width, image.height, reduced.data.data(),
+                       reduced.width, reduced.height, bytesPerPixel, loadOptions().mipFilter);
 
-    glBindTexture(GL_TEXTURE_2D, textureID_);
+    logDownscale(filename, image.width, image.height, reduced.width, reduced.height);
+    image = std::move(reduced);
+    return true;
+}
+
+/*
+ * Create a new pixel unpack buffer and map it for writing. The old contents are invalidated
+ * on mapping, so the driver never has to wait for or preserve them.
+ * The buffer is left bound, and the pointer is nullptr if mapping failed.
+ */
+GLubyte* Texture::mapUnpackBuffer(size_t size, GLuint& pbo) {
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    MemoryTracker::track(MemoryTracker::StagingBuffers, 0, size);
+    return static_cast<GLubyte*>(glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+}
+
+/* Unmap a buffer from mapUnpackBuffer(), returns false if its contents were lost */
+bool Texture::unmapUnpackBuffer(GLuint pbo) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    // The buffer contents are undefined if unmapping fails (e.g. on a mode switch)
+    const bool valid = (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return valid;
+}
+
+/* Delete a buffer from mapUnpackBuffer() of the given size */
+void Texture::deleteUnpackBuffer(GLuint& pbo, size_t size) {
+    glDeleteBuffers(1, &pbo);
+    pbo = 0;
+    MemoryTracker::track(MemoryTracker::StagingBuffers, size, 0);
+}
+
+/* Sized internal format for uncompressed 8 bit data, RGB data is not expanded to RGBA */
+GLenum Texture::sizedFormat(GLuint type) { return (type == GL_RGBA) ? GL_RGBA8 : GL_RGB8; }
+
+size_t Texture::storageSize(GLuint width, GLuint height, GLuint layers, GLsizei levels,
+                            GLenum internalFormat) {
+    // Bytes per 4x4 block for the compressed formats, bytes per texel otherwise
+    size_t blockSize = 0;
+    size_t texelSize = 4;
+    switch (internalFormat) {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT: blockSize = 8; break;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM: blockSize = 16; break;
+        case GL_RGB8:
+        case GL_SRGB8: texelSize = 3; break;
+        default: break;
+    }
+
+    size_t size = 0;
+    for (GLsizei i = 0; i < levels; i++) {
+        const size_t w = std::max(width >> i, 1u);
+        const size_t h = std::max(height >> i, 1u);
+        size += blockSize ? ((w + 3) / 4) * ((h + 3) / 4) * blockSize : w * h * texelSize;
+    }
+    return size * std::max(layers, 1u);
+}
+
+/*
+ * Create a new texture object with storage for an image the size of image_.
+ * The previous texture object, if any, is deleted.
+ */
+void Texture::allocateStorage(GLsizei levels, GLenum internalFormat, GLuint layers) {
+    // Storage allocated by glTexStorage2D() is immutable, so start over with a new texture
+    GLState::deleteTexture(textureID_);
+    glGenTextures(1, &textureID_);
+    target_ = (layers > 0) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    layers_ = layers;
+    levels_ = levels;
+    internalFormat_ = internalFormat;
+    const size_t size = storageSize(image_.width, image_.height, layers, levels, internalFormat);
+    MemoryTracker::track(MemoryTracker::Textures, sizeInBytes_, size);
+    sizeInBytes_ = size;
+
+    GLState::bindTexture(target_, textureID_);
     // Set parameters to determine how the texture is resized
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target_, GL_TEXTURE_MIN_FILTER,
+                    (levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // Set parameters to determine how the texture wraps at edges
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Read the texture data from file and upload it to the GPU
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_.width, image_.height, 0, image_.type,
-                 GL_UNSIGNED_BYTE, image_.data.data());
+    glTexParameteri(target_, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target_, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target_, GL_TEXTURE_MAX_LEVEL, levels - 1);
 
-    glEnable(GL_TEXTURE_2D);  // Required for glGenerateMipmap() to work
+    if (GLEW_ARB_texture_storage) {
+        if (layers > 0) {
+            glTexStorage3D(target_, levels, internalFormat, image_.width, image_.height, layers);
+        } else {
+            glTexStorage2D(target_, levels, internalFormat, image_.width, image_.height);
+        }
+    }
+}
+
+/* Upload one mip level of the texture bound by allocateStorage() */
+void Texture::uploadLevel(GLint level, GLuint width, GLuint height, const GLvoid* pixels) {
+    // RGB rows are not necessarily a multiple of 4 bytes long
+    glPixelStorei(GL_UNPACK_ALIGNMENT, (image_.type == GL_RGBA) ? 4 : 1);
+    // Upload the pixels in their stored byte order, BGR(A) from TGA files needs no conversion
+    if (GLEW_ARB_texture_storage) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, image_.format,
+                        GL_UNSIGNED_BYTE, pixels);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, level, sizedFormat(image_.type), width, height, 0,
+                     image_.format, GL_UNSIGNED_BYTE, pixels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+/* Upload one block compressed mip level of the texture bound by allocateStorage() */
+void Texture::uploadCompressedLevel(GLint level, GLuint width, GLuint height, GLsizei size,
+                                    const GLvoid* blocks) {
+    if (GLEW_ARB_texture_storage) {
+        glCompressedTexSubImage2D(target_, level, 0, 0, width, height, image_.format, size,
+                                  blocks);
+    } else {
+        glCompressedTexImage2D(target_, level, image_.format, width, height, 0, size, blocks);
+    }
+}
+
+/*
+ * Upload mip level 0 of the texture bound by allocateStorage() and generate the other levels.
+ * If a pixel unpack buffer is bound, pixels is an offset into that buffer.
+ */
+void Texture::uploadPixels(const GLvoid* pixels) {
+    uploadLevel(0, image_.width, image_.height, pixels);
     glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+/*
+ * Replace the texture contents with a precomputed mipmap chain. All levels are staged in
+ * one pixel unpack buffer and uploaded from it, GL does no filtering of its own.
+ */
+void Texture::uploadLevels(const MipChain& chain) {
+    const MipChain::Level& base = chain.level(0);
+    image_ = Image();
+    image_.width = base.width;
+    image_.height = base.height;
+    image_.type = chain.type();
+    image_.format = chain.format();
+
+    allocateStorage(static_cast<GLsizei>(chain.levelCount()), sizedFormat(image_.type));
+
+    GLuint pbo = 0;
+    GLubyte* staging = mapUnpackBuffer(chain.totalSize(), pbo);
+    if (staging) {
+        size_t offset = 0;
+        for (size_t i = 0; i < chain.levelCount(); i++) {
+            std::memcpy(staging + offset, chain.level(i).data, chain.level(i).size);
+            offset += chain.level(i).size;
+        }
+    }
+
+    if (unmapUnpackBuffer(pbo) && staging) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        size_t offset = 0;
+        for (size_t i = 0; i < chain.levelCount(); i++) {
+            const MipChain::Level& level = chain.level(i);
+            uploadLevel(static_cast<GLint>(i), level.width, level.height,
+                        reinterpret_cast<const GLvoid*>(offset));
+            offset += level.size;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        // Fall back to uploading straight from client memory
+        for (size_t i = 0; i < chain.levelCount(); i++) {
+            const MipChain::Level& level = chain.level(i);
+            uploadLevel(static_cast<GLint>(i), level.width, level.height, level.data);
+        }
+    }
+    deleteUnpackBuffer(pbo, chain.totalSize());
+}
+
+/* Replace the texture contents with an image decoded on the CPU */
+void Texture::uploadImage(const Image& image) {
+    if (image.data.empty()) {
+        return;
+    }
+    image_.width = image.width;
+    image_.height = image.height;
+    image_.type = image.type;
+    image_.format = image.format;
+
+    allocateStorage(fullMipLevels(image_.width, image_.height), sizedFormat(image_.type));
+    uploadPixels(image.data.data());
+}
 
-    // Image data was copied to the GPU, release contents of the std::vector
-    // When using clear() the std::vector would still hold on to the memory.
-    image_.data = std::vector<GLubyte>();
+/*
+ * Start loading a texture in the background. Until the streamer has decoded and uploaded
+ * the file, the texture is a single mid-gray texel so it can be bound and rendered right away.
+ */
+void Texture::createTextureAsync(const std::string& filename, TextureStreamer& streamer) {
+    if (streamer_) {
+        streamer_->cancel(this);  // A newer request replaces any pending one
+    }
+
+    Image placeholder;
+    placeholder.width = 1;
+    placeholder.height = 1;
+    placeholder.type = GL_RGBA;
+    placeholder.format = GL_RGBA;
+    placeholder.data = {128, 128, 128, 255};
+    uploadImage(placeholder);
+
+    streamer_ = &streamer;
+    filename_ = filename;
+    streamer.request(this, filename);
+}
+
+void Texture::release() {
+    GLState::deleteTexture(textureID_);
+    textureID_ = 0;
+    MemoryTracker::track(MemoryTracker::Textures, sizeInBytes_, 0);
+    sizeInBytes_ = 0;
+}
+
+void Texture::reload(TextureStreamer* streamer) {
+    if (!streamer) {
+        createTexture(filename_);
+    } else if (textureID_ == 0) {
+        createTextureAsync(filename_, *streamer);
+    } else if (!streamer_) {
+        streamer_ = streamer;
+        streamer->request(this, filename_);
+    }
+}
+
+bool Texture::dropTopLevel() {
+    if (textureID_ == 0 || levels_ < 2 || target_ != GL_TEXTURE_2D) {
+        return false;
+    }
+    const GLuint oldTexture = textureID_;
+    const GLsizei oldLevels = levels_;
+    GLState::bindTexture(GL_TEXTURE_2D, oldTexture);
+    GLint compressed = GL_FALSE;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+
+    // Allocate the smaller texture, without deleting the old one yet. The old storage is
+    // counted until then.
+    const size_t oldBytes = sizeInBytes_;
+    textureID_ = 0;
+    sizeInBytes_ = 0;
+    image_.width = std::max(image_.width >> 1, 1u);
+    image_.height = std::max(image_.height >> 1, 1u);
+    allocateStorage(oldLevels - 1, internalFormat_);
+    const GLuint newTexture = textureID_;
+
+    // Each level is packed from the old texture into a buffer and unpacked from it into the
+    // new one, so the texels never leave the GPU
+    GLuint pbo = 0;
+    GLint pboBytes = 0;
+    glGenBuffers(1, &pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (GLint level = 1; level < oldLevels; level++) {
+        GLint width = 0;
+        GLint height = 0;
+        GLint size = 0;
+        GLState::bindTexture(GL_TEXTURE_2D, oldTexture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (compressed) {
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE,
+                                     &size);
+        } else {
+            size = width * height * ((image_.type == GL_RGBA) ? 4 : 3);
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_COPY);
+        MemoryTracker::track(MemoryTracker::StagingBuffers, pboBytes, size);
+        pboBytes = size;
+        if (compressed) {
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, nullptr);
+        } else {
+            glGetTexImage(GL_TEXTURE_2D, level, image_.format, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        GLState::bindTexture(GL_TEXTURE_2D, newTexture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        if (compressed) {
+            uploadCompressedLevel(level - 1, width, height, size, nullptr);
+        } else {
+            uploadLevel(level - 1, width, height, nullptr);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    deleteUnpackBuffer(pbo, pboBytes);
+    GLState::deleteTexture(oldTexture);
+    MemoryTracker::track(MemoryTracker::Textures, oldBytes, 0);
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    return true;
 }
@@ -4,8 +4,17 @@
  * Modified, stripped-down and cleaned-up version of the TGA loader from NeHe tutorial 33.
  *
  * Usage: Call createTexture() with a TGA file as argument to load a texture,
- *        or use the constructor with a file name argument. Uncompressed RGB or RGBA only.
- *        Call glBindTexture() with the public member textureID as argument.
+ *        or use the constructor with a file name argument. Uncompressed or RLE compressed
+ *        RGB or RGBA only. The file is memory mapped and its pixels are uploaded through
+ *        a pixel unpack buffer without an intermediate copy.
+ *        Files ending in .dds are loaded as BC1/BC3 block compressed textures with all
+ *        their mip levels (see BlockCompressor). Files ending in .ktx2 are loaded with all
+ *        their stored levels and array layers, uncompressed or BC1/BC3/BC7 compressed.
+ *        Files ending in .qoi are lossless QOI ("Quite OK Image") images, several times
+ *        smaller than TGA files and fast to decode. The files are decoded with Image, see
+ *        Image.hpp, which also loads and writes images without a GL context.
+ *        Call bind(), or glBindTexture() with id() as argument. Textures managed by a
+ *        ResidencyManager must be bound with bind(), which reloads them if they were evicted.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -16,7 +25,12 @@
 
 #include <GLFW/glfw3.h>
 #include <string>
-#include <vector>
+
+#include "Image.hpp"
+#include "MipChain.hpp"
+
+class ResidencyManager;
+class TextureStreamer;
 
 class Texture {
 public:
@@ -30,26 +44,117 @@ public:
     // The external entry point for loading a texture from a TGA file
     void createTexture(const std::string& filename);  // Load GL texture from file
 
+    // Show a 1x1 placeholder now, and let the streamer load the file in the background.
+    // The streamer must outlive the texture.
+    void createTextureAsync(const std::string& filename, TextureStreamer& streamer);
+
     // returns the OpenGL texture ID
     GLuint id() const;
 
+    // Bind the texture to its target on the active texture unit
+    void bind();
+
     GLuint width() const;
     GLuint height() const;
 
     // returns the type of the texture (GL_RGB or GL_RGBA)
     GLuint type() const;
 
-private:
-    struct ImageData {
-        GLuint width = 0;                // Image width
-        GLuint height = 0;               // Image height
-        GLuint type = 0;                 // Image type (3 bytes per pixel: GL_RGB, 4 bytes: GL_RGBA)
-        std::vector<GLubyte> data;  // Image data (3 or 4 bytes per pixel)
+    // returns the texture target to bind to (GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY)
+    GLenum target() const;
+
+    // returns the number of array layers, 0 if the texture is not an array
+    GLuint layers() const;
+
+    // returns the GPU memory used by all levels and layers of the texture, in bytes
+    size_t sizeInBytes() const;
+
+    // Replace the texture contents with a decoded image, called on the GL thread
+    void uploadImage(const Image& image);
+
+    // Replace the texture contents with a precomputed mipmap chain, called on the GL thread
+    void uploadLevels(const MipChain& chain);
+
+    struct LoadOptions {
+        bool cpuMipmaps = true;  // Filter mipmaps on the CPU instead of using glGenerateMipmap()
+        bool mipCache = true;    // Read and write CPU mipmaps from a cache file next to the image
+        MipChain::Filter mipFilter = MipChain::Filter::Kaiser;
+        // Leave out the largest mip levels until neither side is above maxSize (0: no limit),
+        // and then skipLevels more. Images are resampled to that size before upload, and
+        // DDS and KTX2 files start at the first kept level. At least one level is kept.
+        GLuint maxSize = 0;
+        GLuint skipLevels = 0;
     };
 
-    // Load data from an uncompressed TGA file
-    ImageData loadUncompressedTGA(const std::string& filename) const;
+    // Options used by all subsequent texture loads, set them before loading
+    static LoadOptions& loadOptions();
+
+    // Read the mipmap chain of a TGA file from its cache, or build and cache it (any thread)
+    static MipChain loadMipChain(const std::string& filename);
+
+private:
+    friend class ResidencyManager;
+    friend class TextureStreamer;
+
+    // Load a block compressed texture with all mip levels from a DDS file
+    void createTextureDDS(const std::string& filename);
+
+    // Load a texture with all its stored mip levels and layers from a KTX2 file
+    void createTextureKTX2(const std::string& filename);
+
+    // Create a new texture object with storage for an image of the size in image_,
+    // a 2D array texture if layers > 0
+    void allocateStorage(GLsizei levels, GLenum internalFormat, GLuint layers = 0);
+
+    static GLenum sizedFormat(GLuint type);
+
+    // Bytes of storage for a texture with the given size, levels and internal format
+    static size_t storageSize(GLuint width, GLuint height, GLuint layers, GLsizei levels,
+                              GLenum internalFormat);
+
+    // Upload one mip level (from memory or a bound unpack buffer)
+    void uploadLevel(GLint level, GLuint width, GLuint height, const GLvoid* pixels);
+
+    // Upload one block compressed mip level, image_.format holds the compressed format
+    void uploadCompressedLevel(GLint level, GLuint width, GLuint height, GLsizei size,
+                               const GLvoid* blocks);
+
+    // Upload mip level 0 (from memory or a bound unpack buffer) and generate the other levels
+    void uploadPixels(const GLvoid* pixels);
+
+    static GLsizei fullMipLevels(GLuint width, GLuint height);
+
+    // Number of top mip levels LoadOptions::maxSize and skipLevels leave out of an image
+    static GLuint skippedLevels(GLuint width, GLuint height, GLuint levelCount);
+
+    // Resample an image down to the size chosen by LoadOptions if it is larger, returns true
+    // if it was resampled
+    static bool downscale(Image& image, const std::string& filename);
+
+    // Free the GL texture, keeping the file name so it can be loaded again
+    void release();
+
+    // Load the texture again from its file, in the background if a streamer is given. An
+    // evicted texture shows the placeholder until then, a reduced one keeps its levels.
+    void reload(TextureStreamer* streamer);
+
+    // Replace the texture with one without its largest mip level, returns false if there is
+    // only one level. The remaining levels are copied on the GPU.
+    bool dropTopLevel();
+
+    // Create and map a pixel unpack buffer for staging uploads
+    static GLubyte* mapUnpackBuffer(size_t size, GLuint& pbo);
+    static bool unmapUnpackBuffer(GLuint pbo);
+    static void deleteUnpackBuffer(GLuint& pbo, size_t size);
 
     GLuint textureID_;  // Texture ID for OpenGL
-    ImageData image_;
+    GLenum target_;     // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for layered textures
+    GLuint layers_;     // Number of array layers, 0 for GL_TEXTURE_2D
+    GLsizei levels_;    // Number of mip levels
+    GLenum internalFormat_;
+    size_t sizeInBytes_;  // Storage size set by allocateStorage()
+    Image image_;  // Size and format of the texture, without the pixels
+    std::string filename_;         // File the texture was last loaded from
+    TextureStreamer* streamer_;    // Set while an asynchronous load is pending
+    ResidencyManager* residency_;  // Set while the texture is managed
 };
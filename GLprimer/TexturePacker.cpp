@@ -0,0 +1,264 @@
+/*
+ * Packing of textures into a 2D array texture, with shelf packed atlas layers.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "TexturePacker.hpp"
+#include "BlockCompressor.hpp"
+#include "GLState.hpp"
+#include "MemoryTracker.hpp"
+#include "MipChain.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Read level 0 of a 2D texture back as RGBA, empty if the texture is not loaded
+Image readBack(const Texture& texture) {
+    Image image;
+    if (texture.id() == 0 || texture.target() != GL_TEXTURE_2D) {
+        return image;
+    }
+    image.width = texture.width();
+    image.height = texture.height();
+    image.type = GL_RGBA;
+    image.format = GL_RGBA;
+    image.data.resize(static_cast<size_t>(image.width) * image.height * 4);
+    GLState::bindTexture(GL_TEXTURE_2D, texture.id());
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data.data());
+    return image;
+}
+
+}  // namespace
+
+TexturePacker::TexturePacker() : textureID_(0), layers_(0), sizeInBytes_(0) {}
+
+TexturePacker::~TexturePacker() {
+    GLState::deleteTexture(textureID_);
+    MemoryTracker::track(MemoryTracker::Textures, sizeInBytes_, 0);
+}
+
+size_t TexturePacker::add(const std::string& filename) {
+    files_.push_back(filename);
+    textures_.push_back(nullptr);
+    regions_.emplace_back();
+    return files_.size() - 1;
+}
+
+size_t TexturePacker::add(const Texture& texture) {
+    files_.push_back("loaded texture " + std::to_string(texture.id()));
+    textures_.push_back(&texture);
+    regions_.emplace_back();
+    return files_.size() - 1;
+}
+
+GLuint TexturePacker::id() const { return textureID_; }
+
+GLuint TexturePacker::layers() const { return layers_; }
+
+const TexturePacker::Region& TexturePacker::region(size_t index) const { return regions_[index]; }
+
+void TexturePacker::setUniforms(size_t index, GLint locationLayer, GLint locationUVRect,
+                                GLint locationMaxLod) const {
+    const Region& r = regions_[index];
+    glUniform1f(locationLayer, static_cast<GLfloat>(r.layer));
+    glUniform4fv(locationUVRect, 1, r.uvRect.data());
+    glUniform1f(locationMaxLod, r.maxLod);
+}
+
+bool TexturePacker::build(GLuint padding) {
+    if (files_.empty()) {
+        return false;
+    }
+
+    // Decode all files in parallel, as RGBA so that every layer has the same format. Loaded
+    // textures are read back on this thread, which owns the GL context.
+    std::vector<Image> images(files_.size());
+    for (size_t i = 0; i < textures_.size(); i++) {
+        if (textures_[i]) {
+            images[i] = readBack(*textures_[i]);
+        }
+    }
+    {
+        ThreadPool pool;
+        for (size_t i = 0; i < files_.size(); i++) {
+            if (textures_[i]) {
+                continue;
+            }
+            pool.enqueue([this, &images, i] {
+                Image image = Image::load(files_[i]);
+                if (!image.data.empty()) {
+                    image.data = BlockCompressor::toRGBA(
+                        image.data.data(), static_cast<size_t>(image.width) * image.height,
+                        image.format);
+                    image.type = GL_RGBA;
+                    image.format = GL_RGBA;
+                }
+                images[i] = std::move(image);
+            });
+        }
+        pool.wait();
+    }
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].data.empty()) {
+            std::cerr << "Could not pack texture ('" << files_[i] << "')\n";
+            return false;
+        }
+    }
+
+    // The layer size is set by the largest textures, which get a layer each
+    GLuint pageWidth = 0;
+    GLuint pageHeight = 0;
+    size_t decodedBytes = 0;
+    for (const Image& image : images) {
+        pageWidth = std::max(pageWidth, image.width);
+        pageHeight = std::max(pageHeight, image.height);
+        decodedBytes += image.data.size();
+    }
+    MemoryTracker::Allocation decoded(MemoryTracker::DecodedImages, decodedBytes);
+
+    struct Placement {
+        GLuint layer = 0;
+        GLuint x = 0;  // Position of the image (inside its padding)
+        GLuint y = 0;
+        bool padded = false;
+    };
+    std::vector<Placement> placements(images.size());
+
+    // Textures that do not fit in an atlas with their padding get a layer each. Those smaller
+    // than the layer are stretched to fill it, so GL_REPEAT and filtering across the edges
+    // only ever sample their own texels, and they keep the full mip chain.
+    GLuint layerCount = 0;
+    std::vector<size_t> atlasEntries;
+    for (size_t i = 0; i < images.size(); i++) {
+        Image& image = images[i];
+        if (image.width + 2 * padding > pageWidth || image.height + 2 * padding > pageHeight) {
+            placements[i].layer = layerCount++;
+            if (image.width != pageWidth || image.height != pageHeight) {
+                std::vector<GLubyte> stretched(static_cast<size_t>(pageWidth) * pageHeight * 4);
+                MipChain::resample(image.data.data(), image.width, image.height,
+                                   stretched.data(), pageWidth, pageHeight, 4,
+                                   MipChain::Filter::Kaiser);
+                image.data = std::move(stretched);
+                image.width = pageWidth;
+                image.height = pageHeight;
+            }
+        } else {
+            atlasEntries.push_back(i);
+        }
+    }
+    decodedBytes = 0;
+    for (const Image& image : images) {
+        decodedBytes += image.data.size();
+    }
+    decoded.resize(decodedBytes);
+
+    // Shelf packing of the rest, tallest first, into as many atlas layers as needed
+    std::stable_sort(atlasEntries.begin(), atlasEntries.end(), [&images](size_t a, size_t b) {
+        return images[a].height > images[b].height;
+    });
+    GLuint shelfX = 0;
+    GLuint shelfY = 0;
+    GLuint shelfHeight = 0;
+    bool atlasOpen = false;
+    for (size_t i : atlasEntries) {
+        const GLuint w = images[i].width + 2 * padding;
+        const GLuint h = images[i].height + 2 * padding;
+        if (atlasOpen && shelfX + w > pageWidth) {  // Start a new shelf
+            shelfY += shelfHeight;
+            shelfX = 0;
+            shelfHeight = 0;
+        }
+        if (!atlasOpen || shelfY + h > pageHeight) {  // Start a new atlas layer
+            layerCount++;
+            atlasOpen = true;
+            shelfX = 0;
+            shelfY = 0;
+            shelfHeight = 0;
+        }
+        placements[i] = {layerCount - 1, shelfX + padding, shelfY + padding, true};
+        shelfX += w;
+        shelfHeight = std::max(shelfHeight, h);
+    }
+
+    // Compose the layers on the CPU, replicating the edge pixels of each atlas entry into
+    // its padding so that filtering does not pick up its neighbours. Down the mip chain the
+    // padding halves with every level, and an entry would bleed into its neighbours once it
+    // is gone, so the shader keeps atlas entries to the levels where it is at least a texel.
+    const GLfloat atlasMaxLod =
+        (padding > 0) ? std::floor(std::log2(static_cast<GLfloat>(padding))) : 0.0f;
+    const size_t layerSize = static_cast<size_t>(pageWidth) * pageHeight * 4;
+    std::vector<GLubyte> pixels(layerSize * layerCount, 0);
+    const MemoryTracker::Allocation composed(MemoryTracker::DecodedImages, pixels.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        const Image& image = images[i];
+        const Placement& p = placements[i];
+        GLubyte* page = pixels.data() + layerSize * p.layer;
+        const int pad = p.padded ? static_cast<int>(padding) : 0;
+
+        for (int y = -pad; y < static_cast<int>(image.height) + pad; y++) {
+            const int sy = std::clamp(y, 0, static_cast<int>(image.height) - 1);
+            for (int x = -pad; x < static_cast<int>(image.width) + pad; x++) {
+                const int sx = std::clamp(x, 0, static_cast<int>(image.width) - 1);
+                const GLubyte* src =
+                    image.data.data() + (static_cast<size_t>(sy) * image.width + sx) * 4;
+                GLubyte* dst = page + ((static_cast<size_t>(p.y) + y) * pageWidth + p.x + x) * 4;
+                std::memcpy(dst, src, 4);
+            }
+        }
+
+        Region& r = regions_[i];
+        r.layer = p.layer;
+        r.uvRect = {{static_cast<GLfloat>(p.x) / pageWidth, static_cast<GLfloat>(p.y) / pageHeight,
+                     static_cast<GLfloat>(image.width) / pageWidth,
+                     static_cast<GLfloat>(image.height) / pageHeight}};
+        r.maxLod = p.padded ? atlasMaxLod : Region().maxLod;
+    }
+
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (layerCount > static_cast<GLuint>(maxLayers)) {
+        std::cerr << "Too many texture array layers (" << layerCount << " > " << maxLayers
+                  << ")\n";
+        return false;
+    }
+
+    GLState::deleteTexture(textureID_);
+    glGenTextures(1, &textureID_);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, textureID_);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, pageWidth, pageHeight, layerCount, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, pixels.data());
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // Count the levels that glGenerateMipmap() created
+    size_t bytes = 0;
+    GLuint width = pageWidth;
+    GLuint height = pageHeight;
+    for (GLuint level = 0;; level++) {
+        bytes += layerCount * (static_cast<size_t>(width) * height * 4);
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = std::max(width >> 1, 1u);
+        height = std::max(height >> 1, 1u);
+    }
+    MemoryTracker::track(MemoryTracker::Textures, sizeInBytes_, bytes);
+    sizeInBytes_ = bytes;
+
+    layers_ = layerCount;
+    std::cout << "Packed " << images.size() << " textures into " << layerCount << " layers of "
+              << pageWidth << " x " << pageHeight << "\n";
+    return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * A class to pack several textures into one GL_TEXTURE_2D_ARRAY, so that objects with
+ * different textures can be drawn without binding a new texture in between.
+ *
+ * Usage: Call add() for each TGA file, or for a Texture that is already loaded to read its
+ *        texels back instead of decoding its file again, then build(). Textures that do not
+ *        fit in an atlas with their padding get a layer each, and are stretched to the layer
+ *        size if they are smaller, so they wrap like ordinary textures. Smaller ones are
+ *        packed together into atlas layers with padding around them. Each texture is then
+ *        identified by a Region: a layer index, a UV rectangle (offset s, t and scale s, t)
+ *        within that layer and the highest mip level it may use. Bind id() to
+ *        GL_TEXTURE_2D_ARRAY once, and use setUniforms() before each draw with the
+ *        shaders/fragment_array.glsl shader, which maps the texture coordinates into the
+ *        rectangle. Texture coordinates wrap within each region, with the mip level chosen
+ *        from the unwrapped coordinates so there are no seams where they wrap. Atlas entries
+ *        are limited to the mip levels where their padding still separates them from their
+ *        neighbours.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <array>
+#include <string>
+#include <vector>
+
+class Texture;
+
+class TexturePacker {
+public:
+    struct Region {
+        GLuint layer = 0;
+        std::array<GLfloat, 4> uvRect = {{0.0f, 0.0f, 1.0f, 1.0f}};  // Offset st, scale st
+        GLfloat maxLod = 1000.0f;  // Highest mip level, lower for atlas entries
+    };
+
+    TexturePacker();
+
+    /* Destructor: deletes the array texture */
+    ~TexturePacker();
+
+    TexturePacker(const TexturePacker&) = delete;
+    TexturePacker& operator=(const TexturePacker&) = delete;
+
+    // Queue a TGA file for packing, returns the index of its region
+    size_t add(const std::string& filename);
+
+    // Queue level 0 of a loaded 2D texture, read back from the GPU by build() on the GL
+    // thread. The texture must stay loaded until then.
+    size_t add(const Texture& texture);
+
+    // Decode the queued files in parallel, pack them and create the array texture.
+    // padding is the number of pixels of replicated border around atlas entries.
+    bool build(GLuint padding = 4);
+
+    // returns the OpenGL texture ID of the GL_TEXTURE_2D_ARRAY
+    GLuint id() const;
+
+    GLuint layers() const;
+
+    const Region& region(size_t index) const;
+
+    // Set the layer (float), uvRect (vec4) and maxLod (float) uniforms of the current
+    // program for a region
+    void setUniforms(size_t index, GLint locationLayer, GLint locationUVRect,
+                     GLint locationMaxLod) const;
+
+private:
+    std::vector<std::string> files_;
+    std::vector<const Texture*> textures_;  // Texture to read back, or null to load the file
+    std::vector<Region> regions_;
+    GLuint textureID_;
+    GLuint layers_;
+    size_t sizeInBytes_;  // Of all levels, as counted by the MemoryTracker
+};
@@ -0,0 +1,123 @@
+/*
+ * Background loading of textures.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "TextureStreamer.hpp"
+#include "MemoryTracker.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+TextureStreamer::TextureStreamer(unsigned numThreads)
+    : nextId_(1), latencySumMs_(0.0), workers_(numThreads) {}
+
+void TextureStreamer::request(Texture* texture, const std::string& filename) {
+    unsigned long long id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = nextId_++;
+        requests_.push_back({texture, id, Clock::now(), Image(), MipChain(), false, 0});
+        metrics_.queueDepth = requests_.size();
+    }
+
+    const bool cpuMipmaps = Texture::loadOptions().cpuMipmaps;
+    workers_.enqueue([this, id, filename, cpuMipmaps] {
+        // File I/O, decoding and mipmap filtering happen here, without holding the lock
+        Image image;
+        MipChain chain;
+        if (cpuMipmaps) {
+            chain = Texture::loadMipChain(filename);
+        } else {
+            image = Image::load(filename);
+            Texture::downscale(image, filename);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(requests_.begin(), requests_.end(),
+                               [id](const Request& r) { return r.id == id; });
+        if (it != requests_.end()) {  // Otherwise the request was cancelled meanwhile
+            // A chain read from its cache file is mapped, not decoded into the heap
+            it->decodedBytes = cpuMipmaps ? (chain.isMapped() ? 0 : chain.totalSize())
+                                          : image.data.size();
+            MemoryTracker::track(MemoryTracker::DecodedImages, 0, it->decodedBytes);
+            it->image = std::move(image);
+            it->chain = std::move(chain);
+            it->decoded = true;
+        }
+    });
+}
+
+void TextureStreamer::cancel(Texture* texture) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Request& r : requests_) {
+        if (r.texture == texture) {
+            MemoryTracker::track(MemoryTracker::DecodedImages, r.decodedBytes, 0);
+        }
+    }
+    requests_.erase(std::remove_if(requests_.begin(), requests_.end(),
+                                   [texture](const Request& r) { return r.texture == texture; }),
+                    requests_.end());
+    metrics_.queueDepth = requests_.size();
+    texture->streamer_ = nullptr;
+}
+
+void TextureStreamer::update(double budgetMs) {
+    const Clock::time_point start = Clock::now();
+    metrics_.bytesUploadedLastFrame = 0;
+    metrics_.texturesUploadedLastFrame = 0;
+
+    while (true) {
+        Request done;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find_if(requests_.begin(), requests_.end(),
+                                   [](const Request& r) { return r.decoded; });
+            if (it == requests_.end()) {
+                break;
+            }
+            done = std::move(*it);
+            requests_.erase(it);
+            metrics_.queueDepth = requests_.size();
+        }
+
+        // Only this thread removes requests, so the texture is still alive here
+        done.texture->streamer_ = nullptr;
+        size_t bytes = 0;
+        if (!done.chain.empty()) {
+            done.texture->uploadLevels(done.chain);
+            bytes = done.chain.totalSize();
+        } else if (!done.image.data.empty()) {
+            done.texture->uploadImage(done.image);
+            bytes = done.image.data.size();
+        } else {
+            std::cerr << "Asynchronous texture load failed, keeping the placeholder\n";
+        }
+        MemoryTracker::track(MemoryTracker::DecodedImages, done.decodedBytes, 0);
+        if (bytes > 0) {
+            metrics_.bytesUploadedLastFrame += bytes;
+            metrics_.bytesUploadedTotal += bytes;
+            metrics_.texturesUploadedLastFrame++;
+        }
+
+        const Clock::time_point now = Clock::now();
+        const double latencyMs =
+            std::chrono::duration<double, std::milli>(now - done.requested).count();
+        metrics_.texturesReady++;
+        metrics_.lastLatencyMs = latencyMs;
+        metrics_.maxLatencyMs = std::max(metrics_.maxLatencyMs, latencyMs);
+        latencySumMs_ += latencyMs;
+        metrics_.averageLatencyMs = latencySumMs_ / metrics_.texturesReady;
+
+        if (std::chrono::duration<double, std::milli>(now - start).count() >= budgetMs) {
+            break;
+        }
+    }
+}
+
+TextureStreamer::Metrics TextureStreamer::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return metrics_;
+}
@@ -0,0 +1,74 @@
+/*
+ * Background loading of textures.
+ *
+ * Usage: Create one TextureStreamer before the textures it loads, and call
+ *        Texture::createTextureAsync() to queue a file. Worker threads read and decode
+ *        the files (and build their mipmaps, see Texture::LoadOptions), and update()
+ *        uploads finished images on the GL thread. Call update() once per frame with
+ *        the time in milliseconds it may spend on uploads.
+ *        metrics() reports the current queue depth, load latencies and upload volume.
+ *        All member functions are meant to be called from the GL thread.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+
+class TextureStreamer {
+public:
+    struct Metrics {
+        size_t queueDepth = 0;           // Requests not yet uploaded (decoding or decoded)
+        size_t texturesReady = 0;        // Textures uploaded since the streamer was created
+        double lastLatencyMs = 0.0;      // Request-to-ready time of the latest upload
+        double averageLatencyMs = 0.0;   // Mean request-to-ready time over all uploads
+        double maxLatencyMs = 0.0;       // Longest request-to-ready time
+        size_t bytesUploadedLastFrame = 0;
+        size_t texturesUploadedLastFrame = 0;
+        size_t bytesUploadedTotal = 0;
+    };
+
+    /* Constructor: start numThreads decode workers, 0 means one per hardware thread */
+    explicit TextureStreamer(unsigned numThreads = 0);
+
+    // Queue a file for decoding, the result is uploaded into texture by update()
+    void request(Texture* texture, const std::string& filename);
+
+    // Forget any pending request for a texture (called when it is destroyed or reloaded)
+    void cancel(Texture* texture);
+
+    // Upload decoded images until budgetMs milliseconds have passed. At least one image
+    // is uploaded per call if any is ready, so loading always makes progress.
+    void update(double budgetMs);
+
+    Metrics metrics() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        Texture* texture;
+        unsigned long long id;  // Distinguishes a request from a later one for the same texture
+        Clock::time_point requested;
+        Image image;          // Decoded level 0, when GL generates the mipmaps
+        MipChain chain;       // All levels, when the mipmaps are filtered on the CPU
+        bool decoded;
+        size_t decodedBytes;  // Of the image or the chain, counted by the MemoryTracker
+    };
+
+    mutable std::mutex mutex_;
+    std::deque<Request> requests_;
+    unsigned long long nextId_;
+    Metrics metrics_;
+    double latencySumMs_;
+
+    // Declared last so the workers are joined before the queue is destroyed
+    ThreadPool workers_;
+};
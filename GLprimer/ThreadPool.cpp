@@ -0,0 +1,73 @@
+/*
+ * A small fixed-size pool of worker threads.
+ *
+ * This code is in the public domain.
+ */
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned numThreads) : running_(0), stopping_(false) {
+    if (numThreads == 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(numThreads);
+    for (unsigned i = 0; i < numThreads; i++) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    jobAvailable_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    jobAvailable_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return jobs_.empty() && running_ == 0; });
+}
+
+size_t ThreadPool::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_.size();
+}
+
+size_t ThreadPool::size() const { return workers_.size(); }
+
+void ThreadPool::workerLoop() {
+    TRACE_THREAD("worker");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        jobAvailable_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return;  // Stopping, and nothing left to do
+        }
+        std::function<void()> job = std::move(jobs_.front());
+        jobs_.pop_front();
+        ++running_;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        --running_;
+        if (jobs_.empty() && running_ == 0) {
+            idle_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * A small fixed-size pool of worker threads.
+ *
+ * Usage: Create a pool, then call enqueue() with any callable taking no arguments.
+ *        The jobs are run in FIFO order by the first available worker. wait() blocks
+ *        until all jobs enqueued so far have finished. The destructor finishes the
+ *        remaining jobs and joins the workers.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    /* Constructor: start numThreads workers, 0 means one per hardware thread */
+    explicit ThreadPool(unsigned numThreads = 0);
+
+    /* Destructor: run the jobs still queued and join the workers */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Add a job to the queue
+    void enqueue(std::function<void()> job);
+
+    // Block until the queue is empty and no job is running
+    void wait();
+
+    // Number of jobs waiting to be started
+    size_t pending() const;
+
+    size_t size() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    mutable std::mutex mutex_;
+    std::condition_variable jobAvailable_;
+    std::condition_variable idle_;
+    size_t running_;
+    bool stopping_;
+};
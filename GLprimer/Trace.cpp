@@ -0,0 +1,180 @@
+/*
+ * Scoped CPU trace zones, written as a Chrome trace file.
+ *
+ * This code is in the public domain.
+ */
+#include "Trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    int64_t begin;
+    int64_t end;
+};
+
+// The zones of one thread. Only the thread writes the events, and publishes them with count,
+// so write() can read the first count events at any time.
+struct ThreadBuffer {
+    std::unique_ptr<Event[]> events;  // Null once the thread has exited
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+    unsigned id = 0;
+    std::string name;              // Guarded by the registry mutex
+    std::vector<Event> finished;   // The events of an exited thread, guarded by the mutex
+};
+
+// All threads, kept until the program ends so the zones of finished threads are written
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<std::unique_ptr<Event[]>> spare;  // Event arrays of exited threads
+};
+
+// Never destroyed, threads can still exit during static destruction, such as the workers of
+// a pool in a function-local static
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+const std::chrono::steady_clock::time_point traceStart = std::chrono::steady_clock::now();
+
+ThreadBuffer* registerThread() {
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.spare.empty()) {
+        buffer->events.reset(new Event[Trace::eventsPerThread]);
+    } else {
+        buffer->events = std::move(reg.spare.back());
+        reg.spare.pop_back();
+    }
+    buffer->id = static_cast<unsigned>(reg.buffers.size() + 1);
+    reg.buffers.push_back(std::move(buffer));
+    return reg.buffers.back().get();
+}
+
+// Keep the events of an exiting thread and hand its array to the next thread
+void retireThread(ThreadBuffer& buffer) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    const size_t count = buffer.count.load(std::memory_order_acquire);
+    buffer.finished.assign(buffer.events.get(), buffer.events.get() + count);
+    reg.spare.push_back(std::move(buffer.events));
+}
+
+// Registers the thread on first use and retires it when the thread exits
+struct ThreadSlot {
+    ThreadBuffer* buffer = nullptr;
+    ~ThreadSlot() {
+        if (buffer) {
+            retireThread(*buffer);
+            buffer = nullptr;
+        }
+    }
+};
+
+ThreadBuffer& threadBuffer() {
+    thread_local ThreadSlot slot;
+    if (!slot.buffer) {
+        slot.buffer = registerThread();
+    }
+    return *slot.buffer;
+}
+
+// Quote a string for JSON
+std::string quoted(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+}  // namespace
+
+int64_t Trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - traceStart)
+        .count();
+}
+
+void Trace::record(const char* name, int64_t begin, int64_t end) {
+    ThreadBuffer& buffer = threadBuffer();
+    const size_t count = buffer.count.load(std::memory_order_relaxed);
+    if (count == eventsPerThread) {
+        buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[count] = {name, begin, end};
+    buffer.count.store(count + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const std::string& name) {
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+bool Trace::write(const std::string& filename) {
+    std::ofstream out(filename);
+    if (!out.is_open()) {
+        std::cerr << "Could not write trace ('" << filename << "')\n";
+        return false;
+    }
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t dropped = 0;
+    char line[200];
+    for (const std::unique_ptr<ThreadBuffer>& buffer : reg.buffers) {
+        if (!buffer->name.empty()) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                << "\"tid\":" << buffer->id << ",\"args\":{\"name\":" << quoted(buffer->name)
+                << "}}";
+            first = false;
+        }
+        // Times in microseconds
+        const Event* events = buffer->events ? buffer->events.get() : buffer->finished.data();
+        const size_t count = buffer->events ? buffer->count.load(std::memory_order_acquire)
+                                            : buffer->finished.size();
+        for (size_t i = 0; i < count; i++) {
+            const Event& event = events[i];
+            snprintf(line, sizeof(line), ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                                         "\"dur\":%.3f}",
+                     buffer->id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+            out << (first ? "" : ",\n") << "{\"name\":" << quoted(event.name) << line;
+            first = false;
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    out << "\n]}\n";
+    if (dropped > 0) {
+        std::cerr << dropped << " trace zones were dropped, the thread buffers are full\n";
+    }
+    if (out.fail()) {
+        std::cerr << "Could not write trace ('" << filename << "')\n";
+        return false;
+    }
+    return true;
+}
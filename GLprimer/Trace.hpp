@@ -0,0 +1,71 @@
+/*
+ * Scoped CPU trace zones, written as a Chrome trace file.
+ *
+ * Usage: Put TRACE_ZONE("name") at the start of a scope to measure it, the name must be a
+ *        string literal. The zone ends with the scope, and zones nest. TRACE_THREAD("name")
+ *        names the calling thread in the trace. Each thread records its zones into its own
+ *        buffer without locks, and Trace::write() copies the zones recorded so far by all
+ *        threads into a JSON file, which chrome://tracing and ui.perfetto.dev open, with a
+ *        row per thread. A thread records at most eventsPerThread zones, later ones are
+ *        dropped. When a thread exits, its zones are copied into an array of their size and
+ *        its buffer is reused by the next thread, so threads of short-lived pools do not
+ *        each keep a full buffer. The zones are compiled in when NDEBUG is not defined or
+ *        TRACE_ENABLE is, otherwise the macros expand to nothing and Trace::enabled is false.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if !defined(NDEBUG) || defined(TRACE_ENABLE)
+#define TRACE_ENABLED
+#endif
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef TRACE_ENABLED
+#define TRACE_ZONE(name) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_THREAD(name) Trace::setThreadName(name)
+#else
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#endif
+
+class Trace {
+public:
+#ifdef TRACE_ENABLED
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+    static const size_t eventsPerThread = 1 << 16;
+
+    // Records the time from its construction to its destruction
+    class Zone {
+    public:
+        explicit Zone(const char* name) : name_(name), begin_(Trace::now()) {}
+        ~Zone() { Trace::record(name_, begin_, Trace::now()); }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char* name_;
+        int64_t begin_;
+    };
+
+    // Name the calling thread, the name is copied
+    static void setThreadName(const std::string& name);
+
+    // Write the zones recorded so far, returns false on failure
+    static bool write(const std::string& filename);
+
+    // Nanoseconds since the start of the program
+    static int64_t now();
+
+    // Add a zone to the buffer of the calling thread
+    static void record(const char* name, int64_t begin, int64_t end);
+};
@@ -1,11 +1,15 @@
 /*
- * A class to manage a basic OpenGL VertexArray and index array in an OpenGL VertexArray object.
+ * A class to upload a Mesh to an OpenGL VertexArray object and render it.
  *
- * Usage: The methods createXXX() create geometry from fixed arrays or procedural
- *        descriptions.
- *        The method loadOBJ() loads geometry from an OBJ file. Only the mesh is loaded. Material
- *        information is ignored. Only triangles are supported. OBJ files with quads are rejected.
- *        Call render() to draw the mesh in OpenGL.
+ * Usage: The methods createXXX() and readOBJ() create the geometry in a Mesh, see Mesh.hpp,
+ *        and upload it. Call render() to draw the mesh in OpenGL. bounds() is the
+ *        axis-aligned box around the vertices, for culling.
+ *        The vertex and index arrays are freed once they are uploaded, unless
+ *        setKeepCPUCopy(true) is called before the geometry is created, and mesh() is the
+ *        CPU copy while it is kept. A ResidencyManager can only free the GL buffers of
+ *        meshes that keep the arrays, render() uploads them again when needed. The memory of
+ *        both is counted by the MemoryTracker.
+ *        Tools without a GL context, such as the SoftwareRasterizer, use a Mesh directly.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2013-2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -15,12 +19,18 @@
 #pragma once
 
 #include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <array>
 #include <string>
-#include <vector>
+
+#include "Mesh.hpp"
+
+class ResidencyManager;
 
 // A class to hold geometry data and send it off for rendering
 class TriangleSoup {
 public:
+    using Bounds = Mesh::Bounds;
+
     /* Constructor: initialize a triangleSoup object to all zeros */
     TriangleSoup();
 
@@ -39,7 +49,7 @@ public:
     /* Create a sphere (approximated by polygon segments) */
     void createSphere(float radius, int segments);
 
-    /* Load geometry from an OBJ file */
+    /* Load geometry from an OBJ file, the mesh is left empty if it cannot be read */
     void readOBJ(const std::string& filename);
 
     /* Print data from a triangleSoup object, for debugging purposes */
@@ -51,14 +61,53 @@ public:
     /* Render the geometry in a triangleSoup object */
     void render();
 
+    /* Return the size of the vertex and index buffers in bytes, 0 if they are not allocated */
+    size_t sizeInBytes() const;
+
+    /* Return the extents of the mesh in model coordinates */
+    Bounds bounds() const;
+
+    /* The vertex and index arrays, empty unless they are kept after upload */
+    const Mesh& mesh() const;
+
+    /* Keep the vertex and index arrays in CPU memory after upload. Clearing it frees them
+     * right away if the buffers are already uploaded. */
+    void setKeepCPUCopy(bool keep);
+    bool keepsCPUCopy() const;
+
 private:
+    friend class CommandList;
+    friend class ResidencyManager;
+
     void printError(const char* errtype, const char* errmsg);
 
-    GLuint vao_;                        // Vertex array object, the main handle for geometry
-    int nverts_;                        // Number of vertices in the vertex array
-    int ntris_;                         // Number of triangles in the index array (may be zero)
-    GLuint vertexbuffer_;               // Buffer ID to bind to GL_ARRAY_BUFFER
-    GLuint indexbuffer_;                // Buffer ID to bind to GL_ELEMENT_ARRAY_BUFFER
-    std::vector<GLfloat> vertexarray_;  // Vertex array on interleaved format: x y z nx ny nz s t
-    std::vector<GLuint> indexarray_;    // Element index array
+    /* Create the vertex array object and buffers from mesh_, and take its counts and bounds */
+    void upload();
+
+    /* Free the vertex array object and buffers, keeping the vertex and index arrays */
+    void release();
+
+    /* Upload the buffers again if they have been evicted, and return the vertex array object */
+    GLuint residentVAO();
+
+    /* Account the buffers that were just created, and free the arrays unless they are kept */
+    void uploaded();
+
+    /* Free the vertex and index arrays */
+    void dropCPUCopy();
+
+    /* Report the bytes held by the arrays and the buffers to the MemoryTracker */
+    void trackMemory();
+
+    GLuint vao_;                   // Vertex array object, the main handle for geometry
+    int nverts_;                   // Number of vertices in the vertex buffer
+    int ntris_;                    // Number of triangles in the index buffer (may be zero)
+    GLuint vertexbuffer_;          // Buffer ID to bind to GL_ARRAY_BUFFER
+    GLuint indexbuffer_;           // Buffer ID to bind to GL_ELEMENT_ARRAY_BUFFER
+    Mesh mesh_;                    // CPU copy of the vertex and index arrays
+    ResidencyManager* residency_;  // Set while the mesh is managed
+    Bounds bounds_;                // Extents of the vertex coordinates
+    bool keepCPUCopy_;             // Keep the arrays after upload
+    size_t trackedArrayBytes_;     // Bytes last reported to the MemoryTracker
+    size_t trackedBufferBytes_;
 };
@@ -7,6 +7,7 @@
  * This code is in the public domain.
  */
 #include "Utilities.hpp"
+#include "FrameStats.hpp"
 
 #include <GLFW/glfw3.h>
 #include <cstdio>
@@ -14,31 +15,15 @@
 
 namespace util {
 
-    double displayFPS(GLFWwindow* window) {
-        static int frames = 0;
-        static double fps = 0.0;
-
-        static double t0 = glfwGetTime();  // Gets number of seconds since glfwInit()
-
-        double t = glfwGetTime();  // Get current time
-
-        // update fps only once every second
-        if (t - t0 >= 1.0) {
-            fps = static_cast<double>(frames) / (t - t0);
-            t0 = t;
-            frames = 0;
-        }
-
-        // update the window title
-        if (frames == 0) {
+    double displayFPS(GLFWwindow* window, FrameStats& stats, const std::string& extra) {
+        // update the window title only when the statistics are updated, once every second
+        if (stats.frame()) {
+            const FrameStats::Stats current = stats.stats();
             char title[201];
-            // convert fps to milliseconds
-            double frametime = (fps > 0.0) ? 1000.0 / fps : 0.0;
-            snprintf(title, 200, "TNM046: %.2f ms/frame (%.1f FPS)", frametime, fps);
-            glfwSetWindowTitle(window, title);
+            snprintf(title, 200, "TNM046: %.2f ms/frame (%.1f FPS)  %s", current.averageMs,
+                     current.fps, stats.summary().c_str());
+            glfwSetWindowTitle(window, (title + std::string("  ") + extra).c_str());
         }
-
-        ++frames;
-        return fps;
+        return stats.stats().fps;
     }
 }  // namespace util
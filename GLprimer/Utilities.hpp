@@ -8,7 +8,10 @@
  */
 #pragma once
 
+#include <string>
+
 struct GLFWwindow;
+class FrameStats;
 
 namespace util {
 
@@ -16,11 +19,12 @@ namespace util {
  * displayFPS() - Calculate, display and return frame rate statistics.
  * Called every frame, but statistics are updated only once per second.
  * The time per frame is a better measure of performance than the
- * number of frames per second, so both are displayed.
+ * number of frames per second, so both are displayed, followed by the
+ * percentiles of the frame times, which show stutter that the average hides.
  *
- * NOTE: This function doesn't work properly if you call it for multiple
- * windows. Call it only for one window, and only once every frame.
+ * NOTE: Use one FrameStats per window, and call this only once every frame.
+ * The optional extra text is appended to the title, e.g. the memory use.
  */
-double displayFPS(GLFWwindow* window);
+double displayFPS(GLFWwindow* window, FrameStats& stats, const std::string& extra = "");
 
 }  // namespace util
@@ -0,0 +1,499 @@
+/*
+ * Virtual texturing for TGA images too large to upload in one piece.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "VirtualTexture.hpp"
+#include "GLState.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const GLsizei feedbackScale = 4;  // The feedback buffer is 1/4 of the viewport in each direction
+const GLuint maxLevels = 16;      // Size of the pageOffset uniform array in the shaders
+
+}  // namespace
+
+VirtualTexture::VirtualTexture(GLuint tileSize, GLuint cacheTiles)
+    : tileSize_(std::max(tileSize, 16u))
+    , cacheTiles_(std::clamp(cacheTiles, 2u, 255u))
+    , pixels_(nullptr)
+    , bytesPerPixel_(0)
+    , width_(0)
+    , height_(0)
+    , levels_(0)
+    , cacheTexture_(0)
+    , pageTexture_(0)
+    , pageTableDirty_(false)
+    , frame_(0)
+    , feedbackFBO_(0)
+    , feedbackColor_(0)
+    , feedbackDepth_(0)
+    , feedbackPBO_{0, 0}
+    , feedbackWidth_(0)
+    , feedbackHeight_(0)
+    , feedbackSizes_{0, 0}
+    , feedbackIndex_(0)
+    , viewport_{0, 0, 0, 0}
+    , decodedMemory_(MemoryTracker::DecodedImages)
+    , textureMemory_(MemoryTracker::Textures)
+    , feedbackMemory_(MemoryTracker::StagingBuffers) {}
+
+VirtualTexture::~VirtualTexture() {
+    if (cacheTexture_ != 0) {
+        GLState::deleteTexture(cacheTexture_);
+        GLState::deleteTexture(pageTexture_);
+    }
+    if (feedbackFBO_ != 0) {
+        glDeleteFramebuffers(1, &feedbackFBO_);
+        glDeleteRenderbuffers(1, &feedbackColor_);
+        glDeleteRenderbuffers(1, &feedbackDepth_);
+        glDeleteBuffers(2, feedbackPBO_);
+    }
+}
+
+GLuint VirtualTexture::width() const { return width_; }
+
+GLuint VirtualTexture::height() const { return height_; }
+
+GLuint VirtualTexture::levels() const { return levels_; }
+
+VirtualTexture::Stats VirtualTexture::stats() const {
+    Stats stats = stats_;
+    stats.resident = resident_.size();
+    return stats;
+}
+
+void VirtualTexture::resetStats() { stats_ = Stats(); }
+
+/*
+ * Open a TGA file as a virtual texture. Nothing but the coarsest tile is uploaded here,
+ * but building that tile reads every texel of the image once.
+ */
+bool VirtualTexture::open(const std::string& filename) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cerr << "Could not open texture file ('" << filename << "')\n";
+        return false;
+    }
+    Image header;
+    bool compressed = false;
+    const size_t offset =
+        Image::parseTGAHeader(file.data(), file.size(), filename, header, compressed);
+    if (offset == 0) {
+        return false;
+    }
+
+    bytesPerPixel_ = (header.type == GL_RGBA) ? 4 : 3;
+    if (compressed) {
+        // RLE packets can not be addressed by position, so the image is decoded once
+        Image decoded = Image::loadUncompressedTGA(filename);
+        if (decoded.data.empty()) {
+            return false;
+        }
+        decoded_ = std::move(decoded);
+        file_.close();
+        pixels_ = decoded_.data.data();
+        decodedMemory_.resize(decoded_.data.size());
+    } else {
+        const size_t imageSize = size_t(header.width) * header.height * bytesPerPixel_;
+        if (file.size() - offset < imageSize) {
+            std::cerr << "Truncated TGA file ('" << filename << "')\n";
+            return false;
+        }
+        decoded_ = Image();
+        decodedMemory_.resize(0);
+        file_ = std::move(file);
+        pixels_ = file_.data() + offset;
+    }
+    width_ = header.width;
+    height_ = header.height;
+
+    // Down to the first level that fits in a single tile
+    levels_ = 1;
+    while (levelWidth(levels_ - 1) > tileSize_ || levelHeight(levels_ - 1) > tileSize_) {
+        levels_++;
+    }
+    pageOffsets_.assign(1, 0);
+    for (GLuint level = 0; level < levels_; level++) {
+        pageOffsets_.push_back(pageOffsets_.back() + tilesX(level));
+    }
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    cacheTiles_ = std::min(cacheTiles_, GLuint(maxTextureSize) / (tileSize_ + 2));
+    const GLsizei cacheSize = cacheTiles_ * (tileSize_ + 2);
+
+    if (cacheTexture_ == 0) {
+        glGenTextures(1, &cacheTexture_);
+        glGenTextures(1, &pageTexture_);
+    }
+    GLState::bindTexture(GL_TEXTURE_2D, cacheTexture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cacheSize, cacheSize, 0, GL_BGRA, GL_UNSIGNED_BYTE,
+                 nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    // Integer texels, read with texelFetch()
+    GLState::bindTexture(GL_TEXTURE_2D, pageTexture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, pageOffsets_.back(), tilesY(0), 0,
+                 GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    pageTable_.assign(size_t(pageOffsets_.back()) * tilesY(0) * 4, 0);
+    textureMemory_.resize(size_t(cacheSize) * cacheSize * 4 + pageTable_.size());
+
+    slots_.assign(size_t(cacheTiles_) * cacheTiles_, Slot{0, 0, false});
+    resident_.clear();
+    requested_.clear();
+    missing_.clear();
+    coarseTiles_.clear();
+    coarseIndex_.clear();
+    stats_ = Stats();
+
+    // The coarsest tile is the fallback for everything else, so it is never evicted
+    loadTile(tileKey(levels_ - 1, 0, 0), 0);
+    slots_[0].lastUsed = ULLONG_MAX;
+    stats_.uploads = 0;
+    updatePageTable();
+
+    std::cout << "Virtual texture " << width_ << " x " << height_ << ", " << levels_
+              << " levels, " << cacheTiles_ * cacheTiles_ << " cache tiles of " << tileSize_
+              << " x " << tileSize_ << " ('" << filename << "')\n";
+    return true;
+}
+
+VirtualTexture::TileKey VirtualTexture::tileKey(GLuint level, GLuint x, GLuint y) {
+    return (TileKey(level) << 40) | (TileKey(y) << 20) | TileKey(x);
+}
+
+GLuint VirtualTexture::levelWidth(GLuint level) const { return std::max(width_ >> level, 1u); }
+
+GLuint VirtualTexture::levelHeight(GLuint level) const { return std::max(height_ >> level, 1u); }
+
+GLuint VirtualTexture::tilesX(GLuint level) const {
+    return (levelWidth(level) + tileSize_ - 1) / tileSize_;
+}
+
+GLuint VirtualTexture::tilesY(GLuint level) const {
+    return (levelHeight(level) + tileSize_ - 1) / tileSize_;
+}
+
+void VirtualTexture::readRegion(GLuint level, int x0, int y0, GLuint w, GLuint h, GLubyte* dst) {
+    const int lastX = int(levelWidth(level)) - 1;
+    const int lastY = int(levelHeight(level)) - 1;
+    for (GLuint j = 0; j < h; j++) {
+        const int y = std::clamp(y0 + int(j), 0, lastY);
+        GLubyte* out = dst + size_t(j) * w * 4;
+        if (level == 0) {
+            const GLubyte* row = pixels_ + size_t(y) * width_ * bytesPerPixel_;
+            for (GLuint i = 0; i < w; i++) {
+                const GLubyte* pixel = row + size_t(std::clamp(x0 + int(i), 0, lastX)) *
+                                                 bytesPerPixel_;
+                out[4 * i] = pixel[0];
+                out[4 * i + 1] = pixel[1];
+                out[4 * i + 2] = pixel[2];
+                out[4 * i + 3] = (bytesPerPixel_ == 4) ? pixel[3] : 255;
+            }
+        } else {
+            // The tile is only looked up again when the row crosses into the next one
+            const GLuint tileY = GLuint(y) / tileSize_;
+            const size_t rowOffset = size_t(GLuint(y) % tileSize_) * tileSize_;
+            const GLubyte* tile = nullptr;
+            GLuint tileX = UINT_MAX;
+            for (GLuint i = 0; i < w; i++) {
+                const GLuint x = GLuint(std::clamp(x0 + int(i), 0, lastX));
+                if (x / tileSize_ != tileX) {
+                    tileX = x / tileSize_;
+                    tile = coarseTile(level, tileX, tileY).data();
+                }
+                std::memcpy(out + 4 * i, tile + (rowOffset + x % tileSize_) * 4, 4);
+            }
+        }
+    }
+}
+
+const std::vector<GLubyte>& VirtualTexture::coarseTile(GLuint level, GLuint x, GLuint y) {
+    const TileKey key = tileKey(level, x, y);
+    auto found = coarseIndex_.find(key);
+    if (found != coarseIndex_.end()) {
+        coarseTiles_.splice(coarseTiles_.begin(), coarseTiles_, found->second);
+        return found->second->second;
+    }
+
+    // Average each 2x2 block of the level below
+    const GLuint size = tileSize_;
+    std::vector<GLubyte> below(size_t(4) * size * size * 4);
+    readRegion(level - 1, int(2 * x * size), int(2 * y * size), 2 * size, 2 * size,
+               below.data());
+    std::vector<GLubyte> texels(size_t(size) * size * 4);
+    for (GLuint j = 0; j < size; j++) {
+        const GLubyte* row0 = below.data() + size_t(2 * j) * 2 * size * 4;
+        const GLubyte* row1 = row0 + size_t(2) * size * 4;
+        GLubyte* out = texels.data() + size_t(j) * size * 4;
+        for (GLuint i = 0; i < size * 4; i++) {
+            const GLuint c = (i / 4) * 8 + i % 4;
+            out[i] = GLubyte((row0[c] + row0[c + 4] + row1[c] + row1[c + 4] + 2) >> 2);
+        }
+    }
+
+    coarseTiles_.emplace_front(key, std::move(texels));
+    coarseIndex_[key] = coarseTiles_.begin();
+    // Keep twice the cache in system memory, which covers the recursion for any tile
+    const size_t capacity = std::max<size_t>(64, slots_.size() * 2);
+    while (coarseTiles_.size() > capacity) {
+        coarseIndex_.erase(coarseTiles_.back().first);
+        coarseTiles_.pop_back();
+    }
+    return coarseTiles_.front().second;
+}
+
+void VirtualTexture::loadTile(TileKey key, size_t slot) {
+    const GLuint level = GLuint(key >> 40);
+    const GLuint y = GLuint((key >> 20) & 0xFFFFF);
+    const GLuint x = GLuint(key & 0xFFFFF);
+    const GLuint padded = tileSize_ + 2;
+
+    std::vector<GLubyte> texels(size_t(padded) * padded * 4);
+    readRegion(level, int(x * tileSize_) - 1, int(y * tileSize_) - 1, padded, padded,
+               texels.data());
+
+    GLState::bindTexture(GL_TEXTURE_2D, cacheTexture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(slot % cacheTiles_ * padded),
+                    GLint(slot / cacheTiles_ * padded), padded, padded, GL_BGRA,
+                    GL_UNSIGNED_BYTE, texels.data());
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+
+    slots_[slot] = Slot{key, frame_, true};
+    resident_[key] = slot;
+    stats_.uploads++;
+    pageTableDirty_ = true;
+}
+
+/*
+ * Record a tile sampled this frame. A resident tile is marked as recently used. A missing
+ * tile is queued together with any missing coarser tiles that cover it, and the resident
+ * tile it falls back to meanwhile is marked as used.
+ */
+void VirtualTexture::request(GLuint level, GLuint x, GLuint y) {
+    if (level >= levels_ || x >= tilesX(level) || y >= tilesY(level)) {
+        return;
+    }
+    TileKey key = tileKey(level, x, y);
+    if (!requested_.insert(key).second) {
+        return;
+    }
+
+    auto found = resident_.find(key);
+    if (found != resident_.end()) {
+        stats_.hits++;
+    } else {
+        stats_.misses++;
+        do {
+            missing_.insert(key);
+            level++;
+            x = std::min(x / 2, tilesX(level) - 1);
+            y = std::min(y / 2, tilesY(level) - 1);
+            key = tileKey(level, x, y);
+            found = resident_.find(key);
+        } while (found == resident_.end());
+    }
+    Slot& slot = slots_[found->second];
+    if (slot.lastUsed != ULLONG_MAX) {
+        slot.lastUsed = frame_;
+    }
+}
+
+bool VirtualTexture::findSlot(size_t& slot) const {
+    bool found = false;
+    unsigned long long oldest = frame_;  // Tiles sampled this frame are not replaced
+    for (size_t i = 0; i < slots_.size(); i++) {
+        if (!slots_[i].used) {
+            slot = i;
+            return true;
+        }
+        if (slots_[i].lastUsed < oldest) {
+            oldest = slots_[i].lastUsed;
+            slot = i;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void VirtualTexture::update(size_t maxUploads) {
+    // The level is in the top bits of the key, so the coarsest tiles are loaded first
+    std::vector<TileKey> order(missing_.begin(), missing_.end());
+    std::sort(order.begin(), order.end(), std::greater<TileKey>());
+
+    size_t loaded = 0;
+    size_t slot = 0;
+    while (loaded < std::min(maxUploads, order.size()) && findSlot(slot)) {
+        if (slots_[slot].used) {
+            resident_.erase(slots_[slot].key);
+            stats_.evictions++;
+        }
+        loadTile(order[loaded], slot);
+        loaded++;
+    }
+    stats_.pending = order.size() - loaded;
+
+    // Tiles still missing are requested again by the next feedback pass if they are needed
+    missing_.clear();
+    requested_.clear();
+    if (pageTableDirty_) {
+        updatePageTable();
+    }
+    frame_++;
+}
+
+void VirtualTexture::updatePageTable() {
+    const size_t pageWidth = pageOffsets_.back();
+    for (GLuint level = levels_; level-- > 0;) {
+        for (GLuint y = 0; y < tilesY(level); y++) {
+            for (GLuint x = 0; x < tilesX(level); x++) {
+                GLubyte* entry = &pageTable_[(y * pageWidth + pageOffsets_[level] + x) * 4];
+                auto found = resident_.find(tileKey(level, x, y));
+                if (found != resident_.end()) {
+                    entry[0] = GLubyte(found->second % cacheTiles_);
+                    entry[1] = GLubyte(found->second / cacheTiles_);
+                    entry[2] = GLubyte(level);
+                    entry[3] = 1;
+                } else if (level + 1 < levels_) {
+                    // Same entry as the parent, which has already been filled in
+                    const GLuint parentX = std::min(x / 2, tilesX(level + 1) - 1);
+                    const GLuint parentY = std::min(y / 2, tilesY(level + 1) - 1);
+                    std::memcpy(entry,
+                                &pageTable_[(parentY * pageWidth + pageOffsets_[level + 1] +
+                                             parentX) * 4],
+                                4);
+                }
+            }
+        }
+    }
+
+    GLState::bindTexture(GL_TEXTURE_2D, pageTexture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(pageWidth), tilesY(0), GL_RGBA_INTEGER,
+                    GL_UNSIGNED_BYTE, pageTable_.data());
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    pageTableDirty_ = false;
+}
+
+void VirtualTexture::beginFeedback() {
+    glGetIntegerv(GL_VIEWPORT, viewport_);
+    const GLsizei width = std::max(viewport_[2] / feedbackScale, 1);
+    const GLsizei height = std::max(viewport_[3] / feedbackScale, 1);
+
+    if (width != feedbackWidth_ || height != feedbackHeight_) {
+        if (feedbackFBO_ == 0) {
+            glGenFramebuffers(1, &feedbackFBO_);
+            glGenRenderbuffers(1, &feedbackColor_);
+            glGenRenderbuffers(1, &feedbackDepth_);
+            glGenBuffers(2, feedbackPBO_);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackColor_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth_);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                                  feedbackColor_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                                  feedbackDepth_);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Virtual texture feedback framebuffer is incomplete\n";
+        }
+
+        for (GLuint pbo : feedbackPBO_) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size_t(width) * height * 4 * sizeof(GLushort),
+                         nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        // Color and depth renderbuffers, and the two buffers they are read back into
+        feedbackMemory_.resize(size_t(width) * height * (4 * sizeof(GLushort) + 4) +
+                               2 * size_t(width) * height * 4 * sizeof(GLushort));
+        feedbackWidth_ = width;
+        feedbackHeight_ = height;
+        feedbackSizes_[0] = feedbackSizes_[1] = 0;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO_);
+    glViewport(0, 0, width, height);
+    const GLuint nothing[4] = {0, 0, 0, 0};  // Alpha 0 marks pixels that sampled no tile
+    glClearBufferuiv(GL_COLOR, 0, nothing);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+/*
+ * Start the read back of this frame's feedback into a pixel pack buffer, and process the
+ * previous frame's, which has had a frame to arrive. This avoids waiting for the GPU.
+ */
+void VirtualTexture::endFeedback() {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO_[feedbackIndex_]);
+    glReadPixels(0, 0, feedbackWidth_, feedbackHeight_, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT,
+                 nullptr);
+    feedbackSizes_[feedbackIndex_] = feedbackWidth_ * feedbackHeight_;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport_[0], viewport_[1], viewport_[2], viewport_[3]);
+
+    feedbackIndex_ ^= 1;
+    const GLsizei count = feedbackSizes_[feedbackIndex_];
+    if (count > 0) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO_[feedbackIndex_]);
+        const GLushort* texels = static_cast<const GLushort*>(glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, size_t(count) * 4 * sizeof(GLushort), GL_MAP_READ_BIT));
+        if (texels) {
+            const GLushort* previous = nullptr;
+            for (GLsizei i = 0; i < count; i++) {
+                const GLushort* texel = texels + 4 * i;
+                // Neighbouring pixels mostly sample the same tile
+                if (texel[3] == 0 || (previous && std::memcmp(texel, previous, 8) == 0)) {
+                    continue;
+                }
+                request(texel[2], texel[0], texel[1]);
+                previous = texel;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        feedbackSizes_[feedbackIndex_] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::setUniforms(GLuint program, GLuint cacheUnit, GLuint pageUnit) const {
+    GLState::activeTexture(cacheUnit);
+    GLState::bindTexture(GL_TEXTURE_2D, cacheTexture_);
+    GLState::activeTexture(pageUnit);
+    GLState::bindTexture(GL_TEXTURE_2D, pageTexture_);
+    GLState::activeTexture(0);
+
+    GLint offsets[maxLevels] = {};
+    std::copy(pageOffsets_.begin(), pageOffsets_.begin() + std::min(levels_, maxLevels),
+              offsets);
+
+    // Uniforms a shader does not use have location -1, which glUniform*() ignores
+    glUniform1i(glGetUniformLocation(program, "cacheTex"), GLint(cacheUnit));
+    glUniform1i(glGetUniformLocation(program, "pageTable"), GLint(pageUnit));
+    glUniform2f(glGetUniformLocation(program, "vtSize"), GLfloat(width_), GLfloat(height_));
+    glUniform1f(glGetUniformLocation(program, "tileSize"), GLfloat(tileSize_));
+    glUniform1f(glGetUniformLocation(program, "cacheSize"),
+                GLfloat(cacheTiles_ * (tileSize_ + 2)));
+    glUniform1i(glGetUniformLocation(program, "maxLevel"), GLint(levels_) - 1);
+    glUniform1iv(glGetUniformLocation(program, "pageOffset"), maxLevels, offsets);
+    glUniform1f(glGetUniformLocation(program, "feedbackBias"), std::log2(float(feedbackScale)));
+}
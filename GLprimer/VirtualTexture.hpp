@@ -0,0 +1,155 @@
+/*
+ * Virtual texturing for TGA images too large to upload in one piece.
+ *
+ * Usage: Call open() with a TGA file. The image is split into square tiles at every mip
+ *        level, and only the tiles that are actually sampled are loaded into a fixed-size
+ *        physical cache texture, least recently used tiles are evicted when it is full.
+ *        An indirection texture maps each virtual tile to its cache slot, or to the
+ *        closest coarser tile that is resident. The coarsest level is always resident.
+ *        Each frame:
+ *        - call beginFeedback(), draw the scene with shaders/fragment_vt_feedback.glsl and
+ *          setUniforms(), then endFeedback() to read back which tiles were sampled,
+ *        - call update() to load the missing tiles,
+ *        - draw the scene with shaders/fragment_vt.glsl and setUniforms().
+ *        request() can be called directly to load tiles without a feedback pass.
+ *        Only OpenGL 3.3 core features are used, so it runs on software implementations.
+ *        stats() reports tile hits and misses, uploads and evictions.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Image.hpp"
+#include "MappedFile.hpp"
+#include "MemoryTracker.hpp"
+
+class VirtualTexture {
+public:
+    struct Stats {
+        size_t hits = 0;       // Sampled tiles that were resident
+        size_t misses = 0;     // Sampled tiles that were not resident
+        size_t uploads = 0;    // Tiles loaded into the cache
+        size_t evictions = 0;  // Resident tiles replaced to make room
+        size_t pending = 0;    // Missing tiles left for the next update()
+        size_t resident = 0;   // Tiles in the cache now
+    };
+
+    /* Constructor: tiles of tileSize texels, a cache of cacheTiles x cacheTiles tiles */
+    explicit VirtualTexture(GLuint tileSize = 128, GLuint cacheTiles = 16);
+
+    /* Destructor */
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    // Open a TGA file, uncompressed files are read in place from a memory mapping
+    bool open(const std::string& filename);
+
+    GLuint width() const;
+    GLuint height() const;
+    GLuint levels() const;
+
+    // Redirect rendering to the feedback buffer, a reduced size copy of the viewport
+    void beginFeedback();
+
+    // Restore the framebuffer and collect the tile requests of the previous feedback pass
+    void endFeedback();
+
+    // Mark a tile as sampled this frame (the feedback pass calls this for every tile it sees)
+    void request(GLuint level, GLuint x, GLuint y);
+
+    // Load up to maxUploads missing tiles, coarsest first, and update the indirection texture
+    void update(size_t maxUploads = 16);
+
+    // Bind the cache and indirection textures to two texture units and set the uniforms of
+    // the virtual texturing shaders, the program must be in use
+    void setUniforms(GLuint program, GLuint cacheUnit = 0, GLuint pageUnit = 1) const;
+
+    Stats stats() const;
+    void resetStats();
+
+private:
+    using TileKey = std::uint64_t;
+
+    static TileKey tileKey(GLuint level, GLuint x, GLuint y);
+
+    struct Slot {
+        TileKey key;
+        unsigned long long lastUsed;  // Frame the tile was last sampled
+        bool used;
+    };
+
+    GLuint levelWidth(GLuint level) const;
+    GLuint levelHeight(GLuint level) const;
+    GLuint tilesX(GLuint level) const;
+    GLuint tilesY(GLuint level) const;
+
+    // Copy a w x h texel region of a level into dst as BGRA, clamping at the image edges
+    void readRegion(GLuint level, int x0, int y0, GLuint w, GLuint h, GLubyte* dst);
+
+    // The texels of a tile above level 0, box filtered from the level below and cached
+    const std::vector<GLubyte>& coarseTile(GLuint level, GLuint x, GLuint y);
+
+    // Load a tile with a one texel border into a cache slot
+    void loadTile(TileKey key, size_t slot);
+
+    // Pick a free slot, or the least recently used one not sampled this frame
+    bool findSlot(size_t& slot) const;
+
+    // Point every virtual tile at its cache slot or its closest resident ancestor
+    void updatePageTable();
+
+    GLuint tileSize_;
+    GLuint cacheTiles_;  // Slots per side of the cache texture
+
+    MappedFile file_;  // Uncompressed source image
+    Image decoded_;    // RLE source image, decoded once
+    const GLubyte* pixels_;
+    GLuint bytesPerPixel_;
+    GLuint width_;
+    GLuint height_;
+    GLuint levels_;
+    std::vector<GLuint> pageOffsets_;  // Column of each level in the indirection texture
+
+    GLuint cacheTexture_;  // Physical tiles, with a border for bilinear filtering
+    GLuint pageTexture_;   // Indirection: cache slot x, y, resident level, valid flag
+    std::vector<GLubyte> pageTable_;
+    bool pageTableDirty_;
+
+    std::vector<Slot> slots_;
+    std::unordered_map<TileKey, size_t> resident_;
+    std::unordered_set<TileKey> requested_;  // Tiles sampled this frame
+    std::unordered_set<TileKey> missing_;    // Sampled tiles waiting to be loaded
+    unsigned long long frame_;
+
+    // Decoded coarse tiles, most recently used first
+    std::list<std::pair<TileKey, std::vector<GLubyte>>> coarseTiles_;
+    std::unordered_map<TileKey, decltype(coarseTiles_)::iterator> coarseIndex_;
+
+    // Feedback pass, rendered at 1/feedbackScale of the viewport and read back a frame later
+    GLuint feedbackFBO_;
+    GLuint feedbackColor_;
+    GLuint feedbackDepth_;
+    GLuint feedbackPBO_[2];
+    GLsizei feedbackWidth_;
+    GLsizei feedbackHeight_;
+    GLsizei feedbackSizes_[2];  // Pixel count stored in each PBO
+    int feedbackIndex_;
+    GLint viewport_[4];  // Saved by beginFeedback()
+
+    Stats stats_;
+
+    // Counted by the MemoryTracker
+    MemoryTracker::Allocation decodedMemory_;
+    MemoryTracker::Allocation textureMemory_;
+    MemoryTracker::Allocation feedbackMemory_;
+};
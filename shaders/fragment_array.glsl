@@ -0,0 +1,56 @@
+#version 330 core
+
+in vec2 st;             // Interpolated texture coords, sent from vertex shader
+in vec3 interpolatedNormal;
+out vec4 finalcolor;
+
+uniform sampler2DArray tex;  // Packed textures, see TexturePacker
+uniform float layer;         // Array layer of the texture for this object
+uniform vec4 uvRect;         // Region of the texture in its layer: offset st, scale st
+uniform float maxLod;        // Highest mip level of the region, lower for atlas entries
+uniform mat4 T;
+
+void main() {
+	// Wrap the texture coordinates within the region, like GL_REPEAT would. The mip level
+	// comes from the derivatives of the unwrapped coordinates, which do not jump where
+	// fract() wraps, and is kept at or below maxLod by shortening the derivatives.
+	vec3 stl = vec3(uvRect.xy + fract(st) * uvRect.zw, layer);
+	vec2 dx = dFdx(st) * uvRect.zw;
+	vec2 dy = dFdy(st) * uvRect.zw;
+	vec2 size = vec2(textureSize(tex, 0).xy);
+	float lod = log2(max(length(dx * size), length(dy * size)));
+	if (lod > maxLod) {
+		float scale = exp2(maxLod - lod);
+		dx *= scale;
+		dy *= scale;
+	}
+	vec4 texcolor = textureGrad(tex, stl, dx, dy);
+
+	vec3 L = normalize(mat3(T) * vec3(0.0f, 0.1f, 1.0f));
+	vec3 V = normalize(vec3(-0.4f,-0.4f,-1.0f));
+	vec3 N = interpolatedNormal;
+
+	vec3 colorRGB = vec3(texcolor);
+	vec3 colorGreyscale = vec3(1.0f, 1.0f, 1.0f);
+
+	vec3 ka = 0.9f * colorRGB;
+	vec3 Ia = 0.5f * colorGreyscale;
+
+	vec3 ks = 0.1f * colorGreyscale;
+	vec3 Is = 0.9f * colorGreyscale;
+
+	vec3 kd = 1.0f * colorRGB;
+	vec3 Id = 0.8f * colorGreyscale;
+
+	float n = 100.0f;
+
+	vec3 R = 2.0 * dot(N, L) * N - L;   // Could also have used the function reflect()
+	float dotNL = max(dot(N, L), 0.0);  // If negative, set to zero
+	float dotRV = max(dot(R, V), 0.0);
+	if (dotNL == 0.0) {
+		dotRV = 0.0;  // Do not show highlight on the dark side
+	}
+	vec3 shadedcolor = Ia * ka + Id * kd * dotNL + Is * ks * pow(dotRV, n);
+
+	finalcolor = vec4(shadedcolor, 1.0)*texcolor;  // Use the texture to set the surface color
+}
@@ -0,0 +1,67 @@
+#version 330 core
+
+in vec2 st;             // Interpolated texture coords, sent from vertex shader
+in vec3 interpolatedNormal;
+out vec4 finalcolor;
+
+uniform sampler2D cacheTex;    // Resident tiles, see VirtualTexture
+uniform usampler2D pageTable;  // Cache slot x, y and resident level of each virtual tile
+uniform vec2 vtSize;           // Size of the virtual texture in texels
+uniform float tileSize;        // Size of a tile in texels, without its border
+uniform float cacheSize;       // Size of the cache texture in texels
+uniform int maxLevel;
+uniform int pageOffset[16];    // Column of each level in the page table
+uniform mat4 T;
+
+// Sample the virtual texture, falling back to a coarser level where a tile is not resident
+vec4 virtualTexture(vec2 uv) {
+	// Pick the level like GL would, the feedback shader makes the same choice
+	vec2 dx = dFdx(uv * vtSize);
+	vec2 dy = dFdy(uv * vtSize);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+	int level = clamp(int(floor(lod)), 0, maxLevel);
+
+	vec2 p = fract(uv);  // Wrap like GL_REPEAT
+	vec2 levelSize = max(floor(vtSize / exp2(float(level))), vec2(1.0));
+	ivec2 tile = ivec2(p * levelSize / tileSize);
+	uvec4 entry = texelFetch(pageTable, ivec2(pageOffset[level] + tile.x, tile.y), 0);
+
+	// Position within the resident tile, which may be an ancestor of the wanted one
+	int resident = int(entry.z);
+	levelSize = max(floor(vtSize / exp2(float(resident))), vec2(1.0));
+	vec2 inTile = clamp(p * levelSize / tileSize - vec2(tile >> (resident - level)), 0.0, 1.0);
+	vec2 texel = vec2(entry.xy) * (tileSize + 2.0) + 1.0 + inTile * tileSize;
+	return textureLod(cacheTex, texel / cacheSize, 0.0);
+}
+
+void main() {
+	vec4 texcolor = virtualTexture(st);
+
+	vec3 L = normalize(mat3(T) * vec3(0.0f, 0.1f, 1.0f));
+	vec3 V = normalize(vec3(-0.4f,-0.4f,-1.0f));
+	vec3 N = interpolatedNormal;
+
+	vec3 colorRGB = vec3(texcolor);
+	vec3 colorGreyscale = vec3(1.0f, 1.0f, 1.0f);
+
+	vec3 ka = 0.9f * colorRGB;
+	vec3 Ia = 0.5f * colorGreyscale;
+
+	vec3 ks = 0.1f * colorGreyscale;
+	vec3 Is = 0.9f * colorGreyscale;
+
+	vec3 kd = 1.0f * colorRGB;
+	vec3 Id = 0.8f * colorGreyscale;
+
+	float n = 100.0f;
+
+	vec3 R = 2.0 * dot(N, L) * N - L;   // Could also have used the function reflect()
+	float dotNL = max(dot(N, L), 0.0);  // If negative, set to zero
+	float dotRV = max(dot(R, V), 0.0);
+	if (dotNL == 0.0) {
+		dotRV = 0.0;  // Do not show highlight on the dark side
+	}
+	vec3 shadedcolor = Ia * ka + Id * kd * dotNL + Is * ks * pow(dotRV, n);
+
+	finalcolor = vec4(shadedcolor, 1.0)*texcolor;  // Use the texture to set the surface color
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+in vec2 st;  // Interpolated texture coords, sent from vertex shader
+out uvec4 feedback;
+
+uniform vec2 vtSize;         // Size of the virtual texture in texels
+uniform float tileSize;      // Size of a tile in texels
+uniform int maxLevel;
+uniform float feedbackBias;  // log2 of how much smaller the feedback buffer is than the screen
+
+// Write the tile and level that fragment_vt.glsl will sample here, see VirtualTexture
+void main() {
+	// The buffer is smaller, so the derivatives are larger than in the final pass
+	vec2 dx = dFdx(st * vtSize);
+	vec2 dy = dFdy(st * vtSize);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - feedbackBias;
+	int level = clamp(int(floor(lod)), 0, maxLevel);
+
+	vec2 levelSize = max(floor(vtSize / exp2(float(level))), vec2(1.0));
+	uvec2 tile = uvec2(fract(st) * levelSize / tileSize);
+	feedback = uvec4(tile, uint(level), 1u);
+}
@@ -0,0 +1,166 @@
+/*
+ * blockcompressortest - check the quality of BC1/BC3 compression with PSNR round trips
+ *
+ * Usage: blockcompressortest
+ *
+ * Compresses synthetic RGB and RGBA images with smooth gradients, hard edges and noise to
+ * BC1 and BC3, decompresses them again and compares the result to the original. Fails if
+ * the PSNR of the colors or of the BC3 alpha is below the threshold of the image, if solid
+ * blocks are not reproduced exactly, or if compressing on several threads gives other
+ * blocks than on one. Prints each PSNR, and each failure, and returns 1 if there was any.
+ * Makes no GL calls, no window or GPU is needed.
+ * Build together with GLprimer/BlockCompressor.cpp, MipChain.cpp, MappedFile.cpp,
+ * ThreadPool.cpp and Trace.cpp.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../GLprimer/BlockCompressor.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+struct TestImage {
+    const char* name;
+    GLuint width;
+    GLuint height;
+    GLuint format;               // GL_RGB, GL_BGR or GL_RGBA
+    std::vector<GLubyte> pixels;
+    double minColorPSNR;         // For BC1 and BC3, the colors are encoded the same way
+    double minAlphaPSNR;         // For BC3, RGBA images only
+};
+
+// A smooth color gradient with a soft alpha ramp
+TestImage gradient(GLuint format) {
+    TestImage image = {"gradient", 256, 192, format, {}, 42.0, 48.0};
+    const GLuint bpp = (format == GL_RGBA) ? 4 : 3;
+    for (GLuint y = 0; y < image.height; y++) {
+        for (GLuint x = 0; x < image.width; x++) {
+            image.pixels.push_back(static_cast<GLubyte>(x));
+            image.pixels.push_back(static_cast<GLubyte>(y * 255 / (image.height - 1)));
+            image.pixels.push_back(static_cast<GLubyte>((x + y) / 2));
+            if (bpp == 4) {
+                image.pixels.push_back(static_cast<GLubyte>(255 - (x + 2 * y) / 3));
+            }
+        }
+    }
+    return image;
+}
+
+// Smooth waves with hard edged stripes and a little noise, like a natural texture.
+// The size is not a multiple of 4, to cover partial blocks.
+TestImage pattern(GLuint format) {
+    TestImage image = {"pattern", 203, 157, format, {}, 35.0, 48.0};
+    const GLuint bpp = (format == GL_RGBA) ? 4 : 3;
+    std::mt19937 random(7);
+    std::uniform_int_distribution<int> noise(-6, 6);
+    auto clamp = [](double v) { return static_cast<GLubyte>(std::min(255.0, std::max(0.0, v))); };
+    for (GLuint y = 0; y < image.height; y++) {
+        for (GLuint x = 0; x < image.width; x++) {
+            const double wave = 0.5 + 0.5 * std::sin(x * 0.09) * std::cos(y * 0.07);
+            const bool stripe = ((x / 24 + y / 24) % 2) == 0;
+            image.pixels.push_back(clamp(200.0 * wave + (stripe ? 40 : 0) + noise(random)));
+            image.pixels.push_back(clamp(120.0 + 100.0 * std::sin(y * 0.05) + noise(random)));
+            image.pixels.push_back(clamp(stripe ? 220.0 * wave : 60.0 + noise(random)));
+            if (bpp == 4) {
+                image.pixels.push_back(clamp(stripe ? 255.0 : 255.0 * wave));
+            }
+        }
+    }
+    return image;
+}
+
+const char* formatName(BlockCompressor::Format format) {
+    return (format == BlockCompressor::Format::BC1) ? "BC1" : "BC3";
+}
+
+void roundTrip(const TestImage& image, BlockCompressor::Format blockFormat) {
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    const std::vector<GLubyte> blocks = BlockCompressor::compress(
+        image.pixels.data(), image.width, image.height, image.format, blockFormat);
+    check(blocks.size() == BlockCompressor::compressedSize(image.width, image.height, blockFormat),
+          "the compressed size is wrong");
+    const std::vector<GLubyte> original =
+        BlockCompressor::toRGBA(image.pixels.data(), pixelCount, image.format);
+    const std::vector<GLubyte> decoded =
+        BlockCompressor::decompress(blocks.data(), image.width, image.height, blockFormat);
+
+    const char* layout = (image.format == GL_RGBA) ? "RGBA"
+                         : (image.format == GL_BGR) ? "BGR"
+                                                    : "RGB";
+    const std::string name =
+        std::string(image.name) + " " + layout + " " + formatName(blockFormat);
+    const double colorPSNR = BlockCompressor::psnr(original.data(), decoded.data(), pixelCount,
+                                                   false);
+    std::printf("%-20s color PSNR %6.2f dB (at least %.1f)", name.c_str(), colorPSNR,
+                image.minColorPSNR);
+    check(colorPSNR >= image.minColorPSNR, name + " color PSNR is too low");
+
+    if (blockFormat == BlockCompressor::Format::BC3 && image.format == GL_RGBA) {
+        // The PSNR over RGBA mixes in the alpha error, so compare alpha on its own
+        std::vector<GLubyte> alphaA(pixelCount * 4, 0);
+        std::vector<GLubyte> alphaB(pixelCount * 4, 0);
+        for (size_t i = 0; i < pixelCount; i++) {
+            alphaA[4 * i] = original[4 * i + 3];
+            alphaB[4 * i] = decoded[4 * i + 3];
+        }
+        // Only the first channel differs, so the PSNR over RGB is 10 log10(3) dB too high
+        const double alphaPSNR =
+            BlockCompressor::psnr(alphaA.data(), alphaB.data(), pixelCount, false) -
+            10.0 * std::log10(3.0);
+        std::printf(", alpha PSNR %6.2f dB (at least %.1f)", alphaPSNR, image.minAlphaPSNR);
+        check(alphaPSNR >= image.minAlphaPSNR, name + " alpha PSNR is too low");
+    }
+    std::printf("\n");
+
+    const std::vector<GLubyte> serial = BlockCompressor::compress(
+        image.pixels.data(), image.width, image.height, image.format, blockFormat, 1);
+    check(serial == blocks, name + " differs between one and several threads");
+}
+
+}  // namespace
+
+int main() {
+    for (GLuint format : {GL_RGB, GL_BGR, GL_RGBA}) {
+        for (const TestImage& image : {gradient(format), pattern(format)}) {
+            roundTrip(image, BlockCompressor::Format::BC1);
+            roundTrip(image, BlockCompressor::Format::BC3);
+        }
+    }
+
+    // Solid colors are exact when they are representable in 5:6:5 bits
+    const GLubyte solid[4] = {255, 0, 132, 200};  // 132 = 33 << 2 | 33 >> 4
+    std::vector<GLubyte> flat;
+    for (int i = 0; i < 16 * 16; i++) {
+        flat.insert(flat.end(), solid, solid + 4);
+    }
+    for (BlockCompressor::Format format :
+         {BlockCompressor::Format::BC1, BlockCompressor::Format::BC3}) {
+        const std::vector<GLubyte> blocks =
+            BlockCompressor::compress(flat.data(), 16, 16, GL_RGBA, format);
+        const std::vector<GLubyte> decoded = BlockCompressor::decompress(blocks.data(), 16, 16,
+                                                                         format);
+        const bool alpha = (format == BlockCompressor::Format::BC3);
+        check(std::isinf(BlockCompressor::psnr(flat.data(), decoded.data(), 16 * 16, alpha)),
+              std::string("a solid ") + formatName(format) + " image is not exact");
+    }
+
+    std::printf("blockcompressortest: %s\n", failures ? "FAILED" : "passed");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
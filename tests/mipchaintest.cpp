@@ -0,0 +1,204 @@
+/*
+ * mipchaintest - check the CPU mipmap filters and the mipmap cache of MipChain
+ *
+ * Usage: mipchaintest [scratch directory]
+ *
+ * Resamples rows with known results through the Kaiser filter, on the SSE2 path (RGBA) and
+ * the scalar path (RGB), checks the 2x2 box filter, and that chains generated by several
+ * threads at once match one generated on a single thread. Then writes a source file and
+ * the cache of its chain to the scratch directory (default: the system temporary
+ * directory), and checks that the cache is read back unchanged, and rejected once the
+ * source changes size or time stamp, for another filter, and when it is truncated. Prints
+ * each failure and returns 1 if there was any. Makes no GL calls, no window or GPU is
+ * needed.
+ * Build together with GLprimer/MipChain.cpp, MappedFile.cpp, ThreadPool.cpp and Trace.cpp.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../GLprimer/MipChain.hpp"
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+// Downsample a 16 pixel row with every channel set to the given values to 8 pixels, and
+// compare every channel with the expected values
+void checkKaiserRow(const char* name, const std::vector<GLubyte>& row,
+                    const std::vector<GLubyte>& expected) {
+    for (GLuint bpp : {4u, 3u}) {
+        std::vector<GLubyte> src;
+        for (GLubyte value : row) {
+            src.insert(src.end(), bpp, value);
+        }
+        std::vector<GLubyte> dst(expected.size() * bpp);
+        MipChain::resample(src.data(), static_cast<GLuint>(row.size()), 1, dst.data(),
+                           static_cast<GLuint>(expected.size()), 1, bpp,
+                           MipChain::Filter::Kaiser, 1);
+        for (size_t i = 0; i < dst.size(); i++) {
+            if (dst[i] != expected[i / bpp]) {
+                check(false, std::string("Kaiser ") + name + " with " + std::to_string(bpp) +
+                                 " bytes per pixel, pixel " + std::to_string(i / bpp) + " is " +
+                                 std::to_string(dst[i]) + ", expected " +
+                                 std::to_string(expected[i / bpp]));
+                break;
+            }
+        }
+    }
+}
+
+void writeFile(const std::string& filename, size_t size) {
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    out << std::string(size, 'x');
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    // Expected values from the filter definition in double precision: a Kaiser windowed sinc
+    // of radius 3 and alpha 4, stretched by the scale factor of 2, with normalized weights,
+    // clamped to the edge, then rounded and clamped to 0..255
+    checkKaiserRow("step",
+                   {0, 0, 0, 0, 0, 0, 0, 0, 255, 255, 255, 255, 255, 255, 255, 255},
+                   {0, 2, 0, 15, 240, 255, 253, 255});
+    checkKaiserRow("ramp",
+                   {0, 16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240},
+                   {8, 40, 72, 104, 136, 168, 200, 232});
+    checkKaiserRow("impulse", {0, 0, 0, 0, 0, 0, 0, 255, 0, 0, 0, 0, 0, 0, 0, 0},
+                   {0, 4, 0, 113, 34, 0, 2, 0});
+
+    // A constant image stays constant down to 1x1, with both filters
+    for (MipChain::Filter filter : {MipChain::Filter::Kaiser, MipChain::Filter::Box}) {
+        const std::vector<GLubyte> flat(37 * 23 * 4, 77);
+        MipChain chain;
+        chain.generate(flat.data(), 37, 23, GL_RGBA, GL_RGBA, filter, 1);
+        check(chain.levelCount() == 6, "a 37x23 chain should have 6 levels");
+        for (size_t i = 0; i < chain.levelCount(); i++) {
+            const MipChain::Level& level = chain.level(i);
+            bool same = true;
+            for (size_t j = 0; j < level.size; j++) {
+                same = same && level.data[j] == 77;
+            }
+            check(same, "level " + std::to_string(i) + " of a constant image is not constant");
+        }
+    }
+
+    // The box filter averages 2x2 blocks
+    const GLubyte quad[] = {10, 20, 30, 40, 50, 60};  // 2x1 RGB, then 1x1
+    MipChain box;
+    box.generate(quad, 2, 1, GL_RGB, GL_RGB, MipChain::Filter::Box, 1);
+    check(box.levelCount() == 2 && box.level(1).data[0] == 25 && box.level(1).data[1] == 35 &&
+              box.level(1).data[2] == 45,
+          "the box filter should average (10, 20, 30) and (40, 50, 60) to (25, 35, 45)");
+
+    // Chains generated at the same time, like those of the streamer workers, share the filter
+    // threads and come out the same as on one thread
+    std::vector<GLubyte> large(1024 * 512 * 4);
+    for (size_t i = 0; i < large.size(); i++) {
+        large[i] = static_cast<GLubyte>(i * 13 + i / 4096);
+    }
+    MipChain serial;
+    serial.generate(large.data(), 1024, 512, GL_RGBA, GL_RGBA, MipChain::Filter::Kaiser, 1);
+    std::vector<MipChain> shared(4);
+    std::vector<std::thread> threads;
+    for (MipChain& parallel : shared) {
+        threads.emplace_back([&large, &parallel] {
+            parallel.generate(large.data(), 1024, 512, GL_RGBA, GL_RGBA,
+                              MipChain::Filter::Kaiser, 4);
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const MipChain& parallel : shared) {
+        bool same = parallel.levelCount() == serial.levelCount();
+        for (size_t i = 0; same && i < serial.levelCount(); i++) {
+            same = parallel.level(i).size == serial.level(i).size &&
+                   std::equal(serial.level(i).data, serial.level(i).data + serial.level(i).size,
+                              parallel.level(i).data);
+        }
+        check(same, "a chain generated on the shared threads differs from one thread");
+    }
+
+    // The cache holds the chain of one version of the source file with one filter
+    const std::filesystem::path dir =
+        (argc > 1) ? std::filesystem::path(argv[1]) : std::filesystem::temp_directory_path();
+    const std::string source = (dir / "mipchaintest.src").string();
+    const std::string cacheFile = MipChain::cacheFilename(source);
+    writeFile(source, 100);
+
+    std::vector<GLubyte> pixels(64 * 32 * 4);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = static_cast<GLubyte>(i * 7);
+    }
+    MipChain chain;
+    chain.generate(pixels.data(), 64, 32, GL_RGBA, GL_BGRA, MipChain::Filter::Kaiser, 1);
+    const std::uint64_t stamp = MipChain::sourceStamp(source);
+    check(stamp != 0, "the stamp of an existing file should not be 0");
+    check(MipChain::sourceStamp(source + ".missing") == 0, "the stamp of a missing file is 0");
+    check(chain.writeCache(cacheFile, stamp), "writing the cache failed");
+
+    MipChain cached;
+    const bool read = cached.readCache(cacheFile, stamp, MipChain::Filter::Kaiser);
+    check(read, "reading the cache of an unchanged source failed");
+    if (read) {
+        check(cached.isMapped() && !chain.isMapped(), "only the cached chain should be mapped");
+        check(cached.levelCount() == chain.levelCount() && cached.type() == GL_RGBA &&
+                  cached.format() == GL_BGRA,
+              "the cached chain has another layout");
+        for (size_t i = 0; i < std::min(cached.levelCount(), chain.levelCount()); i++) {
+            check(cached.level(i).size == chain.level(i).size &&
+                      std::equal(chain.level(i).data, chain.level(i).data + chain.level(i).size,
+                                 cached.level(i).data),
+                  "cached level " + std::to_string(i) + " differs");
+        }
+    }
+
+    MipChain rejected;
+    check(!rejected.readCache(cacheFile, stamp, MipChain::Filter::Box),
+          "the cache of another filter should be rejected");
+
+    // A new time stamp at the same size invalidates the cache
+    const auto time = std::filesystem::last_write_time(source);
+    std::filesystem::last_write_time(source, time + std::chrono::seconds(2));
+    const std::uint64_t touched = MipChain::sourceStamp(source);
+    check(touched != stamp, "the stamp should change with the modification time");
+    check(!rejected.readCache(cacheFile, touched, MipChain::Filter::Kaiser),
+          "the cache should be rejected after the source was touched");
+
+    // So does a new size
+    writeFile(source, 101);
+    const std::uint64_t resized = MipChain::sourceStamp(source);
+    check(resized != stamp && resized != touched, "the stamp should change with the size");
+    check(!rejected.readCache(cacheFile, resized, MipChain::Filter::Kaiser),
+          "the cache should be rejected after the source changed size");
+
+    // A truncated cache file is rejected, even with the right stamp
+    cached = MipChain();
+    std::filesystem::resize_file(cacheFile, std::filesystem::file_size(cacheFile) - 1);
+    check(!rejected.readCache(cacheFile, stamp, MipChain::Filter::Kaiser),
+          "a truncated cache should be rejected");
+
+    std::filesystem::remove(source);
+    std::filesystem::remove(cacheFile);
+    std::printf("mipchaintest: %s\n", failures ? "FAILED" : "passed");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
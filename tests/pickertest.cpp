@@ -0,0 +1,225 @@
+/*
+ * pickertest - check the Picker against brute-force ray-triangle intersection
+ *
+ * Usage: pickertest
+ *
+ * Places two spheres, one of them drawn twice so that two objects share its BVH, and a
+ * third sphere that is hidden, in front of the camera of GLprimer. Picks through a grid of
+ * pixels covering the window and tests every triangle of every visible object against the
+ * same ray, in eye coordinates and double precision. Fails if the picker finds another
+ * object, a hit that is not the closest one, a hit where there is none or no hit where
+ * there is one, or if its hit point does not lie on the triangle it names. Hits on an edge
+ * shared by two triangles may name either one. Also checks that a BVH is not built over a
+ * mesh without vertex and index arrays. Prints each failure and returns 1 if there was
+ * any. Makes no GL calls, no window or GPU is needed.
+ * Build together with GLprimer/Picker.cpp, BVH.cpp, Mesh.cpp, ThreadPool.cpp,
+ * MemoryTracker.cpp and Trace.cpp.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../GLprimer/Mesh.hpp"
+#include "../GLprimer/Picker.hpp"
+
+namespace {
+
+using Matrix = std::array<GLfloat, 16>;
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+// Nearest rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+}
+
+Matrix multiply(const Matrix& a, const Matrix& b) {
+    Matrix result{};
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            for (int k = 0; k < 4; k++) {
+                result[4 * col + row] += a[4 * k + row] * b[4 * col + k];
+            }
+        }
+    }
+    return result;
+}
+
+Matrix translate(float x, float y, float z) {
+    return {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, y, z, 1};
+}
+
+Matrix rotateY(float angle) {
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    return {c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1};
+}
+
+// The same projection as mat4perspective() in GLprimer.cpp
+Matrix perspective(float vfov, float aspect, float znear, float zfar) {
+    const float f = 1.0f / std::tan(vfov / 2.0f);
+    return {f / aspect, 0, 0, 0, 0, f, 0, 0, 0, 0, -(zfar + znear) / (zfar - znear), -1,
+            0, 0, -(2.0f * znear * zfar) / (zfar - znear), 0};
+}
+
+// The triangles of a mesh in eye coordinates, 9 values per triangle
+std::vector<double> eyeTriangles(const Mesh& mesh, const Matrix& MV) {
+    std::vector<double> triangles;
+    const std::vector<GLfloat>& vertices = mesh.vertices();
+    for (GLuint index : mesh.indices()) {
+        const GLfloat* p = &vertices[8 * index];
+        for (int i = 0; i < 3; i++) {
+            triangles.push_back(static_cast<double>(MV[i]) * p[0] + MV[4 + i] * p[1] +
+                                MV[8 + i] * p[2] + MV[12 + i]);
+        }
+    }
+    return triangles;
+}
+
+// Moller-Trumbore intersection of a ray from the eye with a triangle, returns the distance
+// along the direction or a negative value if the ray misses it
+double intersect(const double* v, const double* direction) {
+    double e1[3], e2[3];
+    for (int i = 0; i < 3; i++) {
+        e1[i] = v[3 + i] - v[i];
+        e2[i] = v[6 + i] - v[i];
+    }
+    const double p[3] = {direction[1] * e2[2] - direction[2] * e2[1],
+                         direction[2] * e2[0] - direction[0] * e2[2],
+                         direction[0] * e2[1] - direction[1] * e2[0]};
+    const double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (std::fabs(det) < 1e-14) {
+        return -1.0;
+    }
+    const double s[3] = {-v[0], -v[1], -v[2]};  // The ray starts at the eye
+    const double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+    if (u < 0.0 || u > 1.0) {
+        return -1.0;
+    }
+    const double q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2],
+                         s[0] * e1[1] - s[1] * e1[0]};
+    const double w = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) / det;
+    if (w < 0.0 || u + w > 1.0) {
+        return -1.0;
+    }
+    return (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+}
+
+}  // namespace
+
+int main() {
+    const int width = 640;
+    const int height = 480;
+    const float znear = 0.1f;
+    const float vfov = static_cast<float>(M_PI / 3.0);
+    const Matrix P = perspective(vfov, static_cast<float>(width) / height, znear, 100.0f);
+
+    Mesh big;
+    big.createSphere(1.0f, 64);
+    Mesh small;
+    small.createSphere(0.5f, 16);
+    const std::vector<const Mesh*> meshes = {&big, &big, &small, &small};
+    const std::vector<Matrix> MV = {multiply(translate(-0.8f, 0.0f, -4.0f), rotateY(0.3f)),
+                                    multiply(translate(0.9f, 0.2f, -6.0f), rotateY(1.0f)),
+                                    translate(0.1f, -0.1f, -2.5f),
+                                    translate(-0.3f, 0.4f, -1.5f)};
+    const std::vector<bool> visible = {true, true, true, false};
+
+    // A mesh whose arrays were freed, like the copy a TriangleSoup drops after upload
+    Mesh cleared;
+    cleared.createSphere(1.0f, 8);
+    cleared.clear();
+    BVH unbuilt;
+    check(!unbuilt.build(cleared) && unbuilt.empty(),
+          "building a BVH over a cleared mesh should fail");
+
+    Picker picker(1);
+    std::vector<std::vector<double>> triangles;
+    for (size_t object = 0; object < meshes.size(); object++) {
+        check(picker.add(*meshes[object]) == object, "objects should be numbered in order");
+        picker.update(object, MV[object], visible[object]);
+        triangles.push_back(eyeTriangles(*meshes[object], MV[object]));
+    }
+
+    const double f = 1.0 / std::tan(vfov / 2.0);
+    const double aspect = static_cast<double>(width) / height;
+    int picks = 0;
+    int hits = 0;
+    std::vector<double> pickMs;
+    for (int y = 4; y < height; y += 8) {
+        for (int x = 4; x < width; x += 8) {
+            const double cursorX = x + 0.5;
+            const double cursorY = y + 0.5;
+            const Picker::Result result = picker.pick(cursorX, cursorY, width, height, P);
+            pickMs.push_back(picker.stats().ms);
+            picks++;
+
+            // The closest hit beyond the near plane, the direction is scaled to z = -1 so
+            // that the distance along it is the depth
+            const double direction[3] = {(2.0 * cursorX / width - 1.0) * aspect / f,
+                                         (1.0 - 2.0 * cursorY / height) / f, -1.0};
+            double closest = INFINITY;
+            size_t object = Picker::noObject;
+            for (size_t o = 0; o < triangles.size(); o++) {
+                for (size_t t = 0; visible[o] && t < triangles[o].size() / 9; t++) {
+                    const double depth = intersect(&triangles[o][9 * t], direction);
+                    if (depth > znear && depth < closest) {
+                        closest = depth;
+                        object = o;
+                    }
+                }
+            }
+
+            const std::string where = "at " + std::to_string(x) + ", " + std::to_string(y);
+            if (object == Picker::noObject) {
+                check(!result.hit(), "the picker should find nothing " + where);
+                continue;
+            }
+            hits++;
+            if (!result.hit() || result.object != object) {
+                check(false, "the picker should find object " + std::to_string(object) + " " +
+                                 where);
+                continue;
+            }
+            check(std::fabs(-result.position[2] - closest) < 1e-4 * closest,
+                  "the picked depth " + std::to_string(-result.position[2]) + " should be " +
+                      std::to_string(closest) + " " + where);
+
+            // The hit point is where the barycentric coordinates put it on the triangle
+            const double* v = &triangles[object][9 * result.triangle];
+            for (int i = 0; i < 3; i++) {
+                const double expected =
+                    v[i] + result.u * (v[3 + i] - v[i]) + result.v * (v[6 + i] - v[i]);
+                check(std::fabs(result.position[i] - expected) < 1e-4,
+                      "the hit point should lie on triangle " +
+                          std::to_string(result.triangle) + " " + where);
+            }
+        }
+    }
+    check(hits > picks / 10 && hits < picks, "the grid should both hit and miss the spheres");
+
+    std::sort(pickMs.begin(), pickMs.end());
+    std::printf("%d picks, %d hits, pick time median %.4f ms, p99 %.4f ms\n", picks, hits,
+                percentile(pickMs, 50.0), percentile(pickMs, 99.0));
+    std::printf("pickertest: %s\n", failures ? "FAILED" : "passed");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*
+ * bvhbench - build a BVH over a mesh and measure its ray queries
+ *
+ * Usage: bvhbench mesh.obj [rays]
+ *
+ * The mesh is loaded with Mesh::readOBJ(), or made with createSphere() with about
+ * four million triangles when the mesh name is "sphere", without a GL context. The BVH is
+ * built on one thread and on all hardware threads, and the build times and the tree stats
+ * are printed. Then rays (default 1048576) are traced in four ways, on one thread and on all
+ * hardware threads: camera rays through a square grid of pixels looking at the mesh, as single
+ * rays and as 2 x 2 packets, with closest-hit and any-hit queries, and rays between random
+ * points in the bounds of the mesh. The packet results are checked against the single rays.
+ * Build together with GLprimer/BVH.cpp, Mesh.cpp, ThreadPool.cpp, MemoryTracker.cpp and
+ * Trace.cpp. No GL library is needed.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../GLprimer/BVH.hpp"
+#include "../GLprimer/Mesh.hpp"
+#include "../GLprimer/ThreadPool.hpp"
+
+namespace {
+
+// Run func(first, last) over rows 0 to rows - 1, split in jobs over the pool or on this
+// thread, and return the time in seconds
+double timeRows(ThreadPool* pool, int rows, const std::function<void(int, int)>& func) {
+    const auto start = std::chrono::steady_clock::now();
+    if (pool) {
+        const int rowsPerJob = 8;  // Even, so the packets of two rows stay in one job
+        for (int first = 0; first < rows; first += rowsPerJob) {
+            const int last = std::min(first + rowsPerJob, rows);
+            pool->enqueue([&func, first, last]() { func(first, last); });
+        }
+        pool->wait();
+    } else {
+        func(0, rows);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: bvhbench mesh.obj [rays]\n";
+        return 1;
+    }
+    const std::string meshFile = argv[1];
+    const long rayCount = std::max(4L, (argc > 2) ? std::stol(argv[2]) : 1048576L);
+    const int side = static_cast<int>(std::sqrt(static_cast<double>(rayCount))) & ~1;
+
+    Mesh mesh;
+    if (meshFile == "sphere") {
+        mesh.createSphere(1.0f, 1024);
+    } else if (!mesh.readOBJ(meshFile)) {
+        return 1;
+    }
+
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    BVH bvh;
+    for (unsigned threads : {1u, hardwareThreads}) {
+        if (!bvh.build(mesh, threads)) {
+            return 1;
+        }
+        const BVH::Stats stats = bvh.stats();
+        std::printf("build on %u threads: %zu triangles, %zu leaves, %.2f Mtris/s, %s\n",
+                    threads, stats.triangles, stats.leaves,
+                    stats.triangles / stats.buildMs / 1000.0, bvh.summary().c_str());
+        if (hardwareThreads == 1) {
+            break;
+        }
+    }
+    // A camera on the +z side of the mesh, seeing all of it with a 60 degree field of view
+    const Mesh::Bounds bounds = mesh.bounds();
+    float center[3];
+    float radius = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        center[axis] = (bounds.min[axis] + bounds.max[axis]) / 2.0f;
+        radius = std::max(radius, (bounds.max[axis] - bounds.min[axis]) / 2.0f);
+    }
+    const float distance = 2.5f * radius;
+    const float halfWidth = std::tan(static_cast<float>(M_PI / 6.0));
+    const auto cameraRay = [&](int x, int y) {
+        BVH::Ray ray;
+        ray.origin = {{center[0], center[1], center[2] + distance}};
+        ray.direction = {{((x + 0.5f) / side * 2.0f - 1.0f) * halfWidth,
+                          (1.0f - (y + 0.5f) / side * 2.0f) * halfWidth, -1.0f}};
+        return ray;
+    };
+
+    // Segments between random points in the bounds
+    std::vector<BVH::Ray> randomRays(static_cast<size_t>(side) * side);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (BVH::Ray& ray : randomRays) {
+        float from[3], to[3];
+        for (int axis = 0; axis < 3; axis++) {
+            const float extent = bounds.max[axis] - bounds.min[axis];
+            from[axis] = bounds.min[axis] + uniform(random) * extent;
+            to[axis] = bounds.min[axis] + uniform(random) * extent;
+        }
+        ray.origin = {{from[0], from[1], from[2]}};
+        ray.direction = {{to[0] - from[0], to[1] - from[1], to[2] - from[2]}};
+        ray.tMax = 1.0f;
+    }
+
+    std::vector<uint32_t> single(randomRays.size());
+    std::vector<uint32_t> packet(randomRays.size());
+    std::vector<unsigned char> blocked(randomRays.size());
+    std::vector<unsigned char> blocked4(randomRays.size());
+    const std::vector<std::pair<const char*, std::function<void(int, int)>>> queries = {
+        {"camera closest hit",
+         [&](int first, int last) {
+             for (int y = first; y < last; y++) {
+                 for (int x = 0; x < side; x++) {
+                     BVH::Hit hit;
+                     bvh.intersect(cameraRay(x, y), hit);
+                     single[static_cast<size_t>(y) * side + x] = hit.triangle;
+                 }
+             }
+         }},
+        {"camera closest hit 2x2",
+         [&](int first, int last) {
+             for (int y = first & ~1; y < last; y += 2) {
+                 for (int x = 0; x < side; x += 2) {
+                     const BVH::Ray rays[4] = {cameraRay(x, y), cameraRay(x + 1, y),
+                                               cameraRay(x, y + 1), cameraRay(x + 1, y + 1)};
+                     BVH::Hit hits[4];
+                     bvh.intersect4(rays, hits);
+                     for (int i = 0; i < 4; i++) {
+                         packet[static_cast<size_t>(y + i / 2) * side + x + i % 2] =
+                             hits[i].triangle;
+                     }
+                 }
+             }
+         }},
+        {"camera any hit",
+         [&](int first, int last) {
+             for (int y = first; y < last; y++) {
+                 for (int x = 0; x < side; x++) {
+                     blocked[static_cast<size_t>(y) * side + x] = bvh.occluded(cameraRay(x, y));
+                 }
+             }
+         }},
+        {"camera any hit 2x2",
+         [&](int first, int last) {
+             for (int y = first & ~1; y < last; y += 2) {
+                 for (int x = 0; x < side; x += 2) {
+                     const BVH::Ray rays[4] = {cameraRay(x, y), cameraRay(x + 1, y),
+                                               cameraRay(x, y + 1), cameraRay(x + 1, y + 1)};
+                     const unsigned mask = bvh.occluded4(rays);
+                     for (int i = 0; i < 4; i++) {
+                         blocked4[static_cast<size_t>(y + i / 2) * side + x + i % 2] =
+                             (mask >> i) & 1;
+                     }
+                 }
+             }
+         }},
+        {"random closest hit",
+         [&](int first, int last) {
+             for (size_t i = static_cast<size_t>(first) * side;
+                  i < static_cast<size_t>(last) * side; i++) {
+                 BVH::Hit hit;
+                 bvh.intersect(randomRays[i], hit);
+             }
+         }},
+        {"random any hit",
+         [&](int first, int last) {
+             for (size_t i = static_cast<size_t>(first) * side;
+                  i < static_cast<size_t>(last) * side; i++) {
+                 bvh.occluded(randomRays[i]);
+             }
+         }},
+    };
+
+    ThreadPool pool(hardwareThreads);
+    const double rays = static_cast<double>(side) * side;
+    std::printf("%d x %d rays\n%-24s %14s %14s\n", side, side, "Mrays/s", "1 thread",
+                (std::to_string(hardwareThreads) + " threads").c_str());
+    for (const auto& query : queries) {
+        const double serial = timeRows(nullptr, side, query.second);
+        const double parallel = timeRows(&pool, side, query.second);
+        std::printf("%-24s %14.2f %14.2f\n", query.first, rays / serial / 1e6,
+                    rays / parallel / 1e6);
+    }
+
+    const size_t hits = static_cast<size_t>(
+        std::count_if(single.begin(), single.end(), [](uint32_t id) { return id != BVH::noHit; }));
+    const size_t packetDiffs = static_cast<size_t>(
+        std::inner_product(single.begin(), single.end(), packet.begin(), size_t(0),
+                           std::plus<size_t>(), std::not_equal_to<uint32_t>()));
+    const size_t anyDiffs = static_cast<size_t>(
+        std::inner_product(blocked.begin(), blocked.end(), blocked4.begin(), size_t(0),
+                           std::plus<size_t>(), std::not_equal_to<unsigned char>()));
+    std::printf("%zu camera rays hit, %zu packet closest hits and %zu packet any hits differ\n",
+                hits, packetDiffs, anyDiffs);
+    return (packetDiffs == 0 && anyDiffs == 0) ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/*
+ * qoibench - compare loading textures from TGA and QOI files
+ *
+ * Usage: qoibench image.tga image.qoi [runs]
+ *
+ * Make the QOI file with tga2qoi. Both files are loaded runs times (default 10) in two
+ * ways, and the median times are printed together with the bytes read from each file:
+ * - decode: into CPU memory with Image::loadUncompressedTGA() and Image::loadQOI(),
+ * - texture ready: with Texture::createTexture() and glFinish(), with GL generated
+ *   mipmaps so that the CPU mipmap cache does not hide the decoding time.
+ * The files are read through the OS file cache after the first run, so the times show
+ * the decoding and upload cost rather than the disk speed. Runs with a software GL
+ * implementation such as Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1).
+ * Build together with GLprimer/Texture.cpp, Image.cpp, MipChain.cpp, MappedFile.cpp,
+ * ThreadPool.cpp, TextureStreamer.cpp, GLState.cpp, ResidencyManager.cpp, TriangleSoup.cpp,
+ * Mesh.cpp, MemoryTracker.cpp and Trace.cpp.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../GLprimer/Texture.hpp"
+
+namespace {
+
+// Median time of a number of calls in milliseconds, the loader's log lines are silenced
+double medianMs(int runs, const std::function<void()>& func) {
+    std::vector<double> times;
+    std::streambuf* log = std::cout.rdbuf(nullptr);
+    for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        times.push_back(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+    }
+    std::cout.rdbuf(log);
+    std::cout.clear();
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+void printRow(const char* name, size_t bytesRead, size_t imageBytes, double decodeMs,
+              double readyMs) {
+    std::printf("%-4s %12zu %10.1f %11.1f %14.1f\n", name, bytesRead, decodeMs,
+                imageBytes / (1024.0 * 1024.0) / (decodeMs / 1000.0), readyMs);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: qoibench image.tga image.qoi [runs]\n";
+        return 1;
+    }
+    const std::string tgaFile = argv[1];
+    const std::string qoiFile = argv[2];
+    const int runs = std::max(1, (argc > 3) ? std::stoi(argv[3]) : 10);
+
+    const Image tga = Image::loadUncompressedTGA(tgaFile);
+    const Image qoi = Image::loadQOI(qoiFile);
+    if (tga.data.empty() || qoi.data.empty()) {
+        return 1;
+    }
+    if (tga.width != qoi.width || tga.height != qoi.height) {
+        std::cerr << "The images have different sizes\n";
+        return 1;
+    }
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "qoibench", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Unable to open window. Terminating.\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    GLenum err = glewInit();
+    if (GLEW_OK != err) {
+        std::cerr << "Error: " << glewGetErrorString(err) << "\n";
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "GL renderer: " << glGetString(GL_RENDERER) << "\n";
+    Texture::loadOptions().cpuMipmaps = false;
+
+    const auto decode = [&](const std::function<Image()>& load) {
+        return medianMs(runs, [&] { load(); });
+    };
+    const auto ready = [&](const std::string& filename) {
+        return medianMs(runs, [&] {
+            Texture texture(filename);
+            glFinish();
+        });
+    };
+
+    std::cout << tga.width << " x " << tga.height << ", " << tga.data.size() << " bytes of pixels, "
+              << runs << " runs\n";
+    std::printf("%-4s %12s %10s %11s %14s\n", "", "bytes read", "decode ms", "decode MB/s",
+                "texture ms");
+    printRow("TGA", std::filesystem::file_size(tgaFile), tga.data.size(),
+             decode([&] { return Image::loadUncompressedTGA(tgaFile); }), ready(tgaFile));
+    printRow("QOI", std::filesystem::file_size(qoiFile), qoi.data.size(),
+             decode([&] { return Image::loadQOI(qoiFile); }), ready(qoiFile));
+
+    glfwTerminate();
+    return 0;
+}
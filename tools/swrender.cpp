@@ -0,0 +1,142 @@
+/*
+ * swrender - render a textured mesh on the CPU with the SoftwareRasterizer, without a GPU
+ *
+ * Usage: swrender mesh.obj texture.tga output.qoi [width height [runs]]
+ *
+ * The mesh is loaded with Mesh::readOBJ(), or made with createSphere() when the
+ * mesh name is "sphere", without a GL context. The texture can be a TGA or a QOI file. The
+ * mesh is centered in front of the camera with the projection of GLprimer and rendered runs
+ * times (default 10) at width x height (default 800 x 800), first on one thread and then on
+ * all hardware threads. The median frame time and the triangles and shaded pixels per
+ * second are printed, and the last image is written to output.qoi.
+ * Build together with GLprimer/SoftwareRasterizer.cpp, Mesh.cpp, Image.cpp, MappedFile.cpp,
+ * ThreadPool.cpp and Trace.cpp. No GL library is needed.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../GLprimer/Image.hpp"
+#include "../GLprimer/Mesh.hpp"
+#include "../GLprimer/SoftwareRasterizer.hpp"
+
+namespace {
+
+using Matrix = std::array<GLfloat, 16>;
+
+Matrix multiply(const Matrix& a, const Matrix& b) {
+    Matrix result{};
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            for (int k = 0; k < 4; k++) {
+                result[4 * col + row] += a[4 * k + row] * b[4 * col + k];
+            }
+        }
+    }
+    return result;
+}
+
+Matrix identity() { return {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}; }
+
+// The same projection as mat4perspective() in GLprimer.cpp
+Matrix perspective(float vfov, float aspect, float znear, float zfar) {
+    const float f = 1.0f / std::tan(vfov / 2.0f);
+    return {f / aspect, 0, 0, 0, 0, f, 0, 0, 0, 0, -(zfar + znear) / (zfar - znear), -1,
+            0, 0, -(2.0f * znear * zfar) / (zfar - znear), 0};
+}
+
+// Scale and move the mesh to fit in a unit sphere three units in front of the camera
+Matrix placeMesh(const Mesh::Bounds& bounds) {
+    float center[3];
+    float radius = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        center[axis] = (bounds.min[axis] + bounds.max[axis]) / 2.0f;
+        radius = std::max(radius, (bounds.max[axis] - bounds.min[axis]) / 2.0f);
+    }
+    const float scale = (radius > 0.0f) ? 1.0f / radius : 1.0f;
+    Matrix move = identity();
+    move[12] = -center[0];
+    move[13] = -center[1];
+    move[14] = -center[2];
+    Matrix place = identity();
+    place[0] = place[5] = place[10] = scale;
+    place[14] = -3.0f;
+    return multiply(place, move);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: swrender mesh.obj texture.tga output.qoi [width height [runs]]\n";
+        return 1;
+    }
+    const std::string meshFile = argv[1];
+    const std::string textureFile = argv[2];
+    const std::string output = argv[3];
+    const GLuint width = (argc > 5) ? static_cast<GLuint>(std::stoi(argv[4])) : 800;
+    const GLuint height = (argc > 5) ? static_cast<GLuint>(std::stoi(argv[5])) : 800;
+    const int runs = std::max(1, (argc > 6) ? std::stoi(argv[6]) : 10);
+    if (width == 0 || height == 0) {
+        std::cerr << "The image size must be at least 1 x 1\n";
+        return 1;
+    }
+
+    Mesh mesh;
+    if (meshFile == "sphere") {
+        mesh.createSphere(1.0f, 256);
+    } else if (!mesh.readOBJ(meshFile)) {
+        return 1;
+    }
+    const Image image = Image::load(textureFile);
+    if (image.data.empty()) {
+        return 1;
+    }
+    const SoftwareRasterizer::Sampler texture(image);
+
+    const Matrix MV = placeMesh(mesh.bounds());
+    const Matrix P = perspective(static_cast<float>(M_PI / 3.0),
+                                 static_cast<float>(width) / height, 0.1f, 100.0f);
+    const Matrix T = identity();
+
+    const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("%u x %u, %d runs\n", width, height, runs);
+    std::printf("%-8s %10s %10s %10s %12s\n", "threads", "triangles", "pixels", "median ms",
+                "throughput");
+    for (unsigned threads : {1u, hardwareThreads}) {
+        SoftwareRasterizer rasterizer(width, height, threads);
+        std::vector<double> times;
+        for (int i = 0; i < runs; i++) {
+            const auto start = std::chrono::steady_clock::now();
+            rasterizer.clear(0.3f, 0.3f, 0.3f, 0.0f);
+            if (!rasterizer.draw(mesh, MV, P, T, texture)) {
+                return 1;
+            }
+            times.push_back(std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count());
+        }
+        std::sort(times.begin(), times.end());
+        const double medianMs = times[times.size() / 2];
+        const SoftwareRasterizer::Stats stats = rasterizer.stats();
+        std::printf("%-8u %10zu %10zu %10.2f %s\n", threads, stats.triangles, stats.pixels,
+                    medianMs, SoftwareRasterizer::throughput(stats, medianMs / 1000.0).c_str());
+        if (threads == hardwareThreads && !rasterizer.write(output)) {
+            return 1;
+        }
+        if (hardwareThreads == 1) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * tga2dds - offline conversion of TGA textures to BC1/BC3 block compressed DDS files
+ *
+ * Usage: tga2dds input.tga output.dds [bc1|bc3] [box|kaiser]
+ *
+ * The mipmap chain is filtered on the CPU (see MipChain) and every level is compressed
+ * (see BlockCompressor). The default is BC1 for RGB input and BC3 for RGBA input.
+ * The PSNR of the compressed base level is printed to verify the encoding quality.
+ * Build together with GLprimer/Image.cpp, MipChain.cpp, BlockCompressor.cpp,
+ * ThreadPool.cpp, MappedFile.cpp and Trace.cpp. No GL library is needed.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../GLprimer/BlockCompressor.hpp"
+#include "../GLprimer/Image.hpp"
+#include "../GLprimer/MipChain.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: tga2dds input.tga output.dds [bc1|bc3] [box|kaiser]\n";
+        return 1;
+    }
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+
+    const Image image = Image::loadUncompressedTGA(input);
+    if (image.data.empty()) {
+        return 1;
+    }
+
+    BlockCompressor::Format format =
+        (image.type == GL_RGBA) ? BlockCompressor::Format::BC3 : BlockCompressor::Format::BC1;
+    if (argc > 3) {
+        const std::string name = argv[3];
+        if (name == "bc1") {
+            format = BlockCompressor::Format::BC1;
+        } else if (name == "bc3") {
+            format = BlockCompressor::Format::BC3;
+        } else {
+            std::cerr << "Unknown block format '" << name << "'\n";
+            return 1;
+        }
+    }
+    MipChain::Filter filter = MipChain::Filter::Kaiser;
+    if (argc > 4 && std::string(argv[4]) == "box") {
+        filter = MipChain::Filter::Box;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    MipChain chain;
+    chain.generate(image.data.data(), image.width, image.height, image.type, image.format, filter);
+    if (!BlockCompressor::writeDDS(output, chain, format)) {
+        std::cerr << "Could not write '" << output << "'\n";
+        return 1;
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Round trip the base level to report the quality of the encoding
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    const std::vector<GLubyte> original =
+        BlockCompressor::toRGBA(image.data.data(), pixelCount, image.format);
+    const std::vector<GLubyte> blocks = BlockCompressor::compress(
+        image.data.data(), image.width, image.height, image.format, format);
+    const std::vector<GLubyte> decoded =
+        BlockCompressor::decompress(blocks.data(), image.width, image.height, format);
+    const bool alpha = (format == BlockCompressor::Format::BC3) && (image.type == GL_RGBA);
+
+    std::cout << output << ": " << image.width << " x " << image.height << ", "
+              << chain.levelCount() << " levels, "
+              << (format == BlockCompressor::Format::BC1 ? "BC1" : "BC3") << ", "
+              << chain.level(0).size << " -> "
+              << BlockCompressor::compressedSize(image.width, image.height, format)
+              << " bytes at level 0, PSNR " << BlockCompressor::psnr(original.data(),
+                                                                      decoded.data(), pixelCount,
+                                                                      alpha)
+              << " dB, " << seconds << " s\n";
+    return 0;
+}
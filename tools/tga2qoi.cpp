@@ -0,0 +1,67 @@
+/*
+ * tga2qoi - offline conversion of TGA textures to lossless QOI files
+ *
+ * Usage: tga2qoi input.tga output.qoi
+ *
+ * The image is encoded with Image::encodeQOI(), then decoded again and compared with the
+ * original to verify that the conversion is lossless. The file sizes and the encoding and
+ * decoding speeds are printed.
+ * Build together with GLprimer/Image.cpp, BlockCompressor.cpp, MipChain.cpp,
+ * ThreadPool.cpp, MappedFile.cpp and Trace.cpp. No GL library is needed.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "../GLprimer/BlockCompressor.hpp"
+#include "../GLprimer/Image.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: tga2qoi input.tga output.qoi\n";
+        return 1;
+    }
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+
+    const Image image = Image::loadUncompressedTGA(input);
+    if (image.data.empty()) {
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!Image::writeQOI(output, image)) {
+        return 1;
+    }
+    const double encodeSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    const Image decoded = Image::loadQOI(output);
+    const double decodeSeconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Compare in RGBA order, the TGA pixels are BGR(A) and the QOI pixels RGB(A)
+    const size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+    const bool lossless =
+        !decoded.data.empty() && decoded.width == image.width &&
+        decoded.height == image.height &&
+        BlockCompressor::toRGBA(image.data.data(), pixelCount, image.format) ==
+            BlockCompressor::toRGBA(decoded.data.data(), pixelCount, decoded.format);
+    if (!lossless) {
+        std::cerr << "Decoded image differs from the original ('" << output << "')\n";
+        return 1;
+    }
+
+    const double megabytes = image.data.size() / (1024.0 * 1024.0);
+    std::cout << output << ": " << image.width << " x " << image.height << ", "
+              << std::filesystem::file_size(input) << " -> " << std::filesystem::file_size(output)
+              << " bytes, encoded at " << megabytes / encodeSeconds << " MB/s, decoded at "
+              << megabytes / decodeSeconds << " MB/s\n";
+    return 0;
+}
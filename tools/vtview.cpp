@@ -0,0 +1,162 @@
+/*
+ * vtview - fly over a large TGA image with virtual texturing
+ *
+ * Usage: vtview image.tga [frames] [tileSize] [cacheTiles]
+ *
+ * The image is drawn on a quad that slowly zooms in from the whole image to one texel
+ * per pixel and back, while panning around. Every frame runs the feedback pass, loads the
+ * missing tiles and draws the image (see VirtualTexture). The tile hits, misses, uploads
+ * and evictions are printed once per second, and a summary is printed at the end. With
+ * a frame count the program exits by itself, which makes it usable with a software GL
+ * implementation such as Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1).
+ * Run it from a directory next to shaders/. Build together with GLprimer/VirtualTexture.cpp,
+ * Image.cpp, Shader.cpp, GLState.cpp, MappedFile.cpp, MemoryTracker.cpp and Trace.cpp.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "../GLprimer/GLState.hpp"
+#include "../GLprimer/Shader.hpp"
+#include "../GLprimer/VirtualTexture.hpp"
+
+namespace {
+
+void printStats(const VirtualTexture::Stats& stats) {
+    std::cout << "hits " << stats.hits << ", misses " << stats.misses << ", uploads "
+              << stats.uploads << ", evictions " << stats.evictions << ", resident "
+              << stats.resident << ", pending " << stats.pending << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: vtview image.tga [frames] [tileSize] [cacheTiles]\n";
+        return 1;
+    }
+    const long frames = (argc > 2) ? std::stol(argv[2]) : 0;
+    const GLuint tileSize = (argc > 3) ? std::stoul(argv[3]) : 128;
+    const GLuint cacheTiles = (argc > 4) ? std::stoul(argv[4]) : 16;
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    GLFWwindow* window = glfwCreateWindow(512, 512, "vtview", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Unable to open window. Terminating.\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    GLenum err = glewInit();
+    if (GLEW_OK != err) {
+        std::cerr << "Error: " << glewGetErrorString(err) << "\n";
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "GL renderer: " << glGetString(GL_RENDERER) << "\n";
+    glfwSwapInterval(0);
+
+    {
+        VirtualTexture texture(tileSize, cacheTiles);
+        if (!texture.open(argv[1])) {
+            glfwTerminate();
+            return 1;
+        }
+        Shader feedbackShader("../shaders/vertex.glsl", "../shaders/fragment_vt_feedback.glsl");
+        Shader shader("../shaders/vertex.glsl", "../shaders/fragment_vt.glsl");
+
+        // A quad with the aspect ratio of the image: x y z s t
+        const GLfloat aspect = GLfloat(texture.height()) / GLfloat(texture.width());
+        const std::array<GLfloat, 20> quad = {-1.0f, -aspect, 0.0f, 0.0f, 0.0f,
+                                              1.0f,  -aspect, 0.0f, 1.0f, 0.0f,
+                                              1.0f,  aspect,  0.0f, 1.0f, 1.0f,
+                                              -1.0f, aspect,  0.0f, 0.0f, 1.0f};
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        glGenVertexArrays(1, &vao);
+        GLState::bindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
+                              (void*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(2);
+        glVertexAttrib3f(1, 0.0f, 0.0f, 1.0f);  // Constant normal facing the viewer
+        GLState::bindVertexArray(0);
+
+        const std::array<GLfloat, 16> identity = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+                                                  0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                                                  0.0f, 0.0f, 0.0f, 1.0f};
+        const auto draw = [&](GLuint program, const std::array<GLfloat, 16>& MV) {
+            GLState::useProgram(program);
+            glUniformMatrix4fv(glGetUniformLocation(program, "MV"), 1, GL_FALSE, MV.data());
+            glUniformMatrix4fv(glGetUniformLocation(program, "P"), 1, GL_FALSE,
+                               identity.data());
+            glUniformMatrix4fv(glGetUniformLocation(program, "T"), 1, GL_FALSE,
+                               identity.data());
+            texture.setUniforms(program);
+            GLState::bindVertexArray(vao);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        };
+
+        GLState::enable(GL_DEPTH_TEST);
+        double lastReport = glfwGetTime();
+        for (long frame = 0; !glfwWindowShouldClose(window) && (frames == 0 || frame < frames);
+             frame++) {
+            int width, height;
+            glfwGetFramebufferSize(window, &width, &height);
+            glViewport(0, 0, width, height);
+
+            // Zoom from the whole image to one texel per pixel, panning in a circle
+            const double t = (frames > 0) ? 20.0 * frame / frames : glfwGetTime();
+            const double maxZoom = std::max(1.0, double(texture.width()) / width);
+            const GLfloat zoom = GLfloat(std::pow(maxZoom, 0.5 - 0.5 * std::cos(0.3 * t)));
+            const GLfloat x = GLfloat(0.5 * std::cos(0.2 * t));
+            const GLfloat y = GLfloat(0.5 * aspect * std::sin(0.2 * t));
+            const std::array<GLfloat, 16> MV = {zoom, 0.0f, 0.0f, 0.0f, 0.0f, zoom, 0.0f, 0.0f,
+                                                0.0f, 0.0f, 1.0f, 0.0f, -zoom * x, -zoom * y,
+                                                0.0f, 1.0f};
+
+            texture.beginFeedback();
+            draw(feedbackShader.id(), MV);
+            texture.endFeedback();
+            texture.update();
+
+            glClearColor(0.3f, 0.3f, 0.3f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            draw(shader.id(), MV);
+
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            if (glfwGetKey(window, GLFW_KEY_ESCAPE)) {
+                glfwSetWindowShouldClose(window, GL_TRUE);
+            }
+
+            if (glfwGetTime() - lastReport > 1.0) {
+                lastReport = glfwGetTime();
+                std::cout << "Frame " << frame << ": ";
+                printStats(texture.stats());
+            }
+        }
+
+        std::cout << "Total: ";
+        printStats(texture.stats());
+        GLState::deleteVertexArray(vao);
+        glDeleteBuffers(1, &vbo);
+    }
+
+    glfwTerminate();
+    return 0;
+}